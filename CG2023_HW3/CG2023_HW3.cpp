@@ -5,6 +5,11 @@
 #include "light.h"
 #include "imagetexture.h"
 #include "skybox.h"
+#include "modelloader.h"
+#include "texturecache.h"
+#include "textureuploader.h"
+#include "textureresidency.h"
+#include "texturearray.h"
 
 
 // Global variables.
@@ -15,6 +20,8 @@ std::string ModelPathChoice;
 std::string BackGroundPathChoice;
 // Triangle mesh.
 TriangleMesh* mesh = nullptr;
+// Background model loading.
+ModelLoader* modelLoader = nullptr;
 // Lights.
 DirectionalLight* dirLight = nullptr;
 PointLight* pointLight = nullptr;
@@ -45,6 +52,20 @@ SkyboxShaderProg* skyboxShader = nullptr;
 const float lightMoveSpeed = 0.2f;
 // Skybox.
 Skybox* skybox = nullptr;
+// Texture streaming (nullptr if PBOs or fences are not supported).
+TextureUploader* textureUploader = nullptr;
+// Texture mipmaps: downsampling filter, and whether to filter in linear light.
+const MipFilter textureMipFilter = MIP_FILTER_BOX;
+const bool gammaCorrectMips = true;
+// Texture compression: BC7 (if supported) instead of BC1/BC3, and encoder speed versus quality.
+const bool preferBC7 = false;
+const CompressionQuality textureCompressionQuality = COMPRESSION_NORMAL;
+// Host and GPU memory of all textures; over it, the least recently drawn ones lose detail.
+const size_t textureMemoryBudget = 512 * 1024 * 1024;
+// Host copies of texture pixels are freed once uploaded; HOST_PIXELS_RETAIN keeps them for debugging.
+const HostPixelPolicy textureHostPixels = HOST_PIXELS_RELEASE;
+// Vertex layout of loaded models: 16-byte quantized vertices, or VERTEX_FORMAT_FLOAT for 32-byte ones.
+const VertexFormat meshVertexFormat = VERTEX_FORMAT_PACKED;
 
 
 // SceneObject.
@@ -83,6 +104,8 @@ void ProcessSpecialKeysCB(int, int, int);
 void ProcessKeysCB(unsigned char, int, int);
 void SetupRenderState();
 void LoadObjects(const std::string&);
+void UpdateLoadedObjects();
+void ShowTextureStats();
 void CreateCamera();
 void CreateSkybox(const std::string);
 void CreateShaderLib();
@@ -90,11 +113,17 @@ void CreateShaderLib();
 
 void ReleaseResources()
 {
+    // Stop a model that is still loading before deleting the scene.
+    if (modelLoader != nullptr) {
+        delete modelLoader;
+        modelLoader = nullptr;
+    }
     // Delete scene objects and lights.
     if (mesh != nullptr) {
         delete mesh;
         mesh = nullptr;
     }
+    TextureCache::Clear();
     if (pointLight != nullptr) {
         delete pointLight;
         pointLight = nullptr;
@@ -125,6 +154,11 @@ void ReleaseResources()
         delete skyboxShader;
         skyboxShader = nullptr;
     }
+    // Delete the uploader after the textures it may still be streaming.
+    if (textureUploader != nullptr) {
+        delete textureUploader;
+        textureUploader = nullptr;
+    }
 }
 
 static float curSkyboxRotationY = 30.0f;
@@ -133,14 +167,25 @@ const float rotStep = 0.02f;
 void RenderSceneCB()
 {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // Swap in a model that finished loading in the background.
+    UpdateLoadedObjects();
+    // Continue streaming textures to the GPU.
+    if (textureUploader != nullptr)
+        textureUploader->Update();
+    // Keep all textures within the memory budget.
+    TextureResidency::Update(textureUploader);
     
     TriangleMesh* pMesh = sceneObj.mesh;
+    // Show the part of a large model that has been parsed so far instead.
+    if (modelLoader != nullptr && modelLoader->GetStreamingMesh() != nullptr)
+        pMesh = modelLoader->GetStreamingMesh();
     if (pMesh != nullptr) {
         // Update transform.
         curObjRotationY += rotStep;
         glm::mat4x4 S = glm::scale(glm::mat4x4(1.0f), glm::vec3(1.5f, 1.5f, 1.5f));
         glm::mat4x4 R = glm::rotate(glm::mat4x4(1.0f), glm::radians(curObjRotationY), glm::vec3(0, 1, 0));
-        sceneObj.worldMatrix = S * R;
+        sceneObj.worldMatrix = S * R * pMesh->GetModelMatrix();
 
         glm::mat4x4 normalMatrix = glm::transpose(glm::inverse(sceneObj.worldMatrix));
         //glm::mat4x4 normalMatrix = glm::transpose(glm::inverse(camera->GetViewMatrix() * sceneObj.worldMatrix));
@@ -153,25 +198,54 @@ void RenderSceneCB()
         glUniform3fv(phongShadingShader->GetLocCameraPos(), 1, glm::value_ptr(camera->GetCameraPos()));
         glUniformMatrix4fv(phongShadingShader->GetLocNM(), 1, GL_FALSE, glm::value_ptr(normalMatrix));
         glUniformMatrix4fv(phongShadingShader->GetLocMVP(), 1, GL_FALSE, glm::value_ptr(MVP));
-        for (auto& subMesh : sceneObj.mesh->GetSubMeshes()) {  // 用迴圈跑建立好的每個submesh，把所需的data傳進shader
+        // How to decode the mesh's vertices.
+        glUniform1i(phongShadingShader->GetLocPackedVertices(), pMesh->GetBufferFormat() == VERTEX_FORMAT_PACKED);
+        glUniform3fv(phongShadingShader->GetLocPositionScale(), 1, glm::value_ptr(pMesh->GetPackedPositionScale()));
+        glUniform3fv(phongShadingShader->GetLocPositionOffset(), 1, glm::value_ptr(pMesh->GetPackedPositionOffset()));
+        // Texture arrays sample from unit 1, single textures from unit 0.
+        pMesh->UpdateTextureArrays();
+        glUniform1i(phongShadingShader->GetLocMapKd(), 0);
+        glUniform1i(phongShadingShader->GetLocMapKdArray(), 1);
+        const PhongMaterial* lastMaterial = nullptr;
+        const TextureArray* boundArray = nullptr;
+        for (auto& subMesh : pMesh->GetSubMeshes()) {  // 用迴圈跑建立好的每個submesh，把所需的data傳進shader
 
             // Material properties. (Get materials' datas to shader)
-            glUniform3fv(phongShadingShader->GetLocKa(), 1, glm::value_ptr(subMesh.material->GetKa()));
-            glUniform3fv(phongShadingShader->GetLocKd(), 1, glm::value_ptr(subMesh.material->GetKd()));
-            glUniform3fv(phongShadingShader->GetLocKs(), 1, glm::value_ptr(subMesh.material->GetKs()));
-            glUniform1f(phongShadingShader->GetLocNs(), subMesh.material->GetNs());
-
-            if (subMesh.material->GetMapKd() != nullptr) {
-                subMesh.material->GetMapKd()->Bind(GL_TEXTURE0);
-                glUniform1i(phongShadingShader->GetLocMapKd(), 0);
+            // Skipped while they equal those of the previous subMesh.
+            const PhongMaterial* material = subMesh.material;
+            if (lastMaterial == nullptr || material->GetKa() != lastMaterial->GetKa() || material->GetKd() != lastMaterial->GetKd() ||
+                material->GetKs() != lastMaterial->GetKs() || material->GetNs() != lastMaterial->GetNs() ||
+                material->GetMapKdRegion() != lastMaterial->GetMapKdRegion()) {
+                glUniform3fv(phongShadingShader->GetLocKa(), 1, glm::value_ptr(material->GetKa()));
+                glUniform3fv(phongShadingShader->GetLocKd(), 1, glm::value_ptr(material->GetKd()));
+                glUniform3fv(phongShadingShader->GetLocKs(), 1, glm::value_ptr(material->GetKs()));
+                glUniform1f(phongShadingShader->GetLocNs(), material->GetNs());
+                glUniform4fv(phongShadingShader->GetLocMapKdRegion(), 1, glm::value_ptr(material->GetMapKdRegion()));
+                lastMaterial = material;
+            }
+
+            if (subMesh.textureArray != nullptr && subMesh.textureArray->IsReady()) {
+                // One binding for all subMeshes of the array; only the layer changes per draw.
+                if (subMesh.textureArray != boundArray) {
+                    subMesh.textureArray->Bind(GL_TEXTURE1);
+                    boundArray = subMesh.textureArray;
+                }
                 glUniform1i(phongShadingShader->MapKdExist(), 1);
+                glUniform1i(phongShadingShader->GetLocMapKdLayer(), subMesh.textureLayer);
+            }
+            else if (material->GetMapKd() != nullptr && material->GetMapKd()->IsUploaded()) {
+                material->GetMapKd()->Bind(GL_TEXTURE0);
+                glUniform1i(phongShadingShader->MapKdExist(), 1);
+                glUniform1i(phongShadingShader->GetLocMapKdLayer(), -1);
             }
             else {
                 glUniform1i(phongShadingShader->MapKdExist(), 0);
             }
             // Render the mesh.
-            sceneObj.mesh->Rendering(subMesh);  // 把transformation, light data, 傳進Rendering函式做render
+            pMesh->Rendering(subMesh);  // 把transformation, light data, 傳進Rendering函式做render
         }
+        if (boundArray != nullptr)
+            glActiveTexture(GL_TEXTURE0);
         // Light data.
         // Directional Light
         if (dirLight != nullptr) {
@@ -306,37 +380,55 @@ void ProcessKeysCB(unsigned char key, int x, int y)
         if (key == 's')
             spotLight->MoveDown(lightMoveSpeed);
     }
+    // Print the texture statistics, including the uploads still outstanding.
+    if (key == 't')
+        ShowTextureStats();
+    // Compare the CPU-built mipmaps of the scene's textures with the driver's.
+    if (key == 'm') {
+        std::vector<ImageTexture*> textures;
+        if (mesh != nullptr) {
+            for (const SubMesh& subMesh : mesh->GetSubMeshes()) {
+                ImageTexture* texture = subMesh.material->GetMapKd();
+                if (texture != nullptr && texture->IsUploaded() && std::find(textures.begin(), textures.end(), texture) == textures.end())
+                    textures.push_back(texture);
+            }
+        }
+        if (skybox != nullptr && skybox->GetTexture()->IsUploaded())
+            textures.push_back(skybox->GetTexture());
+        for (ImageTexture* texture : textures)
+            texture->CompareMipsWithDriver();
+    }
 }
 
 void Menu(int choice)
 {
     switch (choice) {
     case 1:
-        ModelPathChoice = "../../CG2023_HW3/TestModels_HW3/Arcanine/Arcanine.obj";
+        ModelPathChoice = "../../CG2023_HW3/TestModels_HW3/Arcanine/Arcanine.objm";
         break;
     case 2:
         ModelPathChoice = "../../CG2023_HW3/TestModels_HW3/Ferrari/Ferrari.obj";
         break;
     case 3:
-        ModelPathChoice = "../../CG2023_HW3/TestModels_HW3/Gengar/Gengar.obj";
+        ModelPathChoice = "../../CG2023_HW3/TestModels_HW3/Gengar/Gengar.objm";
         break;
     case 4:
-        ModelPathChoice = "../../CG2023_HW3/TestModels_HW3/Ivysaur/Ivysaur.obj";
+        ModelPathChoice = "../../CG2023_HW3/TestModels_HW3/Ivysaur/Ivysaur.objm";
         break;
     case 5:
-        ModelPathChoice = "../../CG2023_HW3/TestModels_HW3/Koffing/Koffing.obj";
+        ModelPathChoice = "../../CG2023_HW3/TestModels_HW3/Koffing/Koffing.objm";
         break;
     case 6:
-        ModelPathChoice = "../../CG2023_HW3/TestModels_HW3/MagikarpF/MagikarpF.obj";
+        ModelPathChoice = "../../CG2023_HW3/TestModels_HW3/MagikarpF/MagikarpF.objm";
         break;
     case 7:
         ModelPathChoice = "../../CG2023_HW3/TestModels_HW3/Rose/Rose.obj";
         break;
     case 8:
-        ModelPathChoice = "../../CG2023_HW3/TestModels_HW3/Slowbro/Slowbro.obj";
+        ModelPathChoice = "../../CG2023_HW3/TestModels_HW3/Slowbro/Slowbro.objm";
         break;
     case 9:
-        ModelPathChoice = "../../CG2023_HW3/TestModels_HW3/TexCube/TexCube.obj";
+        ModelPathChoice = "../../CG2023_HW3/TestModels_HW3/TexCube/TexCube.objm";
         break;
     case 10:
         BackGroundPathChoice = "../../CG2023_HW3/TestTextures_HW3/photostudio_02_2k.png";
@@ -395,21 +487,60 @@ void SetupRenderState()
 void LoadObjects(const std::string& modelPath)
 {
     // -------------------------------------------------------
-	// Note: you can change the code below if you want to load
-    //       the model dynamically.
-    // load下一個圖前先把前一個圖的mesh刪掉
-    if (mesh != nullptr) {
-        delete mesh;
-        mesh = nullptr;
-    };
+	// Note: the model is parsed on a worker thread; the current mesh
+    //       keeps rendering until UpdateLoadedObjects() swaps in the new one.
+    //       Picking another model while loading cancels the old load.
 	// -------------------------------------------------------
+    if (modelLoader == nullptr)
+        modelLoader = new ModelLoader();
+    modelLoader->Request(modelPath);
+}
+
+void UpdateLoadedObjects()
+{
+    if (modelLoader == nullptr)
+        return;
+    TriangleMesh* loadedMesh = modelLoader->TakeLoadedMesh();
+    if (loadedMesh == nullptr) {
+        // Upload what a streamed load has parsed since the last frame.
+        modelLoader->UpdateStreamingMesh();
+        return;
+    }
 
-    mesh = new TriangleMesh();
-    mesh->LoadFromFile(modelPath, true);
-    mesh->ShowInfo();
-    sceneObj.mesh = mesh;  
+    // Only the GL upload happens on this thread.
+    loadedMesh->SetVertexFormat(meshVertexFormat);
+    loadedMesh->CreateBuffers(textureUploader);
+    loadedMesh->ShowInfo();
+
+    // Delete the previous mesh only now that the new one is ready.
+    TriangleMesh* oldMesh = mesh;
+    mesh = loadedMesh;
+    sceneObj.mesh = mesh;
+    if (oldMesh != nullptr)
+        delete oldMesh;
+    // Textures the old model no longer needs stay resident up to the cache budget.
+    TextureCache::Trim();
+    ShowTextureStats();
+}
 
-    mesh->CreateBuffers();
+// Print the texture cache, texture memory and the uploads still on their way to the GPU.
+void ShowTextureStats()
+{
+    const TextureCacheStats textureStats = TextureCache::GetStats();
+    std::cout << "[INFO] Texture cache: " << textureStats.numTextures << " textures ("
+              << textureStats.totalBytes / (1024 * 1024) << " MB), " << textureStats.numUnused << " unused, "
+              << textureStats.numHits << " hits / " << textureStats.numMisses << " decodes" << std::endl;
+    const TextureMemoryStats memoryStats = TextureResidency::GetStats();
+    std::cout << "[INFO] Texture memory: " << memoryStats.currentBytes / (1024 * 1024) << " MB (peak "
+              << memoryStats.peakBytes / (1024 * 1024) << " MB, budget " << memoryStats.budgetBytes / (1024 * 1024) << " MB), "
+              << memoryStats.numReduced << " of " << memoryStats.numTextures << " textures reduced; "
+              << memoryStats.numDroppedLevels << " levels dropped, " << memoryStats.numRestored << " restores, "
+              << memoryStats.numEvicted << " evicted" << std::endl;
+    if (textureUploader != nullptr) {
+        std::cout << "[INFO] Texture uploads: " << textureUploader->GetOutstandingBytes() / 1024 << " KB outstanding ("
+                  << textureUploader->GetPendingBytes() / 1024 << " KB queued, " << textureUploader->GetInFlightBytes() / 1024
+                  << " KB in flight)" << std::endl;
+    }
 }
 
 void CreateLights()
@@ -451,7 +582,7 @@ void CreateSkybox(const std::string texFilePath)
     const int numSlices = 36;
     const int numStacks = 18;
     const float radius = 50.0f;
-    skybox = new Skybox(texFilePath, numSlices, numStacks, radius);
+    skybox = new Skybox(texFilePath, numSlices, numStacks, radius, textureUploader);
 }
 
 void CreateShaderLib()
@@ -489,6 +620,20 @@ int main(int argc, char** argv)
 
     // Initialization.
     SetupRenderState();
+    if (TextureUploader::IsSupported())
+        textureUploader = new TextureUploader();
+    // Without the extensions, textures stay uncompressed.
+    TextureDecodeOptions decodeOptions;
+    decodeOptions.mipFilter = textureMipFilter;
+    decodeOptions.gammaCorrectMips = gammaCorrectMips;
+    decodeOptions.useBC7 = preferBC7 && (GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc);
+    decodeOptions.compress = decodeOptions.useBC7 || GLEW_EXT_texture_compression_s3tc;
+    decodeOptions.quality = textureCompressionQuality;
+    ImageTexture::SetDecodeOptions(decodeOptions);
+    TextureResidency::SetBudget(textureMemoryBudget);
+    ImageTexture::SetHostPixelPolicy(textureHostPixels);
+    if (!decodeOptions.compress)
+        std::cout << "[INFO] S3TC texture compression is not supported; textures are uploaded uncompressed" << std::endl;
     // LoadObjects("../../CG2023_HW3/TestModels_HW3/Ferrari/Ferrari.obj");
     CreateLights();
     CreateCamera();
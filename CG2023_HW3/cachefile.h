@@ -0,0 +1,91 @@
+#ifndef CACHE_FILE_H
+#define CACHE_FILE_H
+
+#include "headers.h"
+#include "meshcache.h"
+
+// Binary I/O shared by the sidecar cache files (see MeshCache and MipCache).
+
+// Sequential writer for the cache file.
+class CacheWriter
+{
+public:
+	explicit CacheWriter(std::ofstream& stream) : out(stream) {}
+
+	void Write(const void* data, const size_t size) { out.write((const char*)data, (std::streamsize)size); }
+	template <typename T>
+	void WriteValue(const T& value) { Write(&value, sizeof(T)); }
+	void WriteString(const std::string& s) {
+		WriteValue((unsigned int)s.size());
+		Write(s.data(), s.size());
+	}
+	void WriteStamp(const CachedFileStamp& stamp) {
+		WriteString(stamp.path);
+		WriteValue(stamp.size);
+		WriteValue(stamp.modifiedTime);
+	}
+
+private:
+	std::ofstream& out;
+};
+
+// Bounds-checked reader over the mapped cache file.
+class CacheReader
+{
+public:
+	CacheReader(const char* data, const size_t size) : cur(data), end(data + size), ok(true) {}
+
+	bool IsOk() const { return ok; }
+	bool Read(void* data, const size_t size) {
+		if (!ok || (size_t)(end - cur) < size) {
+			ok = false;
+			return false;
+		}
+		if (size > 0)
+			std::memcpy(data, cur, size);
+		cur += size;
+		return true;
+	}
+	template <typename T>
+	bool ReadValue(T& value) { return Read(&value, sizeof(T)); }
+	bool ReadString(std::string& s) {
+		unsigned int length = 0;
+		if (!ReadValue(length) || (size_t)(end - cur) < length) {
+			ok = false;
+			return false;
+		}
+		s.assign(cur, length);
+		cur += length;
+		return true;
+	}
+	bool ReadStamp(CachedFileStamp& stamp) {
+		return ReadString(stamp.path) && ReadValue(stamp.size) && ReadValue(stamp.modifiedTime);
+	}
+	// Read the count of a list of records that take at least minRecordBytes each; a count the rest
+	// of the file cannot hold is rejected before anything is allocated for it.
+	bool ReadCount(unsigned int& count, const size_t minRecordBytes) {
+		if (!ReadValue(count) || count > (size_t)(end - cur) / minRecordBytes) {
+			ok = false;
+			return false;
+		}
+		return true;
+	}
+	// Read an array with a count prefix, as a single copy.
+	template <typename T>
+	bool ReadArray(std::vector<T>& values) {
+		unsigned long long count = 0;
+		if (!ReadValue(count) || count > (unsigned long long)(end - cur) / sizeof(T)) {
+			ok = false;
+			return false;
+		}
+		values.resize((size_t)count);
+		return Read(values.data(), sizeof(T) * (size_t)count);
+	}
+
+private:
+	const char* cur;
+	const char* end;
+	bool ok;
+};
+
+#endif
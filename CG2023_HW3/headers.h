@@ -15,10 +15,25 @@
 // C++ STL headers.
 #include <iostream>
 #include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <deque>
 #include <string>
 #include <iomanip>
 #include <fstream>
 #include <sstream>
 #include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+#include <climits>
+#include <charconv>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
 
 #endif
@@ -0,0 +1,1204 @@
+#include "imagedecoder.h"
+
+static const unsigned char PNG_SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+static unsigned int ReadBigEndian32(const unsigned char* p)
+{
+	return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3];
+}
+
+static unsigned int ReadBigEndian16(const unsigned char* p)
+{
+	return ((unsigned int)p[0] << 8) | p[1];
+}
+
+// Store one pixel as 1 (gray), 3 (RGB) or 4 (RGBA) channels.
+static inline void StorePixel(unsigned char* out, const int numChannels, const int r, const int g, const int b, const int a)
+{
+	if (numChannels == 1) {
+		out[0] = (unsigned char)((r * 77 + g * 150 + b * 29 + 128) >> 8);
+		return;
+	}
+	out[0] = (unsigned char)r;
+	out[1] = (unsigned char)g;
+	out[2] = (unsigned char)b;
+	if (numChannels == 4)
+		out[3] = (unsigned char)a;
+}
+
+// ---------------------------------------------------------------------------------------------
+// DEFLATE (zlib streams of PNG).
+
+// Huffman codes up to this many bits are decoded with one table lookup.
+static const int INFLATE_FAST_BITS = 10;
+
+struct InflateHuffman
+{
+	// (symbol << 4) | code length, indexed by the next INFLATE_FAST_BITS bits; 0 for longer codes.
+	unsigned short fast[1 << INFLATE_FAST_BITS];
+	// Canonical code ranges per length, for the longer codes.
+	int firstCode[16];
+	int firstSymbol[16];
+	// One past the last code of each length, left-aligned to 16 bits.
+	int maxCode[17];
+	unsigned short symbols[288];
+};
+
+struct InflateStream
+{
+	const unsigned char* data;
+	size_t size;
+	size_t pos;
+	unsigned long long bits;
+	int numBits;
+};
+
+static const int LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const int LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const int DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+									   4097, 6145, 8193, 12289, 16385, 24577 };
+static const int DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static const unsigned char CODE_LENGTH_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+static int ReverseBits(int code, const int numBits)
+{
+	int reversed = 0;
+	for (int i = 0; i < numBits; i++, code >>= 1)
+		reversed = (reversed << 1) | (code & 1);
+	return reversed;
+}
+
+static bool BuildInflateHuffman(InflateHuffman& table, const unsigned char* lengths, const int numSymbols)
+{
+	int counts[16] = {};
+	for (int i = 0; i < numSymbols; i++)
+		counts[lengths[i]]++;
+	counts[0] = 0;
+	std::memset(table.fast, 0, sizeof(table.fast));
+
+	int nextCode[16] = {};
+	int code = 0;
+	int symbol = 0;
+	for (int length = 1; length < 16; length++) {
+		nextCode[length] = code;
+		table.firstCode[length] = code;
+		table.firstSymbol[length] = symbol;
+		code += counts[length];
+		if (counts[length] != 0 && code > (1 << length))  // Oversubscribed
+			return false;
+		table.maxCode[length] = code << (16 - length);
+		code <<= 1;
+		symbol += counts[length];
+	}
+	table.maxCode[16] = 0x10000;
+
+	for (int i = 0; i < numSymbols; i++) {
+		const int length = lengths[i];
+		if (length == 0)
+			continue;
+		table.symbols[nextCode[length] - table.firstCode[length] + table.firstSymbol[length]] = (unsigned short)i;
+		if (length <= INFLATE_FAST_BITS) {
+			// The stream holds codes most significant bit first, read from the low bits up.
+			for (int j = ReverseBits(nextCode[length], length); j < (1 << INFLATE_FAST_BITS); j += 1 << length)
+				table.fast[j] = (unsigned short)((i << 4) | length);
+		}
+		nextCode[length]++;
+	}
+	return true;
+}
+
+static inline void Refill(InflateStream& stream)
+{
+	while (stream.numBits <= 56) {
+		const unsigned long long byte = (stream.pos < stream.size) ? stream.data[stream.pos] : 0;
+		stream.pos++;
+		stream.bits |= byte << stream.numBits;
+		stream.numBits += 8;
+	}
+}
+
+static inline unsigned int GetBits(InflateStream& stream, const int numBits)
+{
+	if (stream.numBits < numBits)
+		Refill(stream);
+	const unsigned int value = (unsigned int)(stream.bits & ((1ull << numBits) - 1));
+	stream.bits >>= numBits;
+	stream.numBits -= numBits;
+	return value;
+}
+
+// Next symbol, or -1 for a code that is not in the table.
+static inline int DecodeSymbol(InflateStream& stream, const InflateHuffman& table)
+{
+	if (stream.numBits < 16)
+		Refill(stream);
+	const int entry = table.fast[stream.bits & ((1 << INFLATE_FAST_BITS) - 1)];
+	if (entry != 0) {
+		const int length = entry & 15;
+		stream.bits >>= length;
+		stream.numBits -= length;
+		return entry >> 4;
+	}
+	const int code = ReverseBits((int)(stream.bits & 0xffff), 16);
+	int length = INFLATE_FAST_BITS + 1;
+	while (code >= table.maxCode[length])
+		length++;
+	if (length >= 16)
+		return -1;
+	stream.bits >>= length;
+	stream.numBits -= length;
+	return table.symbols[(code >> (16 - length)) - table.firstCode[length] + table.firstSymbol[length]];
+}
+
+static const InflateHuffman* GetFixedTables()
+{
+	static InflateHuffman tables[2];
+	static const bool built = []() {
+		unsigned char lengths[288];
+		for (int i = 0; i < 288; i++)
+			lengths[i] = (i < 144) ? 8 : (i < 256) ? 9 : (i < 280) ? 7 : 8;
+		BuildInflateHuffman(tables[0], lengths, 288);
+		for (int i = 0; i < 30; i++)
+			lengths[i] = 5;
+		BuildInflateHuffman(tables[1], lengths, 30);
+		return true;
+	}();
+	(void)built;
+	return tables;
+}
+
+// Inflate a zlib stream into exactly outSize bytes.
+static bool Inflate(const unsigned char* data, const size_t size, unsigned char* out, const size_t outSize)
+{
+	if (size < 2 || (data[0] & 15) != 8 || ((data[0] << 8) | data[1]) % 31 != 0 || (data[1] & 32) != 0)
+		return false;
+	InflateStream stream = { data, size, 2, 0, 0 };
+	size_t written = 0;
+	InflateHuffman dynamicTables[2];
+	bool finalBlock = false;
+	while (!finalBlock) {
+		finalBlock = GetBits(stream, 1) != 0;
+		const unsigned int type = GetBits(stream, 2);
+		if (type == 0) {
+			// Stored block: give the whole bytes in the bit buffer back and copy directly.
+			stream.bits >>= stream.numBits & 7;
+			stream.numBits -= stream.numBits & 7;
+			stream.pos -= stream.numBits / 8;
+			stream.bits = 0;
+			stream.numBits = 0;
+			if (stream.pos + 4 > size)
+				return false;
+			const unsigned int length = data[stream.pos] | (data[stream.pos + 1] << 8);
+			const unsigned int inverse = data[stream.pos + 2] | (data[stream.pos + 3] << 8);
+			stream.pos += 4;
+			if ((length ^ 0xffff) != inverse || stream.pos + length > size || written + length > outSize)
+				return false;
+			std::memcpy(out + written, data + stream.pos, length);
+			stream.pos += length;
+			written += length;
+			continue;
+		}
+		if (type == 3)
+			return false;
+
+		const InflateHuffman* tables = GetFixedTables();
+		if (type == 2) {
+			const int numLiteralCodes = GetBits(stream, 5) + 257;
+			const int numDistanceCodes = GetBits(stream, 5) + 1;
+			const int numCodeLengthCodes = GetBits(stream, 4) + 4;
+			if (numLiteralCodes > 286 || numDistanceCodes > 30)
+				return false;
+			unsigned char codeLengthLengths[19] = {};
+			for (int i = 0; i < numCodeLengthCodes; i++)
+				codeLengthLengths[CODE_LENGTH_ORDER[i]] = (unsigned char)GetBits(stream, 3);
+			InflateHuffman codeLengthTable;
+			if (!BuildInflateHuffman(codeLengthTable, codeLengthLengths, 19))
+				return false;
+			unsigned char lengths[286 + 30] = {};
+			int n = 0;
+			while (n < numLiteralCodes + numDistanceCodes) {
+				const int symbol = DecodeSymbol(stream, codeLengthTable);
+				if (symbol < 0)
+					return false;
+				if (symbol < 16) {
+					lengths[n++] = (unsigned char)symbol;
+					continue;
+				}
+				int repeat = 0;
+				unsigned char value = 0;
+				if (symbol == 16) {
+					if (n == 0)
+						return false;
+					repeat = 3 + GetBits(stream, 2);
+					value = lengths[n - 1];
+				}
+				else {
+					repeat = (symbol == 17) ? 3 + GetBits(stream, 3) : 11 + GetBits(stream, 7);
+				}
+				if (n + repeat > numLiteralCodes + numDistanceCodes)
+					return false;
+				std::memset(lengths + n, value, repeat);
+				n += repeat;
+			}
+			if (!BuildInflateHuffman(dynamicTables[0], lengths, numLiteralCodes) ||
+				!BuildInflateHuffman(dynamicTables[1], lengths + numLiteralCodes, numDistanceCodes))
+				return false;
+			tables = dynamicTables;
+		}
+
+		for (;;) {
+			const int symbol = DecodeSymbol(stream, tables[0]);
+			if (symbol < 256) {
+				if (symbol < 0 || written == outSize)
+					return false;
+				out[written++] = (unsigned char)symbol;
+				continue;
+			}
+			if (symbol == 256)
+				break;
+			if (symbol > 285)
+				return false;
+			const size_t length = LENGTH_BASE[symbol - 257] + GetBits(stream, LENGTH_EXTRA[symbol - 257]);
+			const int distanceSymbol = DecodeSymbol(stream, tables[1]);
+			if (distanceSymbol < 0 || distanceSymbol > 29)
+				return false;
+			const size_t distance = DISTANCE_BASE[distanceSymbol] + GetBits(stream, DISTANCE_EXTRA[distanceSymbol]);
+			if (distance > written || written + length > outSize)
+				return false;
+			unsigned char* target = out + written;
+			const unsigned char* source = target - distance;
+			if (distance >= length) {
+				std::memcpy(target, source, length);
+			}
+			else {
+				for (size_t i = 0; i < length; i++)  // Overlapping: repeats the last distance bytes
+					target[i] = source[i];
+			}
+			written += length;
+		}
+		// Reading past the end only ever yields zero bits.
+		if (stream.pos > size + 8)
+			return false;
+	}
+	return written == outSize;
+}
+
+// ---------------------------------------------------------------------------------------------
+// PNG.
+
+struct PngHeader
+{
+	int width;
+	int height;
+	int bitDepth;
+	int colorType;
+	bool interlaced;
+};
+
+// Samples per pixel of a PNG color type (palette indices count as one); 0 if invalid.
+static int GetPngSamples(const int colorType)
+{
+	switch (colorType) {
+	case 0: return 1;
+	case 2: return 3;
+	case 3: return 1;
+	case 4: return 2;
+	case 6: return 4;
+	default: return 0;
+	}
+}
+
+static bool ReadPngHeader(const unsigned char* data, const size_t size, PngHeader& header)
+{
+	if (size < 33 || std::memcmp(data, PNG_SIGNATURE, 8) != 0 || ReadBigEndian32(data + 8) != 13 || std::memcmp(data + 12, "IHDR", 4) != 0)
+		return false;
+	header.width = (int)ReadBigEndian32(data + 16);
+	header.height = (int)ReadBigEndian32(data + 20);
+	header.bitDepth = data[24];
+	header.colorType = data[25];
+	header.interlaced = data[28] != 0;
+	const int depth = header.bitDepth;
+	if (header.width <= 0 || header.height <= 0 || GetPngSamples(header.colorType) == 0 || data[26] != 0 || data[27] != 0)
+		return false;
+	if (depth != 1 && depth != 2 && depth != 4 && depth != 8 && depth != 16)
+		return false;
+	if ((header.colorType == 3 && depth == 16) || (header.colorType != 0 && header.colorType != 3 && depth < 8))
+		return false;
+	return true;
+}
+
+// Undo the filter of one row in place; previous is the unfiltered row above (zeros for the first).
+static bool UnfilterRow(const int filter, unsigned char* row, const unsigned char* previous, const size_t rowSize, const size_t pixelBytes)
+{
+	switch (filter) {
+	case 0:
+		return true;
+	case 1:
+		for (size_t i = pixelBytes; i < rowSize; i++)
+			row[i] = (unsigned char)(row[i] + row[i - pixelBytes]);
+		return true;
+	case 2:
+		for (size_t i = 0; i < rowSize; i++)
+			row[i] = (unsigned char)(row[i] + previous[i]);
+		return true;
+	case 3:
+		for (size_t i = 0; i < rowSize; i++) {
+			const int left = (i >= pixelBytes) ? row[i - pixelBytes] : 0;
+			row[i] = (unsigned char)(row[i] + ((left + previous[i]) >> 1));
+		}
+		return true;
+	case 4:
+		for (size_t i = 0; i < rowSize; i++) {
+			const int a = (i >= pixelBytes) ? row[i - pixelBytes] : 0;
+			const int b = previous[i];
+			const int c = (i >= pixelBytes) ? previous[i - pixelBytes] : 0;
+			const int p = a + b - c;
+			const int pa = std::abs(p - a);
+			const int pb = std::abs(p - b);
+			const int pc = std::abs(p - c);
+			const int predictor = (pa <= pb && pa <= pc) ? a : (pb <= pc) ? b : c;
+			row[i] = (unsigned char)(row[i] + predictor);
+		}
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool DecodePng(const unsigned char* data, const size_t size, const int numChannels, unsigned char* pixels, const size_t rowBytes)
+{
+	PngHeader header;
+	if (!ReadPngHeader(data, size, header) || header.interlaced)
+		return false;
+
+	// Collect the chunks that matter.
+	unsigned char palette[256][4];
+	for (int i = 0; i < 256; i++) {
+		palette[i][0] = palette[i][1] = palette[i][2] = 0;
+		palette[i][3] = 255;
+	}
+	int transparentKey[3] = { -1, -1, -1 };
+	std::vector<unsigned char> compressed;
+	size_t pos = 8;
+	while (pos + 12 <= size) {
+		const size_t length = ReadBigEndian32(data + pos);
+		const unsigned char* type = data + pos + 4;
+		const unsigned char* chunk = data + pos + 8;
+		if (length > size - pos - 12)
+			return false;
+		if (std::memcmp(type, "PLTE", 4) == 0) {
+			for (size_t i = 0; i < length / 3 && i < 256; i++) {
+				palette[i][0] = chunk[3 * i];
+				palette[i][1] = chunk[3 * i + 1];
+				palette[i][2] = chunk[3 * i + 2];
+			}
+		}
+		else if (std::memcmp(type, "tRNS", 4) == 0) {
+			if (header.colorType == 3) {
+				for (size_t i = 0; i < length && i < 256; i++)
+					palette[i][3] = chunk[i];
+			}
+			else if (header.colorType == 0 && length >= 2) {
+				transparentKey[0] = (int)ReadBigEndian16(chunk);
+			}
+			else if (header.colorType == 2 && length >= 6) {
+				for (int c = 0; c < 3; c++)
+					transparentKey[c] = (int)ReadBigEndian16(chunk + 2 * c);
+			}
+		}
+		else if (std::memcmp(type, "IDAT", 4) == 0) {
+			compressed.insert(compressed.end(), chunk, chunk + length);
+		}
+		else if (std::memcmp(type, "IEND", 4) == 0) {
+			break;
+		}
+		pos += length + 12;
+	}
+
+	const int numSamples = GetPngSamples(header.colorType);
+	const int depth = header.bitDepth;
+	const size_t rowSize = ((size_t)header.width * numSamples * depth + 7) / 8;
+	const size_t pixelBytes = std::max<size_t>(1, (size_t)numSamples * depth / 8);
+	std::vector<unsigned char> raw((rowSize + 1) * header.height);
+	if (!Inflate(compressed.data(), compressed.size(), raw.data(), raw.size()))
+		return false;
+	std::vector<unsigned char>().swap(compressed);
+
+	const std::vector<unsigned char> zeroRow(rowSize, 0);
+	const unsigned char* previous = zeroRow.data();
+	const int maxSample = (1 << depth) - 1;
+	for (int y = 0; y < header.height; y++) {
+		unsigned char* row = raw.data() + (rowSize + 1) * y + 1;
+		if (!UnfilterRow(row[-1], row, previous, rowSize, pixelBytes))
+			return false;
+		previous = row;
+
+		// The first row of the file is the top of the image, so it goes last.
+		unsigned char* out = pixels + rowBytes * (header.height - 1 - y);
+		if (depth == 8 && ((header.colorType == 2 && numChannels == 3) || (header.colorType == 6 && numChannels == 4) ||
+						   (header.colorType == 0 && numChannels == 1))) {
+			std::memcpy(out, row, rowSize);
+			continue;
+		}
+		for (int x = 0; x < header.width; x++) {
+			// Samples of this pixel at their full depth.
+			int samples[4] = { 0, 0, 0, 0 };
+			for (int c = 0; c < numSamples; c++) {
+				const size_t index = (size_t)x * numSamples + c;
+				if (depth == 8)
+					samples[c] = row[index];
+				else if (depth == 16)
+					samples[c] = (row[2 * index] << 8) | row[2 * index + 1];
+				else
+					samples[c] = (row[(index * depth) >> 3] >> (8 - depth - ((index * depth) & 7))) & maxSample;
+			}
+			const int shift = (depth == 16) ? 8 : 0;
+			const int scale = (depth < 8) ? 255 / maxSample : 1;
+			switch (header.colorType) {
+			case 0: {
+				const int v = (samples[0] >> shift) * scale;
+				StorePixel(out + (size_t)x * numChannels, numChannels, v, v, v, (samples[0] == transparentKey[0]) ? 0 : 255);
+				break;
+			}
+			case 2: {
+				const bool transparent = samples[0] == transparentKey[0] && samples[1] == transparentKey[1] && samples[2] == transparentKey[2];
+				StorePixel(out + (size_t)x * numChannels, numChannels, samples[0] >> shift, samples[1] >> shift, samples[2] >> shift,
+						   transparent ? 0 : 255);
+				break;
+			}
+			case 3: {
+				const unsigned char* entry = palette[samples[0]];
+				StorePixel(out + (size_t)x * numChannels, numChannels, entry[0], entry[1], entry[2], entry[3]);
+				break;
+			}
+			case 4: {
+				const int v = samples[0] >> shift;
+				StorePixel(out + (size_t)x * numChannels, numChannels, v, v, v, samples[1] >> shift);
+				break;
+			}
+			default:
+				StorePixel(out + (size_t)x * numChannels, numChannels, samples[0] >> shift, samples[1] >> shift, samples[2] >> shift,
+						   samples[3] >> shift);
+				break;
+			}
+		}
+	}
+	return true;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Baseline JPEG.
+
+static const unsigned char JPEG_ZIGZAG[64 + 16] = {
+	0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+	12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+	// Overrun of a corrupt block lands here instead of outside the block.
+	63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63
+};
+
+// Codes up to this many bits are decoded with one table lookup.
+static const int JPEG_FAST_BITS = 9;
+
+struct JpegHuffman
+{
+	// Index into values of the code starting with the next JPEG_FAST_BITS bits; 255 for longer codes.
+	unsigned char fast[1 << JPEG_FAST_BITS];
+	unsigned short codes[256];
+	unsigned char values[256];
+	unsigned char sizes[257];
+	// One past the last code of each length, left-aligned to 16 bits.
+	unsigned int maxCode[18];
+	// Value index minus code, per length.
+	int delta[17];
+};
+
+struct JpegComponent
+{
+	int id;
+	int h;
+	int v;
+	int quantTable;
+	int dcTable;
+	int acTable;
+	int dcPredictor;
+	// Decoded samples, padded to whole MCUs.
+	int planeWidth;
+	int planeHeight;
+	std::vector<unsigned char> plane;
+};
+
+struct JpegDecoder
+{
+	const unsigned char* data;
+	size_t size;
+	size_t pos;
+	// Entropy-coded bits, most significant first.
+	unsigned int bits;
+	int numBits;
+	bool markerReached;
+
+	int width;
+	int height;
+	int maxH;
+	int maxV;
+	int numMcusX;
+	int numMcusY;
+	int restartInterval;
+	bool frameRead;
+	bool adobeRgb;
+	// Dequantization tables in natural order, with the IDCT's scale factors folded in.
+	float quant[4][64];
+	JpegHuffman dcTables[4];
+	JpegHuffman acTables[4];
+	std::vector<JpegComponent> components;
+};
+
+static bool BuildJpegHuffman(JpegHuffman& table, const int counts[16])
+{
+	int k = 0;
+	for (int i = 0; i < 16; i++) {
+		for (int j = 0; j < counts[i]; j++) {
+			if (k >= 256)
+				return false;
+			table.sizes[k++] = (unsigned char)(i + 1);
+		}
+	}
+	table.sizes[k] = 0;
+
+	int code = 0;
+	k = 0;
+	for (int length = 1; length <= 16; length++) {
+		table.delta[length] = k - code;
+		while (table.sizes[k] == length)
+			table.codes[k++] = (unsigned short)code++;
+		if (code > (1 << length))  // Oversubscribed
+			return false;
+		table.maxCode[length] = (unsigned int)code << (16 - length);
+		code <<= 1;
+	}
+	table.maxCode[17] = 0xffffffffu;
+
+	std::memset(table.fast, 255, sizeof(table.fast));
+	for (int i = 0; i < k; i++) {
+		const int length = table.sizes[i];
+		if (length > JPEG_FAST_BITS)
+			continue;
+		const int first = table.codes[i] << (JPEG_FAST_BITS - length);
+		for (int j = 0; j < (1 << (JPEG_FAST_BITS - length)); j++)
+			table.fast[first + j] = (unsigned char)i;
+	}
+	return true;
+}
+
+// Top up the bit buffer; a marker ends the data, after which only zero bits follow.
+static void FillBits(JpegDecoder& decoder)
+{
+	while (decoder.numBits <= 24) {
+		unsigned int byte = 0;
+		if (!decoder.markerReached && decoder.pos < decoder.size) {
+			byte = decoder.data[decoder.pos];
+			if (byte == 0xff) {
+				const unsigned int next = (decoder.pos + 1 < decoder.size) ? decoder.data[decoder.pos + 1] : 0xd9;
+				if (next != 0) {
+					decoder.markerReached = true;
+					byte = 0;
+				}
+				else {
+					decoder.pos += 2;  // Stuffed zero
+				}
+			}
+			else {
+				decoder.pos++;
+			}
+		}
+		decoder.bits |= byte << (24 - decoder.numBits);
+		decoder.numBits += 8;
+	}
+}
+
+static inline int DecodeHuffman(JpegDecoder& decoder, const JpegHuffman& table)
+{
+	if (decoder.numBits < 16)
+		FillBits(decoder);
+	int k = table.fast[decoder.bits >> (32 - JPEG_FAST_BITS)];
+	if (k < 255) {
+		const int length = table.sizes[k];
+		decoder.bits <<= length;
+		decoder.numBits -= length;
+		return table.values[k];
+	}
+	const unsigned int code = decoder.bits >> 16;
+	int length = JPEG_FAST_BITS + 1;
+	while (code >= table.maxCode[length])
+		length++;
+	if (length == 17)
+		return -1;
+	k = (int)(decoder.bits >> (32 - length)) + table.delta[length];
+	decoder.bits <<= length;
+	decoder.numBits -= length;
+	return (k >= 0 && k < 256) ? table.values[k] : -1;
+}
+
+// Read numBits bits as a signed coefficient (JPEG's "receive and extend").
+static inline int ReceiveExtend(JpegDecoder& decoder, const int numBits)
+{
+	if (numBits == 0)
+		return 0;
+	if (decoder.numBits < numBits)
+		FillBits(decoder);
+	const int value = (int)(decoder.bits >> (32 - numBits));
+	decoder.bits <<= numBits;
+	decoder.numBits -= numBits;
+	return (value < (1 << (numBits - 1))) ? value - (1 << numBits) + 1 : value;
+}
+
+static inline unsigned char ClampByte(const int value)
+{
+	return (unsigned char)((value < 0) ? 0 : (value > 255) ? 255 : value);
+}
+
+// Inverse DCT of a dequantized block (AA&N, as libjpeg's float IDCT), written with the level shift.
+static void InverseDct(float block[64], unsigned char* out, const int stride)
+{
+	for (int column = 0; column < 8; column++) {
+		float* in = block + column;
+		float tmp0 = in[0], tmp1 = in[16], tmp2 = in[32], tmp3 = in[48];
+		float tmp10 = tmp0 + tmp2;
+		float tmp11 = tmp0 - tmp2;
+		float tmp13 = tmp1 + tmp3;
+		float tmp12 = (tmp1 - tmp3) * 1.414213562f - tmp13;
+		tmp0 = tmp10 + tmp13;
+		tmp3 = tmp10 - tmp13;
+		tmp1 = tmp11 + tmp12;
+		tmp2 = tmp11 - tmp12;
+
+		float tmp4 = in[8], tmp5 = in[24], tmp6 = in[40], tmp7 = in[56];
+		const float z13 = tmp6 + tmp5;
+		const float z10 = tmp6 - tmp5;
+		const float z11 = tmp4 + tmp7;
+		const float z12 = tmp4 - tmp7;
+		tmp7 = z11 + z13;
+		tmp11 = (z11 - z13) * 1.414213562f;
+		const float z5 = (z10 + z12) * 1.847759065f;
+		tmp10 = z5 - z12 * 1.082392200f;
+		tmp12 = z5 - z10 * 2.613125930f;
+		tmp6 = tmp12 - tmp7;
+		tmp5 = tmp11 - tmp6;
+		tmp4 = tmp10 - tmp5;
+
+		in[0] = tmp0 + tmp7;
+		in[56] = tmp0 - tmp7;
+		in[8] = tmp1 + tmp6;
+		in[48] = tmp1 - tmp6;
+		in[16] = tmp2 + tmp5;
+		in[40] = tmp2 - tmp5;
+		in[24] = tmp3 + tmp4;
+		in[32] = tmp3 - tmp4;
+	}
+	for (int row = 0; row < 8; row++) {
+		const float* in = block + 8 * row;
+		float tmp10 = in[0] + in[4];
+		float tmp11 = in[0] - in[4];
+		const float tmp13 = in[2] + in[6];
+		const float tmp12 = (in[2] - in[6]) * 1.414213562f - tmp13;
+		const float tmp0 = tmp10 + tmp13;
+		const float tmp3 = tmp10 - tmp13;
+		const float tmp1 = tmp11 + tmp12;
+		const float tmp2 = tmp11 - tmp12;
+
+		const float z13 = in[5] + in[3];
+		const float z10 = in[5] - in[3];
+		const float z11 = in[1] + in[7];
+		const float z12 = in[1] - in[7];
+		const float tmp7 = z11 + z13;
+		tmp11 = (z11 - z13) * 1.414213562f;
+		const float z5 = (z10 + z12) * 1.847759065f;
+		tmp10 = z5 - z12 * 1.082392200f;
+		const float tmp12b = z5 - z10 * 2.613125930f;
+		const float tmp6 = tmp12b - tmp7;
+		const float tmp5 = tmp11 - tmp6;
+		const float tmp4 = tmp10 - tmp5;
+
+		const float results[8] = { tmp0 + tmp7, tmp1 + tmp6, tmp2 + tmp5, tmp3 + tmp4, tmp3 - tmp4, tmp2 - tmp5, tmp1 - tmp6, tmp0 - tmp7 };
+		unsigned char* target = out + (size_t)stride * row;
+		for (int i = 0; i < 8; i++)
+			target[i] = ClampByte((int)std::floor(results[i] * 0.125f + 128.5f));
+	}
+}
+
+// Decode one block of a component into its plane at block position (bx, by).
+static bool DecodeJpegBlock(JpegDecoder& decoder, JpegComponent& component, const int bx, const int by)
+{
+	float block[64] = {};
+	const float* quant = decoder.quant[component.quantTable];
+	const int dcSize = DecodeHuffman(decoder, decoder.dcTables[component.dcTable]);
+	if (dcSize < 0 || dcSize > 11)
+		return false;
+	component.dcPredictor += ReceiveExtend(decoder, dcSize);
+	block[0] = component.dcPredictor * quant[0];
+
+	const JpegHuffman& acTable = decoder.acTables[component.acTable];
+	for (int k = 1; k < 64;) {
+		const int symbol = DecodeHuffman(decoder, acTable);
+		if (symbol < 0)
+			return false;
+		const int run = symbol >> 4;
+		const int valueSize = symbol & 15;
+		if (valueSize == 0) {
+			if (run != 15)  // End of block
+				break;
+			k += 16;
+			continue;
+		}
+		k += run;
+		if (k > 63)
+			return false;
+		const int index = JPEG_ZIGZAG[k++];
+		block[index] = ReceiveExtend(decoder, valueSize) * quant[index];
+	}
+	InverseDct(block, component.plane.data() + ((size_t)by * component.planeWidth + bx) * 8, component.planeWidth);
+	return true;
+}
+
+// Skip to the RSTn marker after a restart interval and reset the predictors.
+static bool HandleRestart(JpegDecoder& decoder)
+{
+	decoder.bits = 0;
+	decoder.numBits = 0;
+	decoder.markerReached = false;
+	while (decoder.pos + 1 < decoder.size) {
+		if (decoder.data[decoder.pos] == 0xff && decoder.data[decoder.pos + 1] >= 0xd0 && decoder.data[decoder.pos + 1] <= 0xd7) {
+			decoder.pos += 2;
+			for (auto& component : decoder.components)
+				component.dcPredictor = 0;
+			return true;
+		}
+		decoder.pos++;
+	}
+	return false;
+}
+
+static bool DecodeJpegScan(JpegDecoder& decoder, const std::vector<JpegComponent*>& scanComponents)
+{
+	decoder.bits = 0;
+	decoder.numBits = 0;
+	decoder.markerReached = false;
+	for (auto& component : decoder.components)
+		component.dcPredictor = 0;
+
+	// A scan of one component walks its blocks in raster order; otherwise MCU by MCU.
+	int numUnitsX = decoder.numMcusX;
+	int numUnitsY = decoder.numMcusY;
+	if (scanComponents.size() == 1) {
+		const JpegComponent& component = *scanComponents[0];
+		numUnitsX = ((decoder.width * component.h + decoder.maxH - 1) / decoder.maxH + 7) / 8;
+		numUnitsY = ((decoder.height * component.v + decoder.maxV - 1) / decoder.maxV + 7) / 8;
+	}
+	int unitsToRestart = decoder.restartInterval;
+	for (int uy = 0; uy < numUnitsY; uy++) {
+		for (int ux = 0; ux < numUnitsX; ux++) {
+			if (scanComponents.size() == 1) {
+				if (!DecodeJpegBlock(decoder, *scanComponents[0], ux, uy))
+					return false;
+			}
+			else {
+				for (JpegComponent* component : scanComponents) {
+					for (int by = 0; by < component->v; by++) {
+						for (int bx = 0; bx < component->h; bx++) {
+							if (!DecodeJpegBlock(decoder, *component, ux * component->h + bx, uy * component->v + by))
+								return false;
+						}
+					}
+				}
+			}
+			const bool last = (uy == numUnitsY - 1) && (ux == numUnitsX - 1);
+			if (decoder.restartInterval > 0 && --unitsToRestart == 0 && !last) {
+				if (!HandleRestart(decoder))
+					return false;
+				unitsToRestart = decoder.restartInterval;
+			}
+		}
+	}
+	return true;
+}
+
+// EXIF orientation in an APP1 segment (1 if there is none).
+static int ReadExifOrientation(const unsigned char* segment, const size_t length)
+{
+	if (length < 14 || std::memcmp(segment, "Exif\0\0", 6) != 0)
+		return 1;
+	const unsigned char* tiff = segment + 6;
+	const size_t tiffSize = length - 6;
+	const bool littleEndian = tiff[0] == 'I';
+	auto read16 = [&](size_t offset) -> unsigned int {
+		return littleEndian ? (tiff[offset] | (tiff[offset + 1] << 8)) : ReadBigEndian16(tiff + offset);
+	};
+	auto read32 = [&](size_t offset) -> unsigned int {
+		return littleEndian ? (read16(offset) | (read16(offset + 2) << 16)) : ReadBigEndian32(tiff + offset);
+	};
+	const size_t ifd = read32(4);
+	if (ifd + 2 > tiffSize)
+		return 1;
+	const unsigned int numEntries = read16(ifd);
+	for (unsigned int i = 0; i < numEntries; i++) {
+		const size_t entry = ifd + 2 + 12 * (size_t)i;
+		if (entry + 12 > tiffSize)
+			break;
+		if (read16(entry) == 0x0112)
+			return (int)read16(entry + 8);
+	}
+	return 1;
+}
+
+static bool ReadJpegFrame(JpegDecoder& decoder, const unsigned char* segment, const size_t length)
+{
+	if (length < 6 || segment[0] != 8)  // 8-bit samples only
+		return false;
+	decoder.height = (int)ReadBigEndian16(segment + 1);
+	decoder.width = (int)ReadBigEndian16(segment + 3);
+	const int numComponents = segment[5];
+	if (decoder.width <= 0 || decoder.height <= 0 || (numComponents != 1 && numComponents != 3) || length < 6 + 3 * (size_t)numComponents)
+		return false;
+	decoder.components.resize(numComponents);
+	decoder.maxH = 1;
+	decoder.maxV = 1;
+	for (int i = 0; i < numComponents; i++) {
+		JpegComponent& component = decoder.components[i];
+		component.id = segment[6 + 3 * i];
+		component.h = segment[7 + 3 * i] >> 4;
+		component.v = segment[7 + 3 * i] & 15;
+		component.quantTable = segment[8 + 3 * i];
+		if (component.h < 1 || component.h > 4 || component.v < 1 || component.v > 4 || component.quantTable > 3)
+			return false;
+		decoder.maxH = std::max(decoder.maxH, component.h);
+		decoder.maxV = std::max(decoder.maxV, component.v);
+	}
+	decoder.numMcusX = (decoder.width + 8 * decoder.maxH - 1) / (8 * decoder.maxH);
+	decoder.numMcusY = (decoder.height + 8 * decoder.maxV - 1) / (8 * decoder.maxV);
+	for (auto& component : decoder.components) {
+		// Upsampling needs whole ratios.
+		if (decoder.maxH % component.h != 0 || decoder.maxV % component.v != 0)
+			return false;
+		component.planeWidth = decoder.numMcusX * component.h * 8;
+		component.planeHeight = decoder.numMcusY * component.v * 8;
+	}
+	decoder.frameRead = true;
+	return true;
+}
+
+static bool ReadJpegTables(JpegDecoder& decoder, const unsigned char marker, const unsigned char* segment, const size_t length)
+{
+	// IDCT scale factors: cos(k * pi / 16) * sqrt(2), 1 for k = 0.
+	static const float AAN_SCALE[8] = { 1.0f, 1.387039845f, 1.306562965f, 1.175875602f, 1.0f, 0.785694958f, 0.541196100f, 0.275899379f };
+	size_t pos = 0;
+	if (marker == 0xdb) {
+		while (pos < length) {
+			const int precision = segment[pos] >> 4;
+			const int id = segment[pos] & 15;
+			const size_t tableSize = precision ? 128 : 64;
+			if (id > 3 || precision > 1 || pos + 1 + tableSize > length)
+				return false;
+			for (int i = 0; i < 64; i++) {
+				const int value = precision ? (int)ReadBigEndian16(segment + pos + 1 + 2 * i) : segment[pos + 1 + i];
+				const int index = JPEG_ZIGZAG[i];
+				decoder.quant[id][index] = value * AAN_SCALE[index >> 3] * AAN_SCALE[index & 7];
+			}
+			pos += 1 + tableSize;
+		}
+		return true;
+	}
+	// DHT
+	while (pos + 17 <= length) {
+		const int tableClass = segment[pos] >> 4;
+		const int id = segment[pos] & 15;
+		if (tableClass > 1 || id > 3)
+			return false;
+		int counts[16];
+		int numValues = 0;
+		for (int i = 0; i < 16; i++) {
+			counts[i] = segment[pos + 1 + i];
+			numValues += counts[i];
+		}
+		pos += 17;
+		if (numValues > 256 || pos + numValues > length)
+			return false;
+		JpegHuffman& table = tableClass ? decoder.acTables[id] : decoder.dcTables[id];
+		if (!BuildJpegHuffman(table, counts))
+			return false;
+		std::memcpy(table.values, segment + pos, numValues);
+		pos += numValues;
+	}
+	return true;
+}
+
+// Fixed-point YCbCr -> RGB tables (16 fractional bits), indexed by the chroma sample.
+struct YCbCrTables
+{
+	YCbCrTables() {
+		for (int i = 0; i < 256; i++) {
+			const double c = i - 128.0;
+			crToR[i] = (int)std::lround(1.402 * c);
+			cbToB[i] = (int)std::lround(1.772 * c);
+			crToG[i] = (int)std::lround(-0.714136 * 65536.0 * c);
+			cbToG[i] = (int)std::lround(-0.344136 * 65536.0 * c) + 32768;
+		}
+	}
+	int crToR[256];
+	int cbToB[256];
+	int crToG[256];
+	int cbToG[256];
+};
+
+// Source samples and weight (in 1/256) of each output position along one axis when upsampling
+// by scale: linear between sample centers, as libjpeg's "fancy" upsampling.
+static void ComputeUpsampleTaps(const int outputSize, const int sampleSize, const int scale, std::vector<int>& first, std::vector<int>& weight)
+{
+	first.resize(outputSize);
+	weight.resize(outputSize);
+	for (int i = 0; i < outputSize; i++) {
+		const float position = glm::clamp((i + 0.5f) / scale - 0.5f, 0.0f, (float)(sampleSize - 1));
+		first[i] = (int)position;
+		weight[i] = (int)((position - first[i]) * 256.0f + 0.5f);
+	}
+}
+
+// Convert the component planes to pixels, bottom row first.
+static void StoreJpegPixels(const JpegDecoder& decoder, const int numChannels, unsigned char* pixels, const size_t rowBytes)
+{
+	static const YCbCrTables tables;
+	const int width = decoder.width;
+	const size_t numComponents = decoder.components.size();
+
+	// Upsampling taps of every subsampled component.
+	struct Upsampler
+	{
+		bool full;
+		int sampleWidth;
+		std::vector<int> firstX, weightX, firstY, weightY;
+	};
+	std::vector<Upsampler> upsamplers(numComponents);
+	for (size_t c = 0; c < numComponents; c++) {
+		const JpegComponent& component = decoder.components[c];
+		Upsampler& upsampler = upsamplers[c];
+		upsampler.full = component.h == decoder.maxH && component.v == decoder.maxV;
+		if (upsampler.full)
+			continue;
+		upsampler.sampleWidth = (width * component.h + decoder.maxH - 1) / decoder.maxH;
+		const int sampleHeight = (decoder.height * component.v + decoder.maxV - 1) / decoder.maxV;
+		ComputeUpsampleTaps(width, upsampler.sampleWidth, decoder.maxH / component.h, upsampler.firstX, upsampler.weightX);
+		ComputeUpsampleTaps(decoder.height, sampleHeight, decoder.maxV / component.v, upsampler.firstY, upsampler.weightY);
+	}
+
+	std::vector<std::vector<unsigned char>> rows(numComponents, std::vector<unsigned char>(width));
+	std::vector<int> blended(width + 1);
+	for (int y = 0; y < decoder.height; y++) {
+		const unsigned char* sources[4];
+		for (size_t c = 0; c < numComponents; c++) {
+			const JpegComponent& component = decoder.components[c];
+			const Upsampler& upsampler = upsamplers[c];
+			if (upsampler.full) {
+				sources[c] = component.plane.data() + (size_t)y * component.planeWidth;
+				continue;
+			}
+			// Blend the two sample rows, then the two samples of each pixel.
+			const int y0 = upsampler.firstY[y];
+			const int y1 = std::min(y0 + 1, (int)(component.plane.size() / component.planeWidth) - 1);
+			const int wy = upsampler.weightY[y];
+			const unsigned char* row0 = component.plane.data() + (size_t)y0 * component.planeWidth;
+			const unsigned char* row1 = component.plane.data() + (size_t)y1 * component.planeWidth;
+			for (int x = 0; x < upsampler.sampleWidth; x++)
+				blended[x] = row0[x] * (256 - wy) + row1[x] * wy;
+			blended[upsampler.sampleWidth] = blended[upsampler.sampleWidth - 1];
+			unsigned char* out = rows[c].data();
+			for (int x = 0; x < width; x++) {
+				const int x0 = upsampler.firstX[x];
+				const int wx = upsampler.weightX[x];
+				out[x] = (unsigned char)((blended[x0] * (256 - wx) + blended[x0 + 1] * wx + 32768) >> 16);
+			}
+			sources[c] = out;
+		}
+
+		unsigned char* out = pixels + rowBytes * (decoder.height - 1 - y);
+		if (numComponents == 1) {
+			const unsigned char* gray = sources[0];
+			if (numChannels == 1) {
+				std::memcpy(out, gray, width);
+				continue;
+			}
+			for (int x = 0; x < width; x++)
+				StorePixel(out + (size_t)x * numChannels, numChannels, gray[x], gray[x], gray[x], 255);
+			continue;
+		}
+		const unsigned char* luma = sources[0];
+		const unsigned char* cb = sources[1];
+		const unsigned char* cr = sources[2];
+		for (int x = 0; x < width; x++) {
+			if (decoder.adobeRgb) {
+				StorePixel(out + (size_t)x * numChannels, numChannels, luma[x], cb[x], cr[x], 255);
+				continue;
+			}
+			const int l = luma[x];
+			const int r = l + tables.crToR[cr[x]];
+			const int g = l + ((tables.cbToG[cb[x]] + tables.crToG[cr[x]]) >> 16);
+			const int b = l + tables.cbToB[cb[x]];
+			StorePixel(out + (size_t)x * numChannels, numChannels, ClampByte(r), ClampByte(g), ClampByte(b), 255);
+		}
+	}
+}
+
+// Walk the segments of a JPEG; with pixels == nullptr only up to the frame header.
+static bool DecodeJpeg(JpegDecoder& decoder, const int numChannels, unsigned char* pixels, const size_t rowBytes)
+{
+	const unsigned char* data = decoder.data;
+	const size_t size = decoder.size;
+	if (size < 4 || data[0] != 0xff || data[1] != 0xd8)
+		return false;
+	size_t pos = 2;
+	while (pos + 1 < size) {
+		// Skip fill bytes, stuffed zeros and restart markers left after a scan.
+		if (data[pos] != 0xff) {
+			pos++;
+			continue;
+		}
+		const unsigned char marker = data[pos + 1];
+		if (marker == 0xff || marker == 0x00 || (marker >= 0xd0 && marker <= 0xd7)) {
+			pos += (marker == 0xff) ? 1 : 2;
+			continue;
+		}
+		pos += 2;
+		if (marker == 0xd9)  // EOI
+			break;
+		if (pos + 2 > size)
+			return false;
+		const size_t length = ReadBigEndian16(data + pos);
+		if (length < 2 || pos + length > size)
+			return false;
+		const unsigned char* segment = data + pos + 2;
+		const size_t segmentLength = length - 2;
+		pos += length;
+
+		if (marker == 0xc0 || marker == 0xc1) {
+			if (decoder.frameRead || !ReadJpegFrame(decoder, segment, segmentLength))
+				return false;
+			if (pixels == nullptr)
+				return true;
+			for (auto& component : decoder.components)
+				component.plane.assign((size_t)component.planeWidth * component.planeHeight, 0);
+		}
+		else if (marker >= 0xc2 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc) {
+			return false;  // Progressive, lossless or arithmetic coding
+		}
+		else if (marker == 0xc4 || marker == 0xdb) {
+			if (!ReadJpegTables(decoder, marker, segment, segmentLength))
+				return false;
+		}
+		else if (marker == 0xdd) {
+			if (segmentLength < 2)
+				return false;
+			decoder.restartInterval = (int)ReadBigEndian16(segment);
+		}
+		else if (marker == 0xe1) {
+			// Rotated images are left to the fallback, which applies the orientation.
+			if (ReadExifOrientation(segment, segmentLength) > 1)
+				return false;
+		}
+		else if (marker == 0xee) {
+			if (segmentLength >= 12 && std::memcmp(segment, "Adobe", 5) == 0)
+				decoder.adobeRgb = segment[11] == 0;
+		}
+		else if (marker == 0xda) {
+			if (!decoder.frameRead || segmentLength < 1)
+				return false;
+			const int numScanComponents = segment[0];
+			if (numScanComponents < 1 || segmentLength < 1 + 2 * (size_t)numScanComponents)
+				return false;
+			std::vector<JpegComponent*> scanComponents;
+			for (int i = 0; i < numScanComponents; i++) {
+				auto found = std::find_if(decoder.components.begin(), decoder.components.end(),
+										  [&](const JpegComponent& component) { return component.id == segment[1 + 2 * i]; });
+				if (found == decoder.components.end())
+					return false;
+				found->dcTable = segment[2 + 2 * i] >> 4;
+				found->acTable = segment[2 + 2 * i] & 15;
+				if (found->dcTable > 3 || found->acTable > 3)
+					return false;
+				scanComponents.push_back(&*found);
+			}
+			decoder.pos = pos;
+			if (!DecodeJpegScan(decoder, scanComponents))
+				return false;
+			pos = decoder.pos;
+		}
+	}
+	if (!decoder.frameRead || pixels == nullptr)
+		return false;
+
+	// Components tagged 'R', 'G', 'B' hold RGB rather than YCbCr.
+	if (decoder.components.size() == 3 && decoder.components[0].id == 'R' && decoder.components[1].id == 'G' && decoder.components[2].id == 'B')
+		decoder.adobeRgb = true;
+	StoreJpegPixels(decoder, numChannels, pixels, rowBytes);
+	return true;
+}
+
+static void InitJpegDecoder(JpegDecoder& decoder, const unsigned char* data, const size_t size)
+{
+	decoder.data = data;
+	decoder.size = size;
+	decoder.pos = 0;
+	decoder.bits = 0;
+	decoder.numBits = 0;
+	decoder.markerReached = false;
+	decoder.width = 0;
+	decoder.height = 0;
+	decoder.maxH = 1;
+	decoder.maxV = 1;
+	decoder.numMcusX = 0;
+	decoder.numMcusY = 0;
+	decoder.restartInterval = 0;
+	decoder.frameRead = false;
+	decoder.adobeRgb = false;
+	std::memset(decoder.quant, 0, sizeof(decoder.quant));
+}
+
+// ---------------------------------------------------------------------------------------------
+
+bool ReadImageInfo(const unsigned char* data, const size_t size, ImageInfo& info)
+{
+	info.type = IMAGE_FILE_UNKNOWN;
+	PngHeader header;
+	if (ReadPngHeader(data, size, header)) {
+		info.type = IMAGE_FILE_PNG;
+		info.width = header.width;
+		info.height = header.height;
+		info.numChannels = (header.colorType == 3) ? 3 : GetPngSamples(header.colorType);
+		return true;
+	}
+	if (size >= 2 && data[0] == 0xff && data[1] == 0xd8) {
+		std::unique_ptr<JpegDecoder> decoder(new JpegDecoder());
+		InitJpegDecoder(*decoder, data, size);
+		if (!DecodeJpeg(*decoder, 0, nullptr, 0))
+			return false;
+		info.type = IMAGE_FILE_JPEG;
+		info.width = decoder->width;
+		info.height = decoder->height;
+		info.numChannels = (int)decoder->components.size();
+		return true;
+	}
+	return false;
+}
+
+bool DecodeImage(const unsigned char* data, const size_t size, const int numChannels, unsigned char* pixels, const size_t rowBytes)
+{
+	if (numChannels != 1 && numChannels != 3 && numChannels != 4)
+		return false;
+	ImageInfo info;
+	if (!ReadImageInfo(data, size, info))
+		return false;
+	if (info.type == IMAGE_FILE_PNG)
+		return DecodePng(data, size, numChannels, pixels, rowBytes);
+	std::unique_ptr<JpegDecoder> decoder(new JpegDecoder());
+	InitJpegDecoder(*decoder, data, size);
+	return DecodeJpeg(*decoder, numChannels, pixels, rowBytes);
+}
@@ -0,0 +1,40 @@
+#ifndef IMAGE_DECODER_H
+#define IMAGE_DECODER_H
+
+#include "headers.h"
+
+// PNG and JPEG decoding for textures, without OpenCV.
+// Pixels go straight into the caller's buffer in the layout they are uploaded in: 8-bit
+// channels in RGB(A) order, bottom row first (OpenGL's first row is the bottom of the image)
+// and rows at the caller's pitch, so no flip or channel swap follows and the buffer may be a
+// mapped PBO. Supported are non-interlaced PNGs of every color type and bit depth (16-bit
+// samples are cut to 8 bits) and baseline JPEGs with 1 or 3 components; for anything else
+// (interlaced PNG; progressive, arithmetic-coded, 12-bit, CMYK or EXIF-rotated JPEG) decoding
+// fails and the caller falls back to another decoder.
+
+enum ImageFileType
+{
+	IMAGE_FILE_UNKNOWN,
+	IMAGE_FILE_PNG,
+	IMAGE_FILE_JPEG,
+};
+
+// ImageInfo Declarations.
+struct ImageInfo
+{
+	ImageFileType type;
+	int width;
+	int height;
+	// Channels stored in the file: 1 gray, 2 gray and alpha, 3 color, 4 color and alpha.
+	int numChannels;
+};
+
+// Type, size and channels of an image file in memory; false if it is not a PNG or JPEG
+// or its header is broken.
+bool ReadImageInfo(const unsigned char* data, const size_t size, ImageInfo& info);
+// Decode an image file in memory into numChannels (1, 3 or 4) channels per pixel; rows are
+// rowBytes apart in pixels, which holds ReadImageInfo()'s height of them. Color is averaged
+// to gray for 1 channel; missing alpha is 255. On failure the pixels are undefined.
+bool DecodeImage(const unsigned char* data, const size_t size, const int numChannels, unsigned char* pixels, const size_t rowBytes);
+
+#endif
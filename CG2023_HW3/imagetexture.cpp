@@ -1,76 +1,741 @@
 #include "imagetexture.h"
+#include "textureuploader.h"
+#include "mipcache.h"
+#include "textureresidency.h"
+#include "threadpool.h"
+#include "imagedecoder.h"
+#include "mappedfile.h"
 
-ImageTexture::ImageTexture(const std::string filePath)
-	: texFilePath(filePath)
+// Decode the images the built-in PNG/JPEG decoder rejects with OpenCV; remove to drop that path.
+#define IMAGE_TEXTURE_OPENCV_FALLBACK
+
+// DropTopLevel() keeps at least the levels up to this size.
+static const int MIN_REDUCED_SIZE = 64;
+
+// Chain read again by BeginRestore() on a worker; the worker owns it until done is set.
+struct ImageTexture::RestoreRequest
+{
+	RestoreRequest() : done(false), valid(false) {}
+	std::atomic<bool> done;
+	bool valid;
+	DecodedTexture texture;
+};
+
+TextureDecodeOptions ImageTexture::decodeOptions;
+HostPixelPolicy ImageTexture::hostPixelPolicy = HOST_PIXELS_RELEASE;
+
+// MipCache options of a decode setting.
+static unsigned int GetOptionsKey(const TextureDecodeOptions& options)
+{
+	unsigned int key = (unsigned int)options.mipFilter | (options.gammaCorrectMips ? 4u : 0u);
+	if (options.compress)
+		key |= 8u | (options.useBC7 ? 16u : 0u) | ((unsigned int)options.quality << 5);
+	return key;
+}
+
+ImageTexture::ImageTexture(const std::string filePath, const bool decodeNow)
+	: decodeState(DECODE_PENDING), texFilePath(filePath)
 {
 	imageWidth = 0;
 	imageHeight = 0;
 	numChannels = 0;
 	textureObj = 0;
+	compressedFormat = 0;
+	numLevels = 0;
+	uploader = nullptr;
+	residentBaseLevel = 0;
+	uploadLevel = -1;
+	numUploadedRows = 0;
+	minLod = 0.0f;
+	droppedLevels = 0;
+	lastBoundFrame = TextureResidency::GetFrame();
+	trackedBytes = 0;
+	canRestore = true;
+	hasSourceFile = true;
+	TextureResidency::Register(this);
+
+	if (decodeNow)
+		Decode();
+}
+
+ImageTexture::ImageTexture(const std::string name, DecodedTexture texture)
+	: ImageTexture(name, false)
+{
+	hasSourceFile = false;
+	canRestore = false;
+	if (!texture.levels.empty()) {
+		imageWidth = texture.levels[0].width;
+		imageHeight = texture.levels[0].height;
+		numChannels = texture.numChannels;
+		compressedFormat = texture.compressedFormat;
+		levels = std::move(texture.levels);
+		numLevels = (int)levels.size();
+	}
+	UpdateTrackedBytes();
+	decodeState.store(DECODE_DONE, std::memory_order_release);
+}
+
+void ImageTexture::Decode()
+{
+	{
+		std::unique_lock<std::mutex> lock(decodeMutex);
+		if (decodeState == DECODE_RUNNING)
+			decodeFinished.wait(lock, [this]() { return decodeState == DECODE_DONE; });
+		if (decodeState == DECODE_DONE)
+			return;
+		decodeState = DECODE_RUNNING;
+	}
+
+	DecodedTexture texture;
+	if (DecodeLevels(texFilePath, decodeOptions, texture)) {
+		imageWidth = texture.levels[0].width;
+		imageHeight = texture.levels[0].height;
+		numChannels = texture.numChannels;
+		compressedFormat = texture.compressedFormat;
+		levels = std::move(texture.levels);
+		numLevels = (int)levels.size();
+	}
+	UpdateTrackedBytes();
+
+	{
+		std::lock_guard<std::mutex> lock(decodeMutex);
+		decodeState.store(DECODE_DONE, std::memory_order_release);
+	}
+	decodeFinished.notify_all();
+}
 
+bool ImageTexture::DecodeLevels(const std::string& filePath, const TextureDecodeOptions& options, DecodedTexture& texture)
+{
+	// A current MipCache file replaces the image decoder, the mip generator and the encoder.
+	if (LoadCachedLevels(filePath, options, texture))
+		return true;
 	// Try to load texture image.
-	texImage = cv::imread(texFilePath);
-	if (texImage.rows == 0 || texImage.cols == 0) {
+	TextureLevel image;
+	if (!ReadImage(filePath, image)) {
 		std::cerr << "[ERROR] Failed to load image texture: " << filePath << std::endl;
-		return;
+		return false;
 	}
-	imageWidth = texImage.cols;
-	imageHeight = texImage.rows;
-	numChannels = texImage.channels();
+	// Color images keep 3 channels; alpha is ignored, as cv::imread() always did.
+	return BuildLevels(filePath, std::move(image), 3, options, texture);
+}
 
+bool ImageTexture::ReadImage(const std::string& filePath, TextureLevel& image)
+{
+	// Decode straight from the mapped file into level 0.
+	MappedFile file;
+	ImageInfo info;
+	if (file.Open(filePath)) {
+		const unsigned char* data = (const unsigned char*)file.GetData();
+		if (ReadImageInfo(data, file.GetSize(), info)) {
+			image.width = info.width;
+			image.height = info.height;
+			image.data.resize((size_t)info.width * info.height * 3);
+			if (DecodeImage(data, file.GetSize(), 3, image.data.data(), (size_t)info.width * 3))
+				return true;
+		}
+	}
+#ifdef IMAGE_TEXTURE_OPENCV_FALLBACK
+	// Formats the decoder does not handle (interlaced PNG, progressive JPEG, BMP, ...).
+	cv::Mat texImage = cv::imread(filePath);
+	if (texImage.rows == 0 || texImage.cols == 0)
+		return false;
 	// Flip texture in vertical direction.
 	// OpenCV has smaller y coordinate on top; while OpenGL has larger.
 	cv::flip(texImage, texImage, 0);
+	cv::cvtColor(texImage, texImage, cv::COLOR_BGR2RGB);
+	image.width = texImage.cols;
+	image.height = texImage.rows;
+	image.data.assign(texImage.data, texImage.data + texImage.total() * texImage.elemSize());
+	return true;
+#else
+	return false;
+#endif
+}
 
-	glGenTextures(1, &textureObj);
-    glBindTexture(GL_TEXTURE_2D, textureObj);
-    switch (numChannels) {
+bool ImageTexture::LoadCachedLevels(const std::string& filePath, const TextureDecodeOptions& options, DecodedTexture& texture,
+									const std::vector<std::string>& memberPaths)
+{
+	MipCacheData data;
+	if (!MipCache::Load(filePath, GetOptionsKey(options), data) || data.members.size() != memberPaths.size())
+		return false;
+	for (size_t i = 0; i < memberPaths.size(); i++) {
+		if (data.members[i].path != memberPaths[i])
+			return false;
+	}
+	BlockFormat blockFormat;
+	const bool compressed = GetBlockFormat(data.internalFormat, blockFormat);
+	GLint internalFormat = 0;
+	GLenum format = 0;
+	if (!GetFormats(data.numChannels, internalFormat, format) || (!compressed && data.internalFormat != (unsigned int)internalFormat))
+		return false;
+	for (const auto& level : data.levels) {
+		const size_t expectedSize = compressed ? GetCompressedSize(blockFormat, level.width, level.height)
+											   : (size_t)level.width * level.height * data.numChannels;
+		if (level.width <= 0 || level.height <= 0 || level.data.size() != expectedSize)
+			return false;
+	}
+
+	texture.numChannels = data.numChannels;
+	texture.compressedFormat = compressed ? data.internalFormat : 0;
+	texture.levels = std::move(data.levels);
+	return true;
+}
+
+void ImageTexture::EncodeLevels(TextureLevel image, const int numChannels, const TextureDecodeOptions& options, DecodedTexture& texture)
+{
+	texture.numChannels = numChannels;
+	texture.compressedFormat = 0;
+	texture.levels = GenerateMipChain(std::move(image), numChannels, options.mipFilter, options.gammaCorrectMips);
+
+	// Single-channel images stay uncompressed.
+	if (options.compress && (numChannels == 3 || numChannels == 4)) {
+		BlockFormat blockFormat = options.useBC7 ? BLOCK_FORMAT_BC7 : BLOCK_FORMAT_BC1;
+		if (numChannels == 4 && !options.useBC7)
+			blockFormat = BLOCK_FORMAT_BC3;
+		for (auto& level : texture.levels)
+			level.data = CompressImage(blockFormat, options.quality, level.data.data(), level.width, level.height,
+									   numChannels, (size_t)level.width * numChannels);
+		texture.compressedFormat = GetBlockFormatGL(blockFormat);
+	}
+}
+
+bool ImageTexture::BuildLevels(const std::string& filePath, TextureLevel image, const int numChannels, const TextureDecodeOptions& options,
+							   DecodedTexture& texture, const std::vector<std::string>& memberPaths)
+{
+	GLint internalFormat = 0;
+	GLenum format = 0;
+	if (!GetFormats(numChannels, internalFormat, format)) {
+		std::cerr << "[ERROR] Unsupport texture format" << std::endl;
+		return false;
+	}
+	EncodeLevels(std::move(image), numChannels, options, texture);
+
+	// Without a cache file the levels are simply built again next time.
+	MipCacheData data;
+	data.options = GetOptionsKey(options);
+	data.internalFormat = (texture.compressedFormat != 0) ? texture.compressedFormat : (unsigned int)internalFormat;
+	data.numChannels = numChannels;
+	data.levels = texture.levels;
+	bool stamped = true;
+	if (memberPaths.empty()) {
+		stamped = MeshCache::GetFileStamp(filePath, data.source);
+	}
+	else {
+		data.source.path = filePath;
+		data.source.size = 0;
+		data.source.modifiedTime = 0;
+		data.members.resize(memberPaths.size());
+		for (size_t i = 0; i < memberPaths.size() && stamped; i++)
+			stamped = MeshCache::GetFileStamp(memberPaths[i], data.members[i]);
+	}
+	if (!stamped || !MipCache::Save(filePath, data))
+		std::cerr << "Warning: Failed to write texture cache: " << MipCache::GetCachePath(filePath) << std::endl;
+	return true;
+}
+
+bool ImageTexture::ReleaseDecodedLevels()
+{
+	std::lock_guard<std::mutex> lock(decodeMutex);
+	if (!hasSourceFile || decodeState != DECODE_DONE || textureObj != 0 || uploader != nullptr)
+		return false;
+	std::vector<TextureLevel>().swap(levels);
+	decodeState.store(DECODE_PENDING, std::memory_order_release);
+	UpdateTrackedBytes();
+	return true;
+}
+
+ImageTexture::~ImageTexture()
+{
+	TextureResidency::Unregister(this);
+	if (uploader != nullptr)
+		uploader->Remove(this);
+	// Textures of a cancelled load never reach the GL thread, so there may be nothing to delete.
+	if (textureObj != 0)
+		glDeleteTextures(1, &textureObj);
+}
+
+size_t ImageTexture::GetSizeInBytes() const
+{
+	if (!IsDecoded())
+		return 0;
+	size_t size = 0;
+	for (const auto& level : levels)
+		size += level.data.size();
+	return size;
+}
+
+size_t ImageTexture::GetGpuSizeInBytes() const
+{
+	if (textureObj == 0)
+		return 0;
+	size_t size = 0;
+	for (int i = droppedLevels; i < numLevels; i++)
+		size += GetLevelBytes(i);
+	return size;
+}
+
+size_t ImageTexture::GetPendingUploadBytes() const
+{
+	if (uploadLevel < 0)
+		return 0;
+	size_t size = GetRowBytes(uploadLevel) * (GetNumRows(uploadLevel) - numUploadedRows);
+	for (int i = 0; i < uploadLevel; i++)
+		size += GetLevelBytes(i);
+	return size;
+}
+
+int ImageTexture::GetNumRows(const int level) const
+{
+	return IsCompressed() ? (levels[level].height + 3) / 4 : levels[level].height;
+}
+
+size_t ImageTexture::GetRowBytes(const int level) const
+{
+	return GetLevelBytes(level) / GetNumRows(level);
+}
+
+size_t ImageTexture::GetLevelBytes(const int level) const
+{
+	const TextureLevel& data = levels[level];
+	BlockFormat blockFormat;
+	if (IsCompressed() && GetBlockFormat(compressedFormat, blockFormat))
+		return GetCompressedSize(blockFormat, data.width, data.height);
+	return (size_t)data.width * data.height * numChannels;
+}
+
+void ImageTexture::ReleaseLevelPixels(const int level)
+{
+	if (hostPixelPolicy == HOST_PIXELS_RETAIN || levels[level].data.empty())
+		return;
+	std::vector<unsigned char>().swap(levels[level].data);
+	UpdateTrackedBytes();
+}
+
+bool ImageTexture::GetFormats(const int numChannels, GLint& internalFormat, GLenum& format)
+{
+	switch (numChannels) {
 	case 1:
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, imageWidth, imageHeight, 
-						0, GL_RED, GL_UNSIGNED_BYTE, texImage.ptr());
-		break;
+		internalFormat = GL_R8;
+		format = GL_RED;
+		return true;
 	case 3:
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, imageWidth, imageHeight, 
-						0, GL_BGR, GL_UNSIGNED_BYTE, texImage.ptr());
-		break;
+		internalFormat = GL_RGB8;
+		format = GL_RGB;
+		return true;
 	case 4:
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, imageWidth, imageHeight, 
-						0, GL_BGRA, GL_UNSIGNED_BYTE, texImage.ptr());
-		break;
+		internalFormat = GL_RGBA8;
+		format = GL_RGBA;
+		return true;
 	default:
+		return false;
+	}
+}
+
+bool ImageTexture::Upload()
+{
+	// Done, possibly without levels TextureResidency has dropped since.
+	if (IsUploaded() && uploadLevel < 0)
+		return true;
+	if (uploader != nullptr)  // A TextureUploader is streaming it already
+		return false;
+	if (!BeginUpload())
+		return false;
+
+	for (int level = uploadLevel; level >= 0; level--) {
+		UploadRows(level, 0, GetNumRows(level), levels[level].data.data());
+		ReleaseLevelPixels(level);
+	}
+	SetResidentBaseLevel(0, false);
+	uploadLevel = -1;
+	numUploadedRows = 0;
+	return true;
+}
+
+bool ImageTexture::BeginUpload()
+{
+	if (textureObj != 0)
+		return true;
+	if (!IsValid() || levels.empty())
+		return false;
+	GLint internalFormat = 0;
+	GLenum format = 0;
+	if (!GetFormats(numChannels, internalFormat, format)) {
 		std::cerr << "[ERROR] Unsupport texture format" << std::endl;
-		break;
+		return false;
 	}
 
+	textureObj = CreateStorage(0);
+	residentBaseLevel = numLevels;
+	uploadLevel = numLevels - 1;
+	numUploadedRows = 0;
+	UpdateTrackedBytes();
+	return true;
+}
+
+GLuint ImageTexture::CreateStorage(const int firstLevel) const
+{
+	GLint internalFormat = 0;
+	GLenum format = 0;
+	GetFormats(numChannels, internalFormat, format);
+	if (IsCompressed())
+		internalFormat = compressedFormat;
+	const int numStorageLevels = numLevels - firstLevel;
+
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	if (GLEW_VERSION_4_2 || GLEW_ARB_texture_storage) {
+		glTexStorage2D(GL_TEXTURE_2D, numStorageLevels, internalFormat, levels[firstLevel].width, levels[firstLevel].height);
+	}
+	else {
+		// Mutable storage, allocated level by level with undefined contents.
+		for (int i = firstLevel; i < numLevels; i++) {
+			const TextureLevel& level = levels[i];
+			if (IsCompressed())
+				glCompressedTexImage2D(GL_TEXTURE_2D, i - firstLevel, internalFormat, level.width, level.height, 0, (GLsizei)GetLevelBytes(i), nullptr);
+			else
+				glTexImage2D(GL_TEXTURE_2D, i - firstLevel, internalFormat, level.width, level.height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, numStorageLevels - 1);
+	}
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	// glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	
-	glGenerateMipmap(GL_TEXTURE_2D);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	// Nothing can be sampled until the first level is resident.
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, numStorageLevels - 1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return texture;
+}
+
+void ImageTexture::CopyLevels(const GLuint source, const int sourceFirstLevel, const GLuint destination,
+							  const int destinationFirstLevel, const int first, const int last) const
+{
+	if (GLEW_VERSION_4_3 || GLEW_ARB_copy_image) {
+		for (int i = first; i < last; i++) {
+			glCopyImageSubData(source, GL_TEXTURE_2D, i - sourceFirstLevel, 0, 0, 0,
+							   destination, GL_TEXTURE_2D, i - destinationFirstLevel, 0, 0, 0, levels[i].width, levels[i].height, 1);
+		}
+		return;
+	}
 
+	// Read each level back and upload it again.
+	GLint internalFormat = 0;
+	GLenum format = 0;
+	GetFormats(numChannels, internalFormat, format);
+	std::vector<unsigned char> pixels;
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (int i = first; i < last; i++) {
+		const TextureLevel& level = levels[i];
+		pixels.resize(GetLevelBytes(i));
+		glBindTexture(GL_TEXTURE_2D, source);
+		if (IsCompressed())
+			glGetCompressedTexImage(GL_TEXTURE_2D, i - sourceFirstLevel, pixels.data());
+		else
+			glGetTexImage(GL_TEXTURE_2D, i - sourceFirstLevel, format, GL_UNSIGNED_BYTE, pixels.data());
+		glBindTexture(GL_TEXTURE_2D, destination);
+		if (IsCompressed())
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, i - destinationFirstLevel, 0, 0, level.width, level.height, compressedFormat,
+									  (GLsizei)pixels.size(), pixels.data());
+		else
+			glTexSubImage2D(GL_TEXTURE_2D, i - destinationFirstLevel, 0, 0, level.width, level.height, format, GL_UNSIGNED_BYTE, pixels.data());
+	}
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 	glBindTexture(GL_TEXTURE_2D, 0);
 }
 
-ImageTexture::~ImageTexture()
+GLint ImageTexture::GetInternalFormat() const
 {
-	glDeleteTextures(1, &textureObj);
-	texImage.release();
+	if (IsCompressed())
+		return compressedFormat;
+	GLint internalFormat = 0;
+	GLenum format = 0;
+	GetFormats(numChannels, internalFormat, format);
+	return internalFormat;
+}
+
+bool ImageTexture::CopyToArrayLayer(const GLuint arrayObj, const int layer) const
+{
+	if (!IsFullyResident() || droppedLevels > 0 || uploader != nullptr)
+		return false;
+	if (GLEW_VERSION_4_3 || GLEW_ARB_copy_image) {
+		for (int i = 0; i < numLevels; i++) {
+			glCopyImageSubData(textureObj, GL_TEXTURE_2D, i, 0, 0, 0,
+							   arrayObj, GL_TEXTURE_2D_ARRAY, i, 0, 0, layer, levels[i].width, levels[i].height, 1);
+		}
+		return true;
+	}
+
+	// Read each level back and upload it into the layer.
+	GLint internalFormat = 0;
+	GLenum format = 0;
+	GetFormats(numChannels, internalFormat, format);
+	std::vector<unsigned char> pixels;
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (int i = 0; i < numLevels; i++) {
+		const TextureLevel& level = levels[i];
+		pixels.resize(GetLevelBytes(i));
+		glBindTexture(GL_TEXTURE_2D, textureObj);
+		if (IsCompressed())
+			glGetCompressedTexImage(GL_TEXTURE_2D, i, pixels.data());
+		else
+			glGetTexImage(GL_TEXTURE_2D, i, format, GL_UNSIGNED_BYTE, pixels.data());
+		glBindTexture(GL_TEXTURE_2D_ARRAY, arrayObj);
+		if (IsCompressed())
+			glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, layer, level.width, level.height, 1, compressedFormat,
+									  (GLsizei)pixels.size(), pixels.data());
+		else
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, layer, level.width, level.height, 1, format, GL_UNSIGNED_BYTE, pixels.data());
+	}
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	return true;
+}
+
+void ImageTexture::UploadRows(const int level, const int firstRow, const int numRows, const void* pixels)
+{
+	const TextureLevel& data = levels[level];
+	glBindTexture(GL_TEXTURE_2D, textureObj);
+	if (IsCompressed()) {
+		const int y = firstRow * 4;
+		const int height = std::min(numRows * 4, data.height - y);
+		glCompressedTexSubImage2D(GL_TEXTURE_2D, level - droppedLevels, 0, y, data.width, height, compressedFormat,
+								  (GLsizei)(GetRowBytes(level) * numRows), pixels);
+	}
+	else {
+		GLint internalFormat = 0;
+		GLenum format = 0;
+		GetFormats(numChannels, internalFormat, format);
+		// Level rows are tightly packed, which needs byte alignment for odd RGB widths.
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage2D(GL_TEXTURE_2D, level - droppedLevels, 0, firstRow, data.width, numRows, format, GL_UNSIGNED_BYTE, pixels);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void ImageTexture::SetResidentBaseLevel(const int level, const bool fadeIn)
+{
+	if (level >= residentBaseLevel || level < droppedLevels)
+		return;
+	glBindTexture(GL_TEXTURE_2D, textureObj);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - droppedLevels);
+	// The LOD is relative to the base level: keep the previous sharpness and let FadeInLevel()
+	// bring in the new level over a few frames. The first level shows up at once.
+	if (fadeIn && residentBaseLevel < numLevels)
+		minLod += (float)(residentBaseLevel - level);
+	else
+		minLod = 0.0f;
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_LOD, minLod);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	residentBaseLevel = level;
+}
+
+bool ImageTexture::FadeInLevel(const float step)
+{
+	if (minLod <= 0.0f || textureObj == 0)
+		return false;
+	minLod = std::max(minLod - step, 0.0f);
+	glBindTexture(GL_TEXTURE_2D, textureObj);
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_LOD, minLod);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return minLod > 0.0f;
 }
 
 void ImageTexture::Bind(GLenum textureUnit)
 {
 	glActiveTexture(textureUnit);
     glBindTexture(GL_TEXTURE_2D, textureObj);
+	lastBoundFrame = TextureResidency::GetFrame();
 }
 
 void ImageTexture::Preview()
 {
 	std::string windowText = "[DEBUG] TexturePreview: " + texFilePath;
-	cv::Mat previewImg = cv::Mat(texImage.rows, texImage.cols, texImage.type());
-	cv::cvtColor(texImage, previewImg, cv::COLOR_BGR2RGB);
+	cv::Mat previewImg;
+	GLint internalFormat = 0;
+	GLenum format = 0;
+	if (!IsCompressed() && !levels.empty() && !levels[0].data.empty()) {
+		cv::Mat baseLevel(imageHeight, imageWidth, CV_8UC(numChannels), (void*)levels[0].data.data());
+		cv::flip(baseLevel, previewImg, 0);
+		if (numChannels >= 3)
+			cv::cvtColor(previewImg, previewImg, (numChannels == 4) ? cv::COLOR_RGBA2BGRA : cv::COLOR_RGB2BGR);
+	}
+	else if (!IsCompressed() && IsFullyResident() && GetFormats(numChannels, internalFormat, format)) {
+		// The pixels were released after the upload; read level 0 back from the texture.
+		cv::Mat baseLevel(imageHeight, imageWidth, CV_8UC(numChannels));
+		glBindTexture(GL_TEXTURE_2D, textureObj);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glGetTexImage(GL_TEXTURE_2D, 0, format, GL_UNSIGNED_BYTE, baseLevel.data);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		cv::flip(baseLevel, previewImg, 0);
+		if (numChannels >= 3)
+			cv::cvtColor(previewImg, previewImg, (numChannels == 4) ? cv::COLOR_RGBA2BGRA : cv::COLOR_RGB2BGR);
+	}
+	else {
+		// Compressed (or reduced, or not uploaded yet): show the source image instead.
+		previewImg = cv::imread(texFilePath);
+	}
+	if (previewImg.empty())
+		return;
 	cv::imshow(windowText, previewImg);
 	cv::waitKey(0);
 }
 
+void ImageTexture::CompareMipsWithDriver() const
+{
+	GLint internalFormat = 0;
+	GLenum format = 0;
+	if (IsCompressed() || levels.size() < 2 || !GetFormats(numChannels, internalFormat, format)) {
+		std::cout << "[INFO] " << texFilePath << ": no uncompressed mip chain to compare" << std::endl;
+		return;
+	}
+	// Without host pixels (released after the upload, or dropped), read the chain again.
+	const std::vector<TextureLevel>* chain = &levels;
+	DecodedTexture reloaded;
+	const bool hasPixels = std::all_of(levels.begin(), levels.end(), [](const TextureLevel& level) { return !level.data.empty(); });
+	if (!hasPixels) {
+		if (!DecodeLevels(texFilePath, decodeOptions, reloaded) || reloaded.compressedFormat != 0 || reloaded.levels.size() != levels.size()) {
+			std::cout << "[INFO] " << texFilePath << ": no uncompressed mip chain to compare" << std::endl;
+			return;
+		}
+		chain = &reloaded.levels;
+	}
+
+	GLuint reference = 0;
+	glGenTextures(1, &reference);
+	glBindTexture(GL_TEXTURE_2D, reference);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, imageWidth, imageHeight, 0, format, GL_UNSIGNED_BYTE, (*chain)[0].data.data());
+	glGenerateMipmap(GL_TEXTURE_2D);
+
+	std::cout << "[INFO] Mipmaps of " << texFilePath << " against glGenerateMipmap:" << std::endl;
+	std::vector<unsigned char> driverLevel;
+	for (size_t i = 1; i < chain->size(); i++) {
+		const TextureLevel& level = (*chain)[i];
+		driverLevel.resize(level.data.size());
+		glGetTexImage(GL_TEXTURE_2D, (GLint)i, format, GL_UNSIGNED_BYTE, driverLevel.data());
+		int maxDifference = 0;
+		double squaredError = 0.0;
+		for (size_t j = 0; j < driverLevel.size(); j++) {
+			const int difference = std::abs((int)level.data[j] - (int)driverLevel[j]);
+			maxDifference = std::max(maxDifference, difference);
+			squaredError += (double)difference * difference;
+		}
+		const double mse = squaredError / std::max<size_t>(driverLevel.size(), 1);
+		std::cout << "  Level " << i << " (" << level.width << "x" << level.height << "): ";
+		if (mse > 0.0)
+			std::cout << "PSNR " << std::fixed << std::setprecision(2) << 10.0 * std::log10(255.0 * 255.0 / mse) << " dB";
+		else
+			std::cout << "identical";
+		std::cout << ", max difference " << maxDifference << std::endl;
+	}
+	std::cout.unsetf(std::ios::fixed);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glDeleteTextures(1, &reference);
+}
+
+void ImageTexture::UpdateTrackedBytes()
+{
+	const size_t bytes = GetSizeInBytes() + GetGpuSizeInBytes();
+	TextureResidency::ChangeBytes(trackedBytes, bytes);
+	trackedBytes = bytes;
+}
+
+bool ImageTexture::CanDropLevel() const
+{
+	// Without a file the dropped level could never come back.
+	if (!hasSourceFile || textureObj == 0 || uploader != nullptr || restore != nullptr || uploadLevel >= 0 || residentBaseLevel != droppedLevels)
+		return false;
+	if (droppedLevels + 1 >= numLevels)
+		return false;
+	const TextureLevel& next = levels[droppedLevels + 1];
+	return std::max(next.width, next.height) >= MIN_REDUCED_SIZE;
+}
+
+void ImageTexture::DropTopLevel()
+{
+	const int firstLevel = droppedLevels + 1;
+	const GLuint smaller = CreateStorage(firstLevel);
+	CopyLevels(textureObj, droppedLevels, smaller, firstLevel, firstLevel, numLevels);
+	glDeleteTextures(1, &textureObj);
+	textureObj = smaller;
+	droppedLevels = firstLevel;
+	residentBaseLevel = numLevels;
+	SetResidentBaseLevel(firstLevel, false);
+	// The pixels come back from the MipCache (or the image) if the level is restored.
+	std::vector<unsigned char>().swap(levels[firstLevel - 1].data);
+	UpdateTrackedBytes();
+}
+
+bool ImageTexture::CanRestore() const
+{
+	return droppedLevels > 0 && canRestore && restore == nullptr && uploader == nullptr && textureObj != 0;
+}
+
+size_t ImageTexture::GetRestoreBytes() const
+{
+	size_t size = 0;
+	for (int i = 0; i < droppedLevels; i++)
+		size += 2 * GetLevelBytes(i);
+	return size;
+}
+
+void ImageTexture::BeginRestore(ThreadPool& pool)
+{
+	restore = std::make_shared<RestoreRequest>();
+	std::shared_ptr<RestoreRequest> request = restore;
+	const std::string filePath = texFilePath;
+	const TextureDecodeOptions options = decodeOptions;
+	pool.Submit([request, filePath, options]() {
+		request->valid = DecodeLevels(filePath, options, request->texture);
+		request->done.store(true, std::memory_order_release);
+	});
+}
+
+bool ImageTexture::FinishRestore(TextureUploader* uploader)
+{
+	if (restore == nullptr || !restore->done.load(std::memory_order_acquire))
+		return false;
+	std::shared_ptr<RestoreRequest> request = std::move(restore);
+	DecodedTexture& texture = request->texture;
+	// The file (or the decode options) may have changed since the texture was decoded.
+	if (!request->valid || texture.numChannels != numChannels || texture.compressedFormat != compressedFormat ||
+		(int)texture.levels.size() != numLevels || texture.levels[0].width != imageWidth || texture.levels[0].height != imageHeight) {
+		std::cerr << "Warning: Failed to restore the dropped levels of " << texFilePath << std::endl;
+		canRestore = false;
+		return false;
+	}
+
+	// Full-size storage: the resident levels are copied on the GPU, the others stream in.
+	const int firstResident = droppedLevels;
+	const GLuint full = CreateStorage(0);
+	CopyLevels(textureObj, firstResident, full, 0, firstResident, numLevels);
+	glDeleteTextures(1, &textureObj);
+	textureObj = full;
+	droppedLevels = 0;
+	levels = std::move(texture.levels);
+	residentBaseLevel = numLevels;
+	SetResidentBaseLevel(firstResident, false);
+	for (int i = firstResident; i < numLevels; i++)
+		ReleaseLevelPixels(i);
+	uploadLevel = firstResident - 1;
+	numUploadedRows = 0;
+	UpdateTrackedBytes();
+	if (uploader != nullptr)
+		uploader->Enqueue(this);
+	else
+		Upload();
+	return true;
+}
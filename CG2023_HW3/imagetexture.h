@@ -2,28 +2,228 @@
 #define IMAGE_TEXTURE_H
 
 #include "headers.h"
+#include "mipgenerator.h"
+#include "texturecompressor.h"
+
+class TextureUploader;
+class ThreadPool;
+
+// How Decode() prepares the mip chain (see mipgenerator.h and texturecompressor.h).
+struct TextureDecodeOptions
+{
+	TextureDecodeOptions() : mipFilter(MIP_FILTER_BOX), gammaCorrectMips(true), compress(false), useBC7(false), quality(COMPRESSION_NORMAL) {}
+	MipFilter mipFilter;
+	// Filter colors in linear light rather than in sRGB.
+	bool gammaCorrectMips;
+	// BC1 for RGB images and BC3 for RGBA ones; needs EXT_texture_compression_s3tc.
+	bool compress;
+	// BC7 for both instead; needs ARB_texture_compression_bptc.
+	bool useBC7;
+	CompressionQuality quality;
+};
+
+// What happens to the host copy of the mip chain once it is on the GPU.
+//   RELEASE: each level is freed as soon as it is uploaded (the default); Preview() reads the
+//            pixels back from the texture, or from disk.
+//   RETAIN: every level stays in host memory, for debugging.
+enum HostPixelPolicy
+{
+	HOST_PIXELS_RELEASE,
+	HOST_PIXELS_RETAIN,
+};
+
+// Mip chain of a decoded image, in the format it is uploaded in.
+struct DecodedTexture
+{
+	DecodedTexture() : numChannels(0), compressedFormat(0) {}
+	int numChannels;
+	// 0 if the levels are uncompressed.
+	GLenum compressedFormat;
+	// Level 0 first.
+	std::vector<TextureLevel> levels;
+};
 
 // Texture Declarations.
 class ImageTexture
 {
 public:
 	// Texture Public Methods.
-	ImageTexture(const std::string filePath);
+	// Decodes the image only, so textures can be created on a loader thread;
+	// Upload() must be called on the GL thread before the texture is bound.
+	// With decodeNow = false, decoding waits for Decode(), e.g. on a thread pool.
+	ImageTexture(const std::string filePath, const bool decodeNow = true);
+	// A texture built in memory (e.g. by TextureAtlas), decoded already; name is only shown in
+	// messages. TextureResidency never drops its levels, as there is no file to read them from.
+	ImageTexture(const std::string name, DecodedTexture texture);
 	~ImageTexture();
 
+	// Decode the image once; concurrent callers wait until the first one is done.
+	// The mip chain is built (and compressed, if enabled) here and kept in a MipCache file,
+	// which later decodes read instead of the image.
+	void Decode();
+	bool IsDecoded() const { return decodeState.load(std::memory_order_acquire) == DECODE_DONE; }
+
+	// Synchronous upload of every level (see TextureUploader for the asynchronous one).
+	// Returns false while the image is not decoded yet (or failed to decode).
+	bool Upload();
+	// True once the texture can be bound, i.e. at least its smallest levels are resident.
+	bool IsUploaded() const { return textureObj != 0 && residentBaseLevel < numLevels; }
+	// True once every level is resident.
+	bool IsFullyResident() const { return textureObj != 0 && residentBaseLevel == 0; }
+	// Largest level that is resident (sampling is clamped to it).
+	int GetResidentBaseLevel() const { return residentBaseLevel; }
+	int GetNumLevels() const { return numLevels; }
+	// False if the image could not be decoded (or is not decoded yet).
+	bool IsValid() const { return IsDecoded() && imageWidth > 0 && imageHeight > 0; }
+	// Host memory of the mip chain (only the levels not uploaded yet, unless retained).
+	size_t GetSizeInBytes() const;
+	// GPU memory of the texture object's storage.
+	size_t GetGpuSizeInBytes() const;
+	// Number of top levels TextureResidency has dropped to stay within its budget.
+	int GetNumDroppedLevels() const { return droppedLevels; }
+	bool IsCompressed() const { return compressedFormat != 0; }
+	int GetWidth() const { return imageWidth; }
+	int GetHeight() const { return imageHeight; }
+	// OpenGL internal format of the texture's storage.
+	GLint GetInternalFormat() const;
+	// Copy every level into layer of a GL_TEXTURE_2D_ARRAY with the same size, internal format
+	// and number of levels (see TextureArray). Fails unless the texture is fully resident with
+	// none of its levels dropped.
+	bool CopyToArrayLayer(const GLuint arrayObj, const int layer) const;
+
+	// Also marks the texture as used this frame, for TextureResidency.
 	void Bind(GLenum textureUnit);
 	void Preview();
 	std::string GetPath() const { return texFilePath; }
+	// Debug check on the GL thread: print how far each CPU-built level is from what
+	// glGenerateMipmap makes of level 0 (uncompressed textures only).
+	void CompareMipsWithDriver() const;
+
+	// Applies to textures decoded afterwards; set it once the GL extensions are known.
+	static void SetDecodeOptions(const TextureDecodeOptions& options) { decodeOptions = options; }
+	static TextureDecodeOptions GetDecodeOptions() { return decodeOptions; }
+	// Applies to levels uploaded afterwards.
+	static void SetHostPixelPolicy(const HostPixelPolicy policy) { hostPixelPolicy = policy; }
+	static HostPixelPolicy GetHostPixelPolicy() { return hostPixelPolicy; }
 
 private:
+	friend class TextureUploader;
+	friend class TextureResidency;
+	friend class TextureAtlas;
+	friend class TextureCache;
+	struct RestoreRequest;
+
+	// Texture Private Methods.
+	// OpenGL formats of an image with the given number of channels.
+	static bool GetFormats(const int numChannels, GLint& internalFormat, GLenum& format);
+	// Create the texture object and allocate (immutable, where supported) storage for the
+	// whole chain; nothing is resident yet.
+	bool BeginUpload();
+	// New texture object with storage for levels [firstLevel, numLevels), which become its
+	// levels 0, 1, ...; none of them is sampled yet.
+	GLuint CreateStorage(const int firstLevel) const;
+	// Copy levels [first, last) from one storage of the chain to another on the GPU (or through
+	// host memory without ARB_copy_image). The storages start at levels sourceFirstLevel and
+	// destinationFirstLevel of the chain.
+	void CopyLevels(const GLuint source, const int sourceFirstLevel, const GLuint destination,
+					const int destinationFirstLevel, const int first, const int last) const;
+	// Upload rows [firstRow, firstRow + numRows) of a level from pixels, which is an offset
+	// into the bound GL_PIXEL_UNPACK_BUFFER if one is bound. Rows of compressed levels are
+	// rows of 4x4 blocks.
+	void UploadRows(const int level, const int firstRow, const int numRows, const void* pixels);
+	int GetNumRows(const int level) const;
+	size_t GetRowBytes(const int level) const;
+	// Bytes of a level, whether or not its pixels are held on the host.
+	size_t GetLevelBytes(const int level) const;
+	// Free the host pixels of a level that is on the GPU now, unless they are retained.
+	void ReleaseLevelPixels(const int level);
+	// Make levels [level, numLevels) visible to sampling by moving GL_TEXTURE_BASE_LEVEL down.
+	// With fadeIn, GL_TEXTURE_MIN_LOD keeps the previous sharpness until FadeInLevel() lowers it.
+	void SetResidentBaseLevel(const int level, const bool fadeIn);
+	// Step GL_TEXTURE_MIN_LOD towards 0; returns false once it is there.
+	bool FadeInLevel(const float step);
+	// Bytes of the levels not uploaded yet.
+	size_t GetPendingUploadBytes() const;
+	// Mip chain of an image file, from the MipCache or from the image itself; false if the
+	// image cannot be read. Safe to run on any thread.
+	static bool DecodeLevels(const std::string& filePath, const TextureDecodeOptions& options, DecodedTexture& texture);
+	// Read the mip chain from the MipCache; false if there is no current one. An atlas passes
+	// the key path of its cache and the paths of its members (see MipCacheData::members).
+	static bool LoadCachedLevels(const std::string& filePath, const TextureDecodeOptions& options, DecodedTexture& texture,
+								 const std::vector<std::string>& memberPaths = std::vector<std::string>());
+	// Decode an image file into a tightly packed RGB level 0, bottom row first; false if it is
+	// not a PNG or JPEG the image decoder handles (and the OpenCV fallback fails too, if enabled).
+	static bool ReadImage(const std::string& filePath, TextureLevel& image);
+	// Build (and compress) the mip chain from level 0.
+	static void EncodeLevels(TextureLevel image, const int numChannels, const TextureDecodeOptions& options, DecodedTexture& texture);
+	// The same, and write the chain to the MipCache of filePath (of an atlas, with its members).
+	static bool BuildLevels(const std::string& filePath, TextureLevel image, const int numChannels, const TextureDecodeOptions& options,
+							DecodedTexture& texture, const std::vector<std::string>& memberPaths = std::vector<std::string>());
+	// Give up the decoded levels of a texture that is not on the GPU (nor being uploaded), so the
+	// next Decode() reads them again, from its MipCache; false if it has no file to read them from.
+	// Only for textures no material uses (see TextureCache::ReleaseUnusedPixels); GL thread, since
+	// it reads the upload state.
+	bool ReleaseDecodedLevels();
+
+	// Residency, for TextureResidency (GL thread).
+	// Report the current host and GPU bytes to TextureResidency.
+	void UpdateTrackedBytes();
+	// True if the largest resident level can be given up: the texture is complete, not
+	// streaming, and larger than the smallest size that is kept.
+	bool CanDropLevel() const;
+	// Move the texture into a smaller storage without its largest level, and free that
+	// level's pixels.
+	void DropTopLevel();
+	// True if dropped levels could be brought back now.
+	bool CanRestore() const;
+	// Bytes a restore adds: the dropped levels on the GPU and their pixels on the host.
+	size_t GetRestoreBytes() const;
+	// Read the chain again on pool; FinishRestore() takes it over once it is there.
+	void BeginRestore(ThreadPool& pool);
+	// Move into full-size storage once BeginRestore()'s levels are read; the dropped levels
+	// then stream in through uploader (or are uploaded at once without one). Returns true
+	// if the texture was restored.
+	bool FinishRestore(TextureUploader* uploader);
+
 	// Texture Private Data.
+	enum { DECODE_PENDING, DECODE_RUNNING, DECODE_DONE };
+	std::atomic<int> decodeState;
+	std::mutex decodeMutex;
+	std::condition_variable decodeFinished;
+
 	std::string texFilePath;
 	GLuint textureObj;
 	int imageWidth;
 	int imageHeight;
 	int numChannels;
-	cv::Mat texImage;
+	// Mip chain, level 0 first: tightly packed pixels in the image's channel order, or
+	// blocks of compressedFormat (0 if uncompressed).
+	std::vector<TextureLevel> levels;
+	GLenum compressedFormat;
+	static TextureDecodeOptions decodeOptions;
+	static HostPixelPolicy hostPixelPolicy;
+
+	int numLevels;
+
+	// Upload state. Levels go up smallest first: [residentBaseLevel, numLevels) can be sampled,
+	// and rows [0, numUploadedRows) of uploadLevel are being transferred.
+	TextureUploader* uploader;
+	int residentBaseLevel;
+	int uploadLevel;
+	int numUploadedRows;
+	float minLod;
+
+	// Residency state. Levels [0, droppedLevels) are not in the texture object, whose level 0
+	// is level droppedLevels of the chain.
+	int droppedLevels;
+	unsigned long long lastBoundFrame;
+	size_t trackedBytes;
+	// Levels being read again, if any.
+	std::shared_ptr<RestoreRequest> restore;
+	// Cleared once a restore fails, so it is not tried every frame.
+	bool canRestore;
+	// False for textures built in memory.
+	bool hasSourceFile;
 };
 
 #endif
-
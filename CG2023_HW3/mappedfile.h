@@ -0,0 +1,39 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include "headers.h"
+
+// MappedFile Declarations.
+// Read-only memory mapping of a whole file, so loaders can scan it in place.
+class MappedFile
+{
+public:
+	// MappedFile Public Methods.
+	MappedFile();
+	~MappedFile();
+
+	bool Open(const std::string& filePath);
+	void Close();
+
+	bool IsOpen() const { return isOpen; }
+	const char* GetData() const { return data; }
+	size_t GetSize() const { return size; }
+
+private:
+	// Not copyable: the mapping is owned by exactly one object.
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// MappedFile Private Data.
+	const char* data;
+	size_t size;
+	bool isOpen;
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#else
+	int fileDescriptor;
+#endif
+};
+
+#endif
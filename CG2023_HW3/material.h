@@ -33,7 +33,7 @@ public:
 		Kd = glm::vec3(0.0f, 0.0f, 0.0f);
 		Ks = glm::vec3(0.0f, 0.0f, 0.0f);
 		Ns = 0.0f;
-		mapKd = nullptr;
+		mapKdRegion = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
 	};
 	~PhongMaterial() {};
 
@@ -41,13 +41,19 @@ public:
 	void SetKd(const glm::vec3 kd) { Kd = kd; }
 	void SetKs(const glm::vec3 ks) { Ks = ks; }
 	void SetNs(const float n) { Ns = n; }
-	void SetMapKd(ImageTexture* tex) { mapKd = tex; }
+	// Textures are shared between materials (see TextureCache).
+	void SetMapKd(const std::shared_ptr<ImageTexture>& tex) { mapKd = tex; }
+	// Part of mapKd the texture occupies: offset (xy) and scale (zw); all of it by default,
+	// a region of the atlas for textures packed by TextureAtlas.
+	void SetMapKdRegion(const glm::vec4 region) { mapKdRegion = region; }
 
 	const glm::vec3 GetKa() const { return Ka; }
 	const glm::vec3 GetKd() const { return Kd; }
 	const glm::vec3 GetKs() const { return Ks; }
 	const float GetNs() const { return Ns; }
-	ImageTexture* GetMapKd() const { return mapKd; }
+	ImageTexture* GetMapKd() const { return mapKd.get(); }
+	const std::shared_ptr<ImageTexture>& GetMapKdHandle() const { return mapKd; }
+	const glm::vec4 GetMapKdRegion() const { return mapKdRegion; }
 
 private:
 	// PhongMaterial Private Data.
@@ -55,7 +61,8 @@ private:
 	glm::vec3 Kd;
 	glm::vec3 Ks;
 	float Ns;
-	ImageTexture* mapKd;
+	std::shared_ptr<ImageTexture> mapKd;
+	glm::vec4 mapKdRegion;
 };
 
 // ------------------------------------------------------------------------------------------------
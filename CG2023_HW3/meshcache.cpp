@@ -0,0 +1,176 @@
+#include "meshcache.h"
+#include "mappedfile.h"
+#include "cachefile.h"
+
+static const char MESH_CACHE_MAGIC[8] = { 'M', 'E', 'S', 'H', 'C', 'A', 'C', 'H' };
+
+std::string MeshCache::GetCachePath(const std::string& modelPath)
+{
+	return modelPath + ".meshcache";
+}
+
+bool MeshCache::GetFileStamp(const std::string& filePath, CachedFileStamp& stamp)
+{
+	std::error_code error;
+	const auto size = std::filesystem::file_size(filePath, error);
+	if (error)
+		return false;
+	const auto modifiedTime = std::filesystem::last_write_time(filePath, error);
+	if (error)
+		return false;
+
+	stamp.path = filePath;
+	stamp.size = (unsigned long long)size;
+	stamp.modifiedTime = (long long)modifiedTime.time_since_epoch().count();
+	return true;
+}
+
+bool MeshCache::IsStampCurrent(const CachedFileStamp& recorded)
+{
+	CachedFileStamp current;
+	return MeshCache::GetFileStamp(recorded.path, current)
+		&& current.size == recorded.size && current.modifiedTime == recorded.modifiedTime;
+}
+
+bool MeshCache::Load(const std::string& modelPath, const MeshLoadOptions& options, MeshCacheData& data)
+{
+	MappedFile file;
+	if (!file.Open(GetCachePath(modelPath)))
+		return false;
+
+	CacheReader reader(file.GetData(), file.GetSize());
+	char magic[8];
+	unsigned int version = 0;
+	if (!reader.Read(magic, sizeof(magic)) || std::memcmp(magic, MESH_CACHE_MAGIC, sizeof(magic)) != 0)
+		return false;
+	if (!reader.ReadValue(version) || version != MESH_CACHE_VERSION)
+		return false;
+	if (!reader.ReadValue(data.options.flags) || !reader.ReadValue(data.options.weldEpsilon) ||
+		!reader.ReadValue(data.options.overdrawThreshold) || !(data.options == options))
+		return false;
+
+	// The cache is only valid for the exact model and material files it was built from.
+	if (!reader.ReadStamp(data.source) || data.source.path != modelPath || !IsStampCurrent(data.source))
+		return false;
+	// Path length, size and time.
+	const size_t minStampBytes = sizeof(unsigned int) + sizeof(unsigned long long) + sizeof(long long);
+	unsigned int numLibraries = 0;
+	if (!reader.ReadCount(numLibraries, minStampBytes))
+		return false;
+	data.materialLibraries.resize(numLibraries);
+	for (auto& library : data.materialLibraries) {
+		if (!reader.ReadStamp(library) || !IsStampCurrent(library))
+			return false;
+	}
+
+	reader.ReadValue(data.numTriangles);
+	reader.ReadValue(data.numVerticesBeforeWeld);
+	reader.ReadValue(data.objCenter);
+	reader.ReadValue(data.objExtent);
+	reader.ReadValue(data.vertexCacheBefore);
+	reader.ReadValue(data.vertexCacheAfter);
+	reader.ReadValue(data.overdrawBefore);
+	reader.ReadValue(data.overdrawAfter);
+	reader.ReadValue(data.vertexFetchBefore);
+	reader.ReadValue(data.vertexFetchAfter);
+
+	// Two string lengths, the material parameters and the index count.
+	const size_t minSubMeshBytes = 2 * sizeof(unsigned int) + 3 * sizeof(glm::vec3) + sizeof(float) + sizeof(unsigned long long);
+	unsigned int numSubMeshes = 0;
+	if (!reader.ReadCount(numSubMeshes, minSubMeshBytes))
+		return false;
+	data.subMeshes.resize(numSubMeshes);
+	for (auto& subMesh : data.subMeshes) {
+		reader.ReadString(subMesh.materialName);
+		reader.ReadValue(subMesh.Ka);
+		reader.ReadValue(subMesh.Kd);
+		reader.ReadValue(subMesh.Ks);
+		reader.ReadValue(subMesh.Ns);
+		reader.ReadString(subMesh.texturePath);
+		reader.ReadArray(subMesh.vertexIndices);
+	}
+	reader.ReadArray(data.vertices);
+	if (!reader.IsOk())
+		return false;
+
+	// Reject indices that do not fit the vertex array (e.g. a truncated write).
+	for (const auto& subMesh : data.subMeshes) {
+		for (const unsigned int index : subMesh.vertexIndices) {
+			if (index >= data.vertices.size())
+				return false;
+		}
+	}
+	return true;
+}
+
+// A temporary file no other writer uses: a cancelled load that is still running may save the
+// same model as its replacement, and the two must not write into one file.
+static std::string GetTempPath(const std::string& cachePath)
+{
+	static std::atomic<unsigned int> counter(0);
+	std::ostringstream name;
+	name << cachePath << "." << std::hex << std::hash<std::thread::id>()(std::this_thread::get_id())
+		 << "." << counter.fetch_add(1) << "." << std::chrono::steady_clock::now().time_since_epoch().count() << ".tmp";
+	return name.str();
+}
+
+bool MeshCache::Save(const std::string& modelPath, const MeshCacheData& data)
+{
+	const std::string cachePath = GetCachePath(modelPath);
+	const std::string tempPath = GetTempPath(cachePath);
+	{
+		std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+		if (!out.is_open())
+			return false;
+
+		CacheWriter writer(out);
+		writer.Write(MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+		writer.WriteValue(MESH_CACHE_VERSION);
+		writer.WriteValue(data.options.flags);
+		writer.WriteValue(data.options.weldEpsilon);
+		writer.WriteValue(data.options.overdrawThreshold);
+		writer.WriteStamp(data.source);
+		writer.WriteValue((unsigned int)data.materialLibraries.size());
+		for (const auto& library : data.materialLibraries)
+			writer.WriteStamp(library);
+
+		writer.WriteValue(data.numTriangles);
+		writer.WriteValue(data.numVerticesBeforeWeld);
+		writer.WriteValue(data.objCenter);
+		writer.WriteValue(data.objExtent);
+		writer.WriteValue(data.vertexCacheBefore);
+		writer.WriteValue(data.vertexCacheAfter);
+		writer.WriteValue(data.overdrawBefore);
+		writer.WriteValue(data.overdrawAfter);
+		writer.WriteValue(data.vertexFetchBefore);
+		writer.WriteValue(data.vertexFetchAfter);
+
+		writer.WriteValue((unsigned int)data.subMeshes.size());
+		for (const auto& subMesh : data.subMeshes) {
+			writer.WriteString(subMesh.materialName);
+			writer.WriteValue(subMesh.Ka);
+			writer.WriteValue(subMesh.Kd);
+			writer.WriteValue(subMesh.Ks);
+			writer.WriteValue(subMesh.Ns);
+			writer.WriteString(subMesh.texturePath);
+			writer.WriteValue((unsigned long long)subMesh.vertexIndices.size());
+			writer.Write(subMesh.vertexIndices.data(), sizeof(unsigned int) * subMesh.vertexIndices.size());
+		}
+		writer.WriteValue((unsigned long long)data.vertices.size());
+		writer.Write(data.vertices.data(), sizeof(VertexPTN) * data.vertices.size());
+
+		if (!out.good()) {
+			out.close();
+			std::remove(tempPath.c_str());
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempPath, cachePath, error);
+	if (error) {
+		std::remove(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,107 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include "headers.h"
+#include "trianglemesh.h"
+
+// Binary sidecar cache for parsed models.
+// "<model>.meshcache" holds the final (welded, normalized) vertex array, the subMesh index
+// lists and material parameters of a model, so later loads skip the text parsers entirely.
+// A cache is only used while the model file, every material library it pulls in, the load
+// options and the loader version all match what was recorded when it was written.
+
+// Bump whenever the loader output or the cache layout changes.
+const unsigned int MESH_CACHE_VERSION = 7;
+
+// Identity of a file the cache depends on.
+struct CachedFileStamp
+{
+	std::string path;
+	unsigned long long size;
+	long long modifiedTime;
+};
+
+// Load options the data was produced with; each one is stored and compared on its own.
+struct MeshLoadOptions
+{
+	MeshLoadOptions() {
+		flags = 0;
+		weldEpsilon = 0.0f;
+		overdrawThreshold = 0.0f;
+	}
+	bool operator==(const MeshLoadOptions& other) const {
+		return flags == other.flags && weldEpsilon == other.weldEpsilon && overdrawThreshold == other.overdrawThreshold;
+	}
+	// MESH_LOAD_* bits.
+	unsigned int flags;
+	// Only meaningful with MESH_LOAD_WELD / MESH_LOAD_OPTIMIZE_OVERDRAW set; 0 otherwise.
+	float weldEpsilon;
+	float overdrawThreshold;
+};
+
+const unsigned int MESH_LOAD_NORMALIZE = 1u;
+const unsigned int MESH_LOAD_WELD = 2u;
+const unsigned int MESH_LOAD_OPTIMIZE_VERTEX_CACHE = 4u;
+const unsigned int MESH_LOAD_OPTIMIZE_OVERDRAW = 8u;
+const unsigned int MESH_LOAD_OPTIMIZE_VERTEX_FETCH = 16u;
+
+// One subMesh with its material.
+struct CachedSubMesh
+{
+	std::string materialName;
+	glm::vec3 Ka;
+	glm::vec3 Kd;
+	glm::vec3 Ks;
+	float Ns;
+	std::string texturePath;
+	std::vector<unsigned int> vertexIndices;
+};
+
+// MeshCacheData Declarations.
+struct MeshCacheData
+{
+	MeshCacheData() {
+		numTriangles = 0;
+		numVerticesBeforeWeld = 0;
+		objCenter = glm::vec3(0.0f, 0.0f, 0.0f);
+		objExtent = glm::vec3(0.0f, 0.0f, 0.0f);
+	}
+	MeshLoadOptions options;
+	CachedFileStamp source;
+	std::vector<CachedFileStamp> materialLibraries;
+
+	std::vector<VertexPTN> vertices;
+	std::vector<CachedSubMesh> subMeshes;
+	int numTriangles;
+	int numVerticesBeforeWeld;
+	glm::vec3 objCenter;
+	glm::vec3 objExtent;
+	// Vertex cache efficiency of the parsed and of the stored (optimized) index order.
+	VertexCacheStats vertexCacheBefore;
+	VertexCacheStats vertexCacheAfter;
+	// Overdraw of the same two orders.
+	OverdrawStats overdrawBefore;
+	OverdrawStats overdrawAfter;
+	// Vertex fetch traffic before and after the vertices were sorted by first use.
+	VertexFetchStats vertexFetchBefore;
+	VertexFetchStats vertexFetchAfter;
+};
+
+// MeshCache Declarations.
+class MeshCache
+{
+public:
+	// Path of the cache file that belongs to a model file.
+	static std::string GetCachePath(const std::string& modelPath);
+	// Current size and modification time of a file; false if it does not exist.
+	static bool GetFileStamp(const std::string& filePath, CachedFileStamp& stamp);
+	// A recorded stamp is current if the file still has the same size and modification time.
+	static bool IsStampCurrent(const CachedFileStamp& recorded);
+
+	// Read the cache of modelPath; fails if it is missing, corrupt or stale.
+	static bool Load(const std::string& modelPath, const MeshLoadOptions& options, MeshCacheData& data);
+	// Write the cache of modelPath (to a temporary file first, so readers never see half a file).
+	static bool Save(const std::string& modelPath, const MeshCacheData& data);
+};
+
+#endif
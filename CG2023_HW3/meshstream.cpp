@@ -0,0 +1,25 @@
+#include "meshstream.h"
+
+MeshStream::MeshStream()
+{
+}
+
+MeshStream::~MeshStream()
+{
+}
+
+void MeshStream::Push(MeshBatch&& batch)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	batches.push_back(std::move(batch));
+}
+
+bool MeshStream::Pop(MeshBatch& batch)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (batches.empty())
+		return false;
+	batch = std::move(batches.front());
+	batches.pop_front();
+	return true;
+}
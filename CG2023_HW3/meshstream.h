@@ -0,0 +1,52 @@
+#ifndef MESH_STREAM_H
+#define MESH_STREAM_H
+
+#include "headers.h"
+#include "trianglemesh.h"
+
+// Progressive display of models that are still loading.
+// While TriangleMesh::LoadFromFile works through a large file, it publishes every parsed
+// wave of chunks as a MeshBatch. The GL thread pops the batches and appends them to a
+// preview mesh (TriangleMesh::AppendBatch), which draws whatever has arrived so far.
+
+// MeshBatch Declarations.
+struct MeshBatch
+{
+	MeshBatch() {
+		boundsMin = glm::vec3(0.0f, 0.0f, 0.0f);
+		boundsMax = glm::vec3(0.0f, 0.0f, 0.0f);
+	}
+	// Vertices that follow the ones of all earlier batches (not welded, not normalized).
+	std::vector<VertexPTN> vertices;
+	// Material of every subMesh known so far; the list only grows from batch to batch.
+	// These are copies taken on the loader thread (sharing the texture handles), so the GL
+	// thread never touches the materials of the mesh being loaded while it changes them.
+	std::vector<PhongMaterial> materials;
+	// New triangles of each subMesh, indexing the vertices of all batches up to this one.
+	std::vector<std::vector<unsigned int>> subMeshIndices;
+	// Bounding box of this batch's vertices.
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+};
+
+// MeshStream Declarations.
+// Queue of batches from the loader thread to the GL thread.
+class MeshStream
+{
+public:
+	// MeshStream Public Methods.
+	MeshStream();
+	~MeshStream();
+
+	// Loader thread.
+	void Push(MeshBatch&& batch);
+	// GL thread: take the oldest batch; false if none is waiting.
+	bool Pop(MeshBatch& batch);
+
+private:
+	// MeshStream Private Data.
+	std::mutex mutex;
+	std::deque<MeshBatch> batches;
+};
+
+#endif
@@ -0,0 +1,97 @@
+#include "mipcache.h"
+#include "mappedfile.h"
+#include "cachefile.h"
+
+static const char MIP_CACHE_MAGIC[8] = { 'M', 'I', 'P', 'C', 'A', 'C', 'H', 'E' };
+
+std::string MipCache::GetCachePath(const std::string& imagePath)
+{
+	return imagePath + ".mipcache";
+}
+
+bool MipCache::Load(const std::string& imagePath, const unsigned int options, MipCacheData& data)
+{
+	MappedFile file;
+	if (!file.Open(GetCachePath(imagePath)))
+		return false;
+
+	CacheReader reader(file.GetData(), file.GetSize());
+	char magic[8];
+	unsigned int version = 0;
+	if (!reader.Read(magic, sizeof(magic)) || std::memcmp(magic, MIP_CACHE_MAGIC, sizeof(magic)) != 0)
+		return false;
+	if (!reader.ReadValue(version) || version != MIP_CACHE_VERSION)
+		return false;
+	if (!reader.ReadValue(data.options) || data.options != options)
+		return false;
+	if (!reader.ReadStamp(data.source) || data.source.path != imagePath)
+		return false;
+	unsigned int numMembers = 0;
+	if (!reader.ReadValue(numMembers))
+		return false;
+	data.members.resize(numMembers);
+	for (auto& member : data.members) {
+		if (!reader.ReadStamp(member) || !MeshCache::IsStampCurrent(member))
+			return false;
+	}
+	// An atlas has no file of its own; its members stand in for it.
+	if (data.members.empty() && !MeshCache::IsStampCurrent(data.source))
+		return false;
+
+	reader.ReadValue(data.internalFormat);
+	reader.ReadValue(data.numChannels);
+	unsigned int numLevels = 0;
+	if (!reader.ReadValue(numLevels) || numLevels == 0 || numLevels > 32)
+		return false;
+	data.levels.resize(numLevels);
+	for (auto& level : data.levels) {
+		reader.ReadValue(level.width);
+		reader.ReadValue(level.height);
+		reader.ReadArray(level.data);
+	}
+	return reader.IsOk();
+}
+
+bool MipCache::Save(const std::string& imagePath, const MipCacheData& data)
+{
+	const std::string cachePath = GetCachePath(imagePath);
+	const std::string tempPath = cachePath + ".tmp";
+	{
+		std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+		if (!out.is_open())
+			return false;
+
+		CacheWriter writer(out);
+		writer.Write(MIP_CACHE_MAGIC, sizeof(MIP_CACHE_MAGIC));
+		writer.WriteValue(MIP_CACHE_VERSION);
+		writer.WriteValue(data.options);
+		writer.WriteStamp(data.source);
+		writer.WriteValue((unsigned int)data.members.size());
+		for (const auto& member : data.members)
+			writer.WriteStamp(member);
+
+		writer.WriteValue(data.internalFormat);
+		writer.WriteValue(data.numChannels);
+		writer.WriteValue((unsigned int)data.levels.size());
+		for (const auto& level : data.levels) {
+			writer.WriteValue(level.width);
+			writer.WriteValue(level.height);
+			writer.WriteValue((unsigned long long)level.data.size());
+			writer.Write(level.data.data(), level.data.size());
+		}
+
+		if (!out.good()) {
+			out.close();
+			std::remove(tempPath.c_str());
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempPath, cachePath, error);
+	if (error) {
+		std::remove(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,53 @@
+#ifndef MIP_CACHE_H
+#define MIP_CACHE_H
+
+#include "headers.h"
+#include "meshcache.h"
+#include "imagetexture.h"
+
+// Binary sidecar cache for encoded textures.
+// "<image>.mipcache" holds the complete mip chain of an image in the format it is uploaded in
+// (e.g. BC1 blocks), so later loads skip both the image decoder and the encoder. A cache is only
+// used while the image file, the encoder options and the cache version match what was recorded.
+// A texture atlas has no image file of its own; its cache is named after a key path instead and
+// depends on the stamps of the member images it was packed from.
+
+// Bump whenever the encoders or the cache layout change.
+const unsigned int MIP_CACHE_VERSION = 4;
+
+// MipCacheData Declarations.
+struct MipCacheData
+{
+	MipCacheData() {
+		options = 0;
+		internalFormat = 0;
+		numChannels = 0;
+	}
+	// Hash of the encoder options the levels were produced with.
+	unsigned int options;
+	CachedFileStamp source;
+	// Images an atlas was packed from, in packing order (empty for the cache of one image,
+	// whose source stamp is checked instead).
+	std::vector<CachedFileStamp> members;
+
+	// OpenGL internal format of the levels and channels of the source image.
+	unsigned int internalFormat;
+	int numChannels;
+	// Level 0 first.
+	std::vector<TextureLevel> levels;
+};
+
+// MipCache Declarations.
+class MipCache
+{
+public:
+	// Path of the cache file that belongs to an image file.
+	static std::string GetCachePath(const std::string& imagePath);
+
+	// Read the cache of imagePath; fails if it is missing, corrupt or stale.
+	static bool Load(const std::string& imagePath, const unsigned int options, MipCacheData& data);
+	// Write the cache of imagePath (to a temporary file first, so readers never see half a file).
+	static bool Save(const std::string& imagePath, const MipCacheData& data);
+};
+
+#endif
@@ -0,0 +1,227 @@
+#include "mipgenerator.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIP_GENERATOR_SSE2
+#endif
+
+// Kaiser filter: window radius (in destination pixels) and shape.
+static const float KAISER_RADIUS = 3.0f;
+static const float KAISER_ALPHA = 4.0f;
+
+// sRGB <-> linear conversion tables.
+struct GammaTables
+{
+	GammaTables() {
+		for (int i = 0; i < 256; i++) {
+			const float s = i / 255.0f;
+			toLinear[i] = (s <= 0.04045f) ? s / 12.92f : std::pow((s + 0.055f) / 1.055f, 2.4f);
+		}
+		for (int i = 0; i < 4096; i++) {
+			const float l = i / 4095.0f;
+			const float s = (l <= 0.0031308f) ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+			toSrgb[i] = (unsigned char)std::lround(s * 255.0f);
+		}
+	}
+	float toLinear[256];
+	// Indexed by linear value * 4095.
+	unsigned char toSrgb[4096];
+};
+
+static const GammaTables& GetGammaTables()
+{
+	static const GammaTables tables;
+	return tables;
+}
+
+// Source pixels and weights of every destination pixel along one axis.
+struct FilterTaps
+{
+	int numTaps;
+	// numTaps entries per destination pixel; indices are clamped to the image.
+	std::vector<int> indices;
+	std::vector<float> weights;
+};
+
+// Zeroth-order modified Bessel function of the first kind.
+static float BesselI0(const float x)
+{
+	float sum = 1.0f;
+	float term = 1.0f;
+	for (int k = 1; k < 32 && term > 1e-8f * sum; k++) {
+		const float t = x / (2.0f * k);
+		term *= t * t;
+		sum += term;
+	}
+	return sum;
+}
+
+static float Sinc(const float x)
+{
+	if (std::fabs(x) < 1e-6f)
+		return 1.0f;
+	const float px = 3.14159265f * x;
+	return std::sin(px) / px;
+}
+
+static FilterTaps ComputeTaps(const int srcSize, const int dstSize, const MipFilter filter)
+{
+	// Source pixels per destination pixel (2, or a little more for odd sizes; 1 for a size-1 axis).
+	const float scale = (float)srcSize / dstSize;
+	const float radius = ((filter == MIP_FILTER_KAISER) ? KAISER_RADIUS : 0.5f) * scale;
+
+	FilterTaps taps;
+	taps.numTaps = (int)std::ceil(2.0f * radius) + 1;
+	taps.indices.resize((size_t)dstSize * taps.numTaps);
+	taps.weights.resize((size_t)dstSize * taps.numTaps);
+	const float windowScale = 1.0f / BesselI0(KAISER_ALPHA);
+	for (int x = 0; x < dstSize; x++) {
+		const float center = (x + 0.5f) * scale;
+		const int first = (int)std::floor(center - radius);
+		float sum = 0.0f;
+		for (int k = 0; k < taps.numTaps; k++) {
+			const int i = first + k;
+			float weight = 0.0f;
+			if (filter == MIP_FILTER_KAISER) {
+				const float t = (i + 0.5f - center) / scale;
+				const float u = t / KAISER_RADIUS;
+				if (std::fabs(u) < 1.0f)
+					weight = Sinc(t) * BesselI0(KAISER_ALPHA * std::sqrt(1.0f - u * u)) * windowScale;
+			}
+			else {
+				// Coverage of source pixel [i, i + 1] by the footprint [center - radius, center + radius].
+				weight = std::max(0.0f, std::min((float)i + 1.0f, center + radius) - std::max((float)i, center - radius));
+			}
+			taps.indices[(size_t)x * taps.numTaps + k] = glm::clamp(i, 0, srcSize - 1);
+			taps.weights[(size_t)x * taps.numTaps + k] = weight;
+			sum += weight;
+		}
+		for (int k = 0; k < taps.numTaps; k++)
+			taps.weights[(size_t)x * taps.numTaps + k] /= sum;
+	}
+	return taps;
+}
+
+// dst[i] += weight * src[i] for count floats.
+static void MultiplyAdd(float* dst, const float* src, const float weight, const size_t count)
+{
+	size_t i = 0;
+#ifdef MIP_GENERATOR_SSE2
+	const __m128 w = _mm_set1_ps(weight);
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), w)));
+#endif
+	for (; i < count; i++)
+		dst[i] += weight * src[i];
+}
+
+// Resample one row of 4-float pixels along x.
+static void FilterRow(float* dst, const float* src, const FilterTaps& taps, const int dstWidth)
+{
+	const int* index = taps.indices.data();
+	const float* weight = taps.weights.data();
+	for (int x = 0; x < dstWidth; x++) {
+#ifdef MIP_GENERATOR_SSE2
+		__m128 sum = _mm_setzero_ps();
+		for (int k = 0; k < taps.numTaps; k++, index++, weight++)
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(src + 4 * (*index)), _mm_set1_ps(*weight)));
+		_mm_storeu_ps(dst + 4 * x, sum);
+#else
+		float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		for (int k = 0; k < taps.numTaps; k++, index++, weight++) {
+			for (int c = 0; c < 4; c++)
+				sum[c] += src[4 * (*index) + c] * (*weight);
+		}
+		std::memcpy(dst + 4 * x, sum, sizeof(sum));
+#endif
+	}
+}
+
+// Convert 4-float pixels back to 8-bit channels.
+static void StoreLevel(TextureLevel& level, const std::vector<float>& pixels, const int numChannels, const bool gammaCorrect)
+{
+	const GammaTables& gamma = GetGammaTables();
+	const size_t numPixels = (size_t)level.width * level.height;
+	const int numColorChannels = (numChannels == 4) ? 3 : numChannels;
+	level.data.resize(numPixels * numChannels);
+	unsigned char* out = level.data.data();
+	for (size_t i = 0; i < numPixels; i++) {
+		for (int c = 0; c < numChannels; c++) {
+			const float v = glm::clamp(pixels[4 * i + c], 0.0f, 1.0f);
+			if (gammaCorrect && c < numColorChannels)
+				*out++ = gamma.toSrgb[(int)(v * 4095.0f + 0.5f)];
+			else
+				*out++ = (unsigned char)(v * 255.0f + 0.5f);
+		}
+	}
+}
+
+std::vector<TextureLevel> GenerateMipChain(const unsigned char* pixels, const int width, const int height, const int numChannels,
+										   const size_t rowBytes, const MipFilter filter, const bool gammaCorrect)
+{
+	if (width <= 0 || height <= 0 || numChannels < 1 || numChannels > 4)
+		return std::vector<TextureLevel>();
+
+	TextureLevel base;
+	base.width = width;
+	base.height = height;
+	base.data.resize((size_t)width * height * numChannels);
+	for (int y = 0; y < height; y++)
+		std::memcpy(base.data.data() + (size_t)y * width * numChannels, pixels + rowBytes * y, (size_t)width * numChannels);
+	return GenerateMipChain(std::move(base), numChannels, filter, gammaCorrect);
+}
+
+std::vector<TextureLevel> GenerateMipChain(TextureLevel base, const int numChannels, const MipFilter filter, const bool gammaCorrect)
+{
+	std::vector<TextureLevel> levels;
+	const int width = base.width;
+	const int height = base.height;
+	if (width <= 0 || height <= 0 || numChannels < 1 || numChannels > 4 || base.data.size() < (size_t)width * height * numChannels)
+		return levels;
+
+	// Level 0 as linear floats for filtering.
+	const GammaTables& gamma = GetGammaTables();
+	const int numColorChannels = (numChannels == 4) ? 3 : numChannels;
+	std::vector<float> current((size_t)width * height * 4, 0.0f);
+	const unsigned char* pixel = base.data.data();
+	for (size_t i = 0; i < (size_t)width * height; i++) {
+		for (int c = 0; c < numChannels; c++, pixel++)
+			current[4 * i + c] = (gammaCorrect && c < numColorChannels) ? gamma.toLinear[*pixel] : *pixel / 255.0f;
+	}
+	levels.push_back(std::move(base));
+
+	int srcWidth = width;
+	int srcHeight = height;
+	std::vector<float> rows;
+	std::vector<float> next;
+	while (srcWidth > 1 || srcHeight > 1) {
+		const int dstWidth = std::max(srcWidth / 2, 1);
+		const int dstHeight = std::max(srcHeight / 2, 1);
+		const FilterTaps tapsX = ComputeTaps(srcWidth, dstWidth, filter);
+		const FilterTaps tapsY = ComputeTaps(srcHeight, dstHeight, filter);
+		const size_t dstRowFloats = (size_t)dstWidth * 4;
+
+		// Horizontal pass over every source row, then a vertical pass over whole rows.
+		rows.resize((size_t)srcHeight * dstRowFloats);
+		for (int y = 0; y < srcHeight; y++)
+			FilterRow(rows.data() + y * dstRowFloats, current.data() + (size_t)y * srcWidth * 4, tapsX, dstWidth);
+		next.assign((size_t)dstHeight * dstRowFloats, 0.0f);
+		for (int y = 0; y < dstHeight; y++) {
+			for (int k = 0; k < tapsY.numTaps; k++) {
+				const size_t tap = (size_t)y * tapsY.numTaps + k;
+				if (tapsY.weights[tap] != 0.0f)
+					MultiplyAdd(next.data() + y * dstRowFloats, rows.data() + tapsY.indices[tap] * dstRowFloats, tapsY.weights[tap], dstRowFloats);
+			}
+		}
+
+		TextureLevel level;
+		level.width = dstWidth;
+		level.height = dstHeight;
+		StoreLevel(level, next, numChannels, gammaCorrect);
+		levels.push_back(std::move(level));
+		current.swap(next);
+		srcWidth = dstWidth;
+		srcHeight = dstHeight;
+	}
+	return levels;
+}
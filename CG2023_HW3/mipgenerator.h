@@ -0,0 +1,36 @@
+#ifndef MIP_GENERATOR_H
+#define MIP_GENERATOR_H
+
+#include "headers.h"
+
+// Mip chain generation on the CPU.
+// Each level is resampled from the previous one with a separable filter, in linear light
+// (8-bit color channels are treated as sRGB and alpha as linear), and the levels are kept as
+// floats between passes, so rounding errors do not pile up down the chain. The inner loops
+// use SSE2 where available. Runs wherever it is called, i.e. on the texture decode workers.
+
+// Downsampling filters.
+//   BOX: the average of the source pixels under each destination pixel (as glGenerateMipmap).
+//   KAISER: Kaiser-windowed sinc over 3 destination pixels each side; sharper, slower.
+enum MipFilter
+{
+	MIP_FILTER_BOX,
+	MIP_FILTER_KAISER,
+};
+
+// One level of a texture's mip chain, with tightly packed rows (or 4x4 blocks).
+struct TextureLevel
+{
+	int width;
+	int height;
+	std::vector<unsigned char> data;
+};
+
+// Levels 0 (a tightly packed copy of the image) down to 1x1 of an image with 1, 3 or 4 8-bit
+// channels whose rows are rowBytes apart. Without gammaCorrect, colors are filtered as stored.
+std::vector<TextureLevel> GenerateMipChain(const unsigned char* pixels, const int width, const int height, const int numChannels,
+										   const size_t rowBytes, const MipFilter filter, const bool gammaCorrect);
+// The same from a tightly packed level 0, which becomes the first level without a copy.
+std::vector<TextureLevel> GenerateMipChain(TextureLevel base, const int numChannels, const MipFilter filter, const bool gammaCorrect);
+
+#endif
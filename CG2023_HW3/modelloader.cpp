@@ -0,0 +1,118 @@
+#include "modelloader.h"
+#include "texturecache.h"
+
+// Files at least this large are shown progressively while they load.
+static const unsigned long long STREAMING_MIN_FILE_SIZE = 32ull * 1024 * 1024;
+
+ModelLoader::ModelLoader()
+{
+}
+
+ModelLoader::~ModelLoader()
+{
+	Cancel();
+	CollectRetiredJobs(true);
+}
+
+void ModelLoader::Request(const std::string& modelPath)
+{
+	Cancel();
+	CollectRetiredJobs(false);
+
+	currentJob = std::make_unique<Job>();
+	currentJob->modelPath = modelPath;
+	std::error_code error;
+	const unsigned long long fileSize = std::filesystem::file_size(modelPath, error);
+	if (!error && fileSize >= STREAMING_MIN_FILE_SIZE) {
+		currentJob->streamed = true;
+		// An OBJ/OBJM record costs about 64 bytes per output vertex; the VBO grows if that is too few.
+		currentJob->estimatedVertices = (size_t)(fileSize / 64);
+	}
+	currentJob->worker = std::thread(RunJob, currentJob.get());
+	std::cout << "[INFO] Loading " << modelPath << " in the background" << std::endl;
+}
+
+void ModelLoader::Cancel()
+{
+	if (currentJob == nullptr)
+		return;
+	// The worker notices the flag at its next poll; it is joined later so the GL thread never blocks.
+	currentJob->cancel = true;
+	ReleaseStreamingMesh(currentJob.get());
+	retiredJobs.push_back(std::move(currentJob));
+}
+
+TriangleMesh* ModelLoader::TakeLoadedMesh()
+{
+	CollectRetiredJobs(false);
+	if (currentJob == nullptr || !currentJob->done.load())
+		return nullptr;
+
+	currentJob->worker.join();
+	std::unique_ptr<Job> job = std::move(currentJob);
+	ReleaseStreamingMesh(job.get());
+	if (!job->succeeded) {
+		std::cerr << "[ERROR] Failed to load " << job->modelPath << std::endl;
+		delete job->mesh;
+		return nullptr;
+	}
+	return job->mesh;
+}
+
+void ModelLoader::UpdateStreamingMesh()
+{
+	if (currentJob == nullptr || !currentJob->streamed)
+		return;
+	MeshBatch batch;
+	while (currentJob->stream.Pop(batch)) {
+		if (currentJob->streamingMesh == nullptr) {
+			currentJob->streamingMesh = new TriangleMesh();
+			currentJob->streamingMesh->BeginStreaming(currentJob->estimatedVertices);
+		}
+		currentJob->streamingMesh->AppendBatch(batch);
+	}
+}
+
+TriangleMesh* ModelLoader::GetStreamingMesh() const
+{
+	if (currentJob == nullptr || currentJob->streamingMesh == nullptr || currentJob->streamingMesh->GetNumTriangles() == 0)
+		return nullptr;
+	return currentJob->streamingMesh;
+}
+
+void ModelLoader::RunJob(Job* job)
+{
+	// Only CPU work happens here: the mesh has no GL objects until CreateBuffers().
+	job->mesh = new TriangleMesh();
+	job->mesh->SetReportLoadStats(true);
+	job->mesh->SetCancelFlag(&job->cancel);
+	if (job->streamed)
+		job->mesh->SetStream(&job->stream);
+	job->succeeded = job->mesh->LoadFromFile(job->modelPath, true) && !job->cancel.load();
+	job->mesh->SetCancelFlag(nullptr);
+	job->mesh->SetStream(nullptr);
+	job->done = true;
+}
+
+// Delete the preview on the GL thread, with its copies of the materials.
+void ModelLoader::ReleaseStreamingMesh(Job* job)
+{
+	delete job->streamingMesh;
+	job->streamingMesh = nullptr;
+}
+
+void ModelLoader::CollectRetiredJobs(const bool wait)
+{
+	for (auto it = retiredJobs.begin(); it != retiredJobs.end();) {
+		Job* job = it->get();
+		if (!wait && !job->done.load()) {
+			++it;
+			continue;
+		}
+		job->worker.join();
+		delete job->mesh;
+		it = retiredJobs.erase(it);
+		// The textures a cancelled load decoded stay cached for a later attempt.
+		TextureCache::Trim();
+	}
+}
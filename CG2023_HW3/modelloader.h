@@ -0,0 +1,65 @@
+#ifndef MODEL_LOADER_H
+#define MODEL_LOADER_H
+
+#include "headers.h"
+#include "trianglemesh.h"
+#include "meshstream.h"
+
+// ModelLoader Declarations.
+// Loads models on a background thread so the render loop keeps drawing the current mesh.
+// Parsing and texture decoding run on the worker; the finished mesh is handed to the GL
+// thread through TakeLoadedMesh(), which is where its buffers and textures get created.
+// Large files are streamed: until they are done, GetStreamingMesh() shows the part parsed so far.
+class ModelLoader
+{
+public:
+	// ModelLoader Public Methods.
+	ModelLoader();
+	~ModelLoader();
+
+	// Start loading a model; a load that is still running is cancelled.
+	void Request(const std::string& modelPath);
+	// Cancel the running load, if any.
+	void Cancel();
+
+	// Called on the GL thread every frame: returns a fully loaded mesh once (nullptr otherwise).
+	// The caller takes ownership and still has to call CreateBuffers().
+	TriangleMesh* TakeLoadedMesh();
+	bool IsLoading() const { return currentJob != nullptr; }
+
+	// Called on the GL thread every frame: uploads the batches parsed since the last call.
+	void UpdateStreamingMesh();
+	// Partial preview of the model being loaded (nullptr if there is nothing to show yet).
+	TriangleMesh* GetStreamingMesh() const;
+
+private:
+	// One load request and the thread working on it.
+	struct Job
+	{
+		Job() : mesh(nullptr), streamed(false), estimatedVertices(0), streamingMesh(nullptr), succeeded(false), cancel(false), done(false) {}
+		std::string modelPath;
+		TriangleMesh* mesh;
+		// Streamed loads publish their geometry; the GL thread turns it into the preview mesh,
+		// which it creates on the first batch and owns.
+		bool streamed;
+		size_t estimatedVertices;
+		MeshStream stream;
+		TriangleMesh* streamingMesh;
+		bool succeeded;
+		std::atomic<bool> cancel;
+		std::atomic<bool> done;
+		std::thread worker;
+	};
+
+	// ModelLoader Private Methods.
+	static void RunJob(Job* job);
+	// Join cancelled jobs that have finished and free their meshes.
+	void CollectRetiredJobs(const bool wait);
+	static void ReleaseStreamingMesh(Job* job);
+
+	// ModelLoader Private Data.
+	std::unique_ptr<Job> currentJob;
+	std::vector<std::unique_ptr<Job>> retiredJobs;
+};
+
+#endif
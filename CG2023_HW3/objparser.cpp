@@ -0,0 +1,363 @@
+#include "objparser.h"
+
+// Helpers for scanning a mapped text file in place.
+static inline bool IsBlank(const char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+static inline const char* SkipBlanks(const char* p, const char* end)
+{
+	while (p < end && IsBlank(*p)) ++p;
+	return p;
+}
+
+static inline const char* NextLine(const char* p, const char* end)
+{
+	const char* newline = (const char*)std::memchr(p, '\n', end - p);
+	return newline ? newline + 1 : end;
+}
+
+// True if the line at p starts with the given keyword followed by a blank.
+static inline bool MatchKeyword(const char* p, const char* end, const char* keyword, const size_t length)
+{
+	return (size_t)(end - p) > length && std::memcmp(p, keyword, length) == 0 && IsBlank(p[length]);
+}
+
+// Read the first whitespace-delimited token at p.
+static std::string ReadToken(const char* p, const char* end)
+{
+	p = SkipBlanks(p, end);
+	const char* tokenEnd = p;
+	while (tokenEnd < end && !IsBlank(*tokenEnd) && *tokenEnd != '\r' && *tokenEnd != '\n') ++tokenEnd;
+	return std::string(p, tokenEnd);
+}
+
+// Parse a float at p with std::from_chars, which never consults the C locale.
+// Returns the position right after the number, or p itself if no number was found.
+static inline const char* ParseFloat(const char* p, const char* end, float& value)
+{
+	const char* start = (p < end && *p == '+') ? p + 1 : p;  // from_chars rejects a leading '+'.
+	const std::from_chars_result result = std::from_chars(start, end, value);
+	return result.ec == std::errc() ? result.ptr : p;
+}
+
+static inline const char* ParseInt(const char* p, const char* end, int& value)
+{
+	const char* start = (p < end && *p == '+') ? p + 1 : p;
+	const std::from_chars_result result = std::from_chars(start, end, value);
+	return result.ec == std::errc() ? result.ptr : p;
+}
+
+// Parse up to count blank-separated floats; returns how many were read.
+static inline int ParseFloats(const char*& p, const char* end, float* values, const int count)
+{
+	int numValues = 0;
+	for (; numValues < count; numValues++) {
+		const char* s = SkipBlanks(p, end);
+		const char* next = ParseFloat(s, end, values[numValues]);
+		if (next == s) break;
+		p = next;
+	}
+	return numValues;
+}
+
+// Record a usemtl / mtllib line if p holds one; returns true if it did.
+static inline bool ParseMaterialRecord(const char* p, const char* end, ParsedChunk& chunk, const size_t numCorners)
+{
+	const bool isUse = MatchKeyword(p, end, "usemtl", 6);
+	const bool isLibrary = !isUse && MatchKeyword(p, end, "mtllib", 6);
+	if (!isUse && !isLibrary)
+		return false;
+
+	ChunkEvent event;
+	event.isLibrary = isLibrary;
+	event.name = ReadToken(p + 6, end);
+	event.cornerOffset = numCorners;
+	event.triangleOffset = 0;
+	chunk.events.push_back(event);
+	return true;
+}
+
+// Poll the cancel flag every few thousand lines; parsing stops at the next poll after it is set.
+static inline bool PollCancel(const ParsedChunk& chunk, unsigned int& lineCounter)
+{
+	return (++lineCounter & 4095) == 0 && chunk.cancelFlag != nullptr && chunk.cancelFlag->load(std::memory_order_relaxed);
+}
+
+std::vector<ParsedChunk> SplitIntoChunks(const char* data, const char* end, const int maxChunks, const size_t minChunkSize)
+{
+	const size_t size = end - data;
+	size_t numChunks = std::max<size_t>(1, std::min<size_t>((size_t)std::max(maxChunks, 1), size / std::max<size_t>(minChunkSize, 1)));
+
+	std::vector<ParsedChunk> chunks;
+	chunks.reserve(numChunks);
+	const char* begin = data;
+	for (size_t i = 1; i <= numChunks && begin < end; i++) {
+		// Move each cut forward to just after the next newline.
+		const char* cut = (i == numChunks) ? end : NextLine(std::max(begin, data + size * i / numChunks), end);
+		if (cut <= begin)
+			continue;
+		chunks.emplace_back();
+		chunks.back().begin = begin;
+		chunks.back().end = cut;
+		begin = cut;
+	}
+	if (chunks.empty()) {
+		chunks.emplace_back();
+		chunks.back().begin = chunks.back().end = data;
+	}
+	return chunks;
+}
+
+std::vector<std::string> ScanHeaderMaterialLibraries(const char* data, const char* end)
+{
+	std::vector<std::string> libraries;
+	for (const char* p = data; p < end; p = NextLine(p, end)) {
+		p = SkipBlanks(p, end);
+		if (p == end)
+			break;
+		if (*p == 'v' || *p == 'f')  // "v", "vt", "vn", "vtx" or "f": the geometry starts here
+			break;
+		if (MatchKeyword(p, end, "mtllib", 6))
+			libraries.push_back(ReadToken(p + 6, end));
+	}
+	return libraries;
+}
+
+// Parse the "v", "vt", "vn", "f", "usemtl" and "mtllib" records of an *.OBJ chunk.
+void ParseObjChunk(ParsedChunk& chunk)
+{
+	const char* end = chunk.end;
+	// Roughly one record per 30 bytes; avoids most regrowth on large files.
+	const size_t estimate = (end - chunk.begin) / 90;
+	chunk.positions.reserve(estimate);
+	chunk.texcoords.reserve(estimate);
+	chunk.normals.reserve(estimate);
+	chunk.corners.reserve(estimate * 3);
+	chunk.faceSizes.reserve(estimate);
+
+	unsigned int lineCounter = 0;
+	for (const char* p = chunk.begin; p < end; p = NextLine(p, end)) {
+		if (PollCancel(chunk, lineCounter))
+			break;
+		p = SkipBlanks(p, end);
+		if (p + 1 >= end)
+			break;
+
+		switch (*p) {
+		case 'v':
+			if (IsBlank(p[1])) {
+				const char* s = p + 2;
+				float v[3] = { 0.0f, 0.0f, 0.0f };
+				ParseFloats(s, end, v, 3);
+				chunk.positions.push_back(glm::vec3(v[0], v[1], v[2]));
+			}
+			else if (p[1] == 't' && MatchKeyword(p, end, "vt", 2)) {
+				const char* s = p + 3;
+				float vt[2] = { 0.0f, 0.0f };
+				ParseFloats(s, end, vt, 2);
+				chunk.texcoords.push_back(glm::vec2(vt[0], vt[1]));
+			}
+			else if (p[1] == 'n' && MatchKeyword(p, end, "vn", 2)) {
+				const char* s = p + 3;
+				float vn[3] = { 0.0f, 1.0f, 0.0f };
+				ParseFloats(s, end, vn, 3);
+				chunk.normals.push_back(glm::vec3(vn[0], vn[1], vn[2]));
+			}
+			break;
+
+		case 'f':
+			if (IsBlank(p[1])) {
+				// Each corner is "v", "v/vt", "v//vn" or "v/vt/vn".
+				const size_t localCounts[3] = { chunk.positions.size(), chunk.texcoords.size(), chunk.normals.size() };
+				unsigned int numCorners = 0;
+				const char* s = p + 2;
+				while (true) {
+					s = SkipBlanks(s, end);
+					ObjCorner corner = { { 0, 0, 0 }, 0 };
+					const char* next = ParseInt(s, end, corner.index[0]);
+					if (next == s)
+						break;
+					s = next;
+					for (int k = 1; k < 3 && s < end && *s == '/'; k++)
+						s = ParseInt(s + 1, end, corner.index[k]);
+					// Relative indices count back from the records read so far.
+					for (int k = 0; k < 3; k++) {
+						if (corner.index[k] < 0) {
+							corner.index[k] += (int)localCounts[k];
+							corner.relativeMask |= 1u << k;
+						}
+					}
+					chunk.corners.push_back(corner);
+					numCorners++;
+				}
+				if (numCorners > 0)
+					chunk.faceSizes.push_back(numCorners);
+			}
+			break;
+
+		case 'u':
+		case 'm':
+			ParseMaterialRecord(p, end, chunk, chunk.corners.size());
+			break;
+
+		default:
+			break;
+		}
+	}
+	chunk.numVertices = chunk.corners.size();
+}
+
+// Parse the "vtx", "usemtl" and "mtllib" records of an *.OBJM chunk.
+// Every "vtx px py pz u v nx ny nz" record is one triangle corner.
+void ParseObjmChunk(ParsedChunk& chunk)
+{
+	const char* end = chunk.end;
+	// Every record is at least "vtx " plus eight one-digit values.
+	chunk.vertices.reserve((end - chunk.begin) / 20);
+
+	unsigned int lineCounter = 0;
+	for (const char* p = chunk.begin; p < end; p = NextLine(p, end)) {
+		if (PollCancel(chunk, lineCounter))
+			break;
+		p = SkipBlanks(p, end);
+
+		if (MatchKeyword(p, end, "vtx", 3)) {
+			float values[8];
+			const char* s = p + 3;
+			if (ParseFloats(s, end, values, 8) == 8) {
+				chunk.vertices.push_back(VertexPTN(glm::vec3(values[0], values[1], values[2]),
+												   glm::vec3(values[5], values[6], values[7]),
+												   glm::vec2(values[3], values[4])));
+			}
+			else {
+				chunk.numInvalidCorners++;
+			}
+		}
+		else {
+			ParseMaterialRecord(p, end, chunk, chunk.vertices.size());
+		}
+	}
+	chunk.numVertices = chunk.vertices.size();
+}
+
+// Find the attribute with the given global index in whichever chunk holds it.
+template <typename T>
+static inline const T* FindAttribute(const ParsedChunk* chunks, const size_t numChunks, const ParsedChunk& hint, const size_t globalIndex,
+									 size_t ParsedChunk::* offset, std::vector<T> ParsedChunk::* attributes)
+{
+	// Most references point into the chunk being resolved.
+	if (globalIndex >= hint.*offset && globalIndex < hint.*offset + (hint.*attributes).size())
+		return &(hint.*attributes)[globalIndex - hint.*offset];
+
+	// Otherwise find the last chunk that starts at or before the index.
+	size_t lo = 0, hi = numChunks;
+	while (hi - lo > 1) {
+		const size_t mid = (lo + hi) / 2;
+		if (chunks[mid].*offset <= globalIndex)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	const ParsedChunk& owner = chunks[lo];
+	if (globalIndex < owner.*offset || globalIndex >= owner.*offset + (owner.*attributes).size())
+		return nullptr;
+	return &(owner.*attributes)[globalIndex - owner.*offset];
+}
+
+// Flush the events that happen before the given corner.
+static inline void MarkEvents(ParsedChunk& chunk, size_t& nextEvent, const size_t corner)
+{
+	while (nextEvent < chunk.events.size() && chunk.events[nextEvent].cornerOffset <= corner) {
+		chunk.events[nextEvent].triangleOffset = chunk.triangles.size() / 3;
+		nextEvent++;
+	}
+}
+
+void ResolveObjChunk(ParsedChunk& chunk, const size_t totalPositions, const size_t totalTexcoords, const size_t totalNormals,
+					 const ParsedChunk* chunks, const size_t numChunks, VertexPTN* output)
+{
+	const size_t totals[3] = { totalPositions, totalTexcoords, totalNormals };
+	const size_t offsets[3] = { chunk.positionOffset, chunk.texcoordOffset, chunk.normalOffset };
+
+	chunk.triangles.reserve(chunk.corners.size() * 3);
+	size_t nextEvent = 0;
+	size_t corner = 0;
+	for (const unsigned int faceSize : chunk.faceSizes) {
+		MarkEvents(chunk, nextEvent, corner);
+
+		bool valid = true;
+		const unsigned int firstVertex = (unsigned int)(chunk.vertexOffset + corner);
+		for (unsigned int c = 0; c < faceSize; c++, corner++) {
+			const ObjCorner& objCorner = chunk.corners[corner];
+			// Convert to 0-based global indices; -1 marks a missing or out-of-range attribute.
+			long long globalIndex[3];
+			for (int k = 0; k < 3; k++) {
+				const long long index = objCorner.index[k];
+				if (objCorner.relativeMask & (1u << k))
+					globalIndex[k] = (long long)offsets[k] + index;
+				else
+					globalIndex[k] = index > 0 ? index - 1 : -1;
+				if (globalIndex[k] >= (long long)totals[k])
+					globalIndex[k] = -1;
+			}
+
+			// Store a PTN for one point in the structure.
+			VertexPTN vertex;
+			const glm::vec3* position = globalIndex[0] >= 0 ?
+				FindAttribute(chunks, numChunks, chunk, (size_t)globalIndex[0], &ParsedChunk::positionOffset, &ParsedChunk::positions) : nullptr;
+			if (position != nullptr)
+				vertex.position = *position;
+			else
+				valid = false;
+			if (globalIndex[1] >= 0) {
+				const glm::vec2* texcoord = FindAttribute(chunks, numChunks, chunk, (size_t)globalIndex[1], &ParsedChunk::texcoordOffset, &ParsedChunk::texcoords);
+				if (texcoord != nullptr) vertex.texcoord = *texcoord;
+			}
+			if (globalIndex[2] >= 0) {
+				const glm::vec3* normal = FindAttribute(chunks, numChunks, chunk, (size_t)globalIndex[2], &ParsedChunk::normalOffset, &ParsedChunk::normals);
+				if (normal != nullptr) vertex.normal = *normal;
+			}
+			output[chunk.vertexOffset + corner] = vertex;
+		}
+
+		if (!valid) {
+			// Keep the vertices so later offsets stay put, but drop the face.
+			chunk.numInvalidCorners += faceSize;
+			continue;
+		}
+		// Split the polygon into a triangle fan.
+		for (unsigned int i = 2; i < faceSize; i++) {
+			chunk.triangles.push_back(firstVertex);
+			chunk.triangles.push_back(firstVertex + i - 1);
+			chunk.triangles.push_back(firstVertex + i);
+		}
+	}
+	MarkEvents(chunk, nextEvent, (size_t)-1);
+}
+
+void ResolveObjmChunk(ParsedChunk& chunk, const size_t totalVertices, VertexPTN* output)
+{
+	// A trailing incomplete triangle is dropped.
+	const size_t numVertices = chunk.vertexOffset >= totalVertices ? 0 :
+		std::min(chunk.vertices.size(), totalVertices - chunk.vertexOffset);
+	if (numVertices > 0)
+		std::memcpy((void*)(output + chunk.vertexOffset), chunk.vertices.data(), sizeof(VertexPTN) * numVertices);
+
+	// Every third corner closes a triangle, even when it started in the previous chunk.
+	chunk.triangles.reserve(numVertices + 3);
+	size_t nextEvent = 0;
+	for (size_t i = 0; i < numVertices; i++) {
+		const size_t globalIndex = chunk.vertexOffset + i;
+		if (globalIndex % 3 != 2)
+			continue;
+		MarkEvents(chunk, nextEvent, i);
+		chunk.triangles.push_back((unsigned int)globalIndex - 2);
+		chunk.triangles.push_back((unsigned int)globalIndex - 1);
+		chunk.triangles.push_back((unsigned int)globalIndex);
+	}
+	MarkEvents(chunk, nextEvent, (size_t)-1);
+	// The chunk's vertices are in the output array now.
+	std::vector<VertexPTN>().swap(chunk.vertices);
+}
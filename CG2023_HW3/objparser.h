@@ -0,0 +1,94 @@
+#ifndef OBJ_PARSER_H
+#define OBJ_PARSER_H
+
+#include "headers.h"
+#include "trianglemesh.h"
+
+// Chunked OBJ/OBJM parsing.
+// A mapped model file is split at line boundaries into chunks that are parsed independently:
+//   1. ParseObjChunk / ParseObjmChunk read the records of one chunk into local arrays.
+//   2. After the per-chunk counts are known, every chunk gets its global attribute and vertex
+//      offsets, and ResolveObjChunk / ResolveObjmChunk write its vertices into the shared array.
+//   3. The caller walks the chunks in file order and applies their material events.
+// Parsing the whole file as a single chunk is the serial path, so both give identical output.
+// Streamed loads run the passes over a few chunks (a wave) at a time, in file order.
+
+// One "v/vt/vn" face corner as written in the file (0 = missing).
+// Relative (negative) indices are stored as chunk-local offsets, flagged in relativeMask.
+struct ObjCorner
+{
+	int index[3];
+	unsigned int relativeMask;
+};
+
+// A "usemtl" or "mtllib" record.
+struct ChunkEvent
+{
+	bool isLibrary;
+	std::string name;
+	// Number of corners in the chunk before the record.
+	size_t cornerOffset;
+	// Number of triangles in the chunk before the record (set by the resolve pass).
+	size_t triangleOffset;
+};
+
+// ParsedChunk Declarations.
+struct ParsedChunk
+{
+	ParsedChunk() {
+		begin = end = nullptr;
+		positionOffset = texcoordOffset = normalOffset = 0;
+		vertexOffset = 0;
+		numVertices = 0;
+		numInvalidCorners = 0;
+		cancelFlag = nullptr;
+	}
+	// Text range of the chunk.
+	const char* begin;
+	const char* end;
+	// Parsing stops early once this is set (optional).
+	const std::atomic<bool>* cancelFlag;
+
+	// OBJ records.
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec2> texcoords;
+	std::vector<glm::vec3> normals;
+	std::vector<ObjCorner> corners;
+	std::vector<unsigned int> faceSizes;
+	// OBJM records.
+	std::vector<VertexPTN> vertices;
+
+	std::vector<ChunkEvent> events;
+
+	// Global offsets of this chunk's first position / texcoord / normal / output vertex.
+	size_t positionOffset;
+	size_t texcoordOffset;
+	size_t normalOffset;
+	size_t vertexOffset;
+	// Output vertices produced by the chunk.
+	size_t numVertices;
+
+	// Triangles of the chunk as global vertex indices, filled by the resolve pass.
+	std::vector<unsigned int> triangles;
+	size_t numInvalidCorners;
+};
+
+// Split [data, end) into at most maxChunks pieces that start at line boundaries.
+std::vector<ParsedChunk> SplitIntoChunks(const char* data, const char* end, const int maxChunks, const size_t minChunkSize);
+
+// Names of the "mtllib" records before the first vertex or face of a model file. Libraries
+// are nearly always declared there, so their materials (and textures) can be loaded while
+// the geometry is still being parsed.
+std::vector<std::string> ScanHeaderMaterialLibraries(const char* data, const char* end);
+
+// Pass 1: parse the records of one chunk.
+void ParseObjChunk(ParsedChunk& chunk);
+void ParseObjmChunk(ParsedChunk& chunk);
+
+// Pass 2: write the chunk's vertices to output[chunk.vertexOffset...] and build its triangles.
+// Attributes are looked up in chunks[0, numChunks), which must all have their offsets set.
+void ResolveObjChunk(ParsedChunk& chunk, const size_t totalPositions, const size_t totalTexcoords, const size_t totalNormals,
+					 const ParsedChunk* chunks, const size_t numChunks, VertexPTN* output);
+void ResolveObjmChunk(ParsedChunk& chunk, const size_t totalVertices, VertexPTN* output);
+
+#endif
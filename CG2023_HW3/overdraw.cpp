@@ -0,0 +1,208 @@
+#include "overdraw.h"
+#include "vertexcache.h"
+
+// FIFO vertex cache simulation over the vertices of a mesh, as in AnalyzeVertexCache().
+class CacheSimulator
+{
+public:
+	explicit CacheSimulator(const size_t numVertices) : entered(numVertices, 0), numMisses(VERTEX_CACHE_ANALYSIS_SIZE + 1) {}
+	// Start over with an empty cache.
+	void Flush() { numMisses += VERTEX_CACHE_ANALYSIS_SIZE + 1; }
+	// Cache misses of a triangle.
+	int Draw(const unsigned int* triangle) {
+		int misses = 0;
+		for (int k = 0; k < 3; k++) {
+			const unsigned int v = triangle[k];
+			if (numMisses - entered[v] > (unsigned long long)VERTEX_CACHE_ANALYSIS_SIZE) {
+				entered[v] = numMisses++;
+				misses++;
+			}
+		}
+		return misses;
+	}
+
+private:
+	// Miss count at which each vertex entered the cache (0 = never).
+	std::vector<unsigned long long> entered;
+	unsigned long long numMisses;
+};
+
+void OptimizeOverdraw(unsigned int* indices, const size_t numIndices, const VertexPTN* vertices,
+					  const size_t numVertices, const float threshold)
+{
+	const size_t numTriangles = numIndices / 3;
+	if (numTriangles < 2)
+		return;
+	CacheSimulator cache(numVertices);
+
+	// Hard cuts: a triangle whose corners all miss starts a new patch of the surface.
+	std::vector<size_t> hardCuts;
+	for (size_t t = 0; t < numTriangles; t++) {
+		if (cache.Draw(indices + t * 3) == 3 || t == 0)
+			hardCuts.push_back(t);
+	}
+	hardCuts.push_back(numTriangles);
+
+	// Soft cuts: within a patch, close a cluster as soon as its miss rate (with the cache
+	// flushed at its start) is within threshold of the patch's.
+	std::vector<size_t> clusters;
+	for (size_t c = 0; c + 1 < hardCuts.size(); c++) {
+		const size_t begin = hardCuts[c];
+		const size_t end = hardCuts[c + 1];
+		cache.Flush();
+		int patchMisses = 0;
+		for (size_t t = begin; t < end; t++)
+			patchMisses += cache.Draw(indices + t * 3);
+		const float targetAcmr = (float)patchMisses / (end - begin) * threshold;
+
+		cache.Flush();
+		clusters.push_back(begin);
+		int misses = 0;
+		int count = 0;
+		for (size_t t = begin; t < end; t++) {
+			misses += cache.Draw(indices + t * 3);
+			count++;
+			if ((float)misses / count <= targetAcmr && t + 1 < end) {
+				clusters.push_back(t + 1);
+				cache.Flush();
+				misses = count = 0;
+			}
+		}
+	}
+	clusters.push_back(numTriangles);
+	const size_t numClusters = clusters.size() - 1;
+	if (numClusters < 2)
+		return;
+
+	// Occlusion potential of each cluster: how far its area-weighted centroid lies out along its
+	// average normal, seen from the centroid of the whole list.
+	glm::vec3 center(0.0f, 0.0f, 0.0f);
+	for (size_t i = 0; i < numTriangles * 3; i++)
+		center += vertices[indices[i]].position;
+	center /= (float)(numTriangles * 3);
+	std::vector<float> keys(numClusters);
+	for (size_t c = 0; c < numClusters; c++) {
+		glm::vec3 centroid(0.0f, 0.0f, 0.0f);
+		glm::vec3 normal(0.0f, 0.0f, 0.0f);
+		float area = 0.0f;
+		for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+			const glm::vec3& a = vertices[indices[t * 3]].position;
+			const glm::vec3& b = vertices[indices[t * 3 + 1]].position;
+			const glm::vec3& d = vertices[indices[t * 3 + 2]].position;
+			const glm::vec3 n = glm::cross(b - a, d - a);
+			const float triangleArea = glm::length(n);
+			centroid += (a + b + d) * (triangleArea / 3.0f);
+			normal += n;
+			area += triangleArea;
+		}
+		const float normalLength = glm::length(normal);
+		if (area > 0.0f && normalLength > 0.0f)
+			keys[c] = glm::dot(centroid / area - center, normal / normalLength);
+		else
+			keys[c] = 0.0f;
+	}
+
+	std::vector<size_t> order(numClusters);
+	for (size_t c = 0; c < numClusters; c++)
+		order[c] = c;
+	std::stable_sort(order.begin(), order.end(), [&keys](const size_t a, const size_t b) { return keys[a] > keys[b]; });
+	std::vector<unsigned int> output;
+	output.reserve(numTriangles * 3);
+	for (const size_t c : order)
+		output.insert(output.end(), indices + clusters[c] * 3, indices + clusters[c + 1] * 3);
+	std::copy(output.begin(), output.end(), indices);
+}
+
+// A vertex projected into the grid: x, y in pixels and the depth.
+struct GridPoint
+{
+	float x;
+	float y;
+	float z;
+};
+
+// Draw a triangle into the depth buffer with a less-than test, at pixel centers.
+static void RasterizeTriangle(GridPoint a, GridPoint b, GridPoint c, std::vector<float>& depth, unsigned long long& numShaded)
+{
+	float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+	if (area == 0.0f)
+		return;
+	if (area < 0.0f) {
+		std::swap(b, c);
+		area = -area;
+	}
+	const int minX = std::max(0, (int)std::floor(std::min({ a.x, b.x, c.x })));
+	const int maxX = std::min(OVERDRAW_GRID_SIZE - 1, (int)std::ceil(std::max({ a.x, b.x, c.x })));
+	const int minY = std::max(0, (int)std::floor(std::min({ a.y, b.y, c.y })));
+	const int maxY = std::min(OVERDRAW_GRID_SIZE - 1, (int)std::ceil(std::max({ a.y, b.y, c.y })));
+	// Edge functions (twice the area of the sub-triangle opposite each corner) and depth are
+	// linear across the grid, so they are stepped instead of evaluated per pixel.
+	const float invArea = 1.0f / area;
+	const float stepAX = -(c.y - b.y), stepAY = c.x - b.x;
+	const float stepBX = -(a.y - c.y), stepBY = a.x - c.x;
+	const float stepCX = -(b.y - a.y), stepCY = b.x - a.x;
+	const float px = minX + 0.5f;
+	const float py = minY + 0.5f;
+	float rowA = stepAY * (py - b.y) + stepAX * (px - b.x);
+	float rowB = stepBY * (py - c.y) + stepBX * (px - c.x);
+	float rowC = stepCY * (py - a.y) + stepCX * (px - a.x);
+	for (int y = minY; y <= maxY; y++, rowA += stepAY, rowB += stepBY, rowC += stepCY) {
+		float wa = rowA, wb = rowB, wc = rowC;
+		float* row = depth.data() + (size_t)y * OVERDRAW_GRID_SIZE;
+		for (int x = minX; x <= maxX; x++, wa += stepAX, wb += stepBX, wc += stepCX) {
+			if (wa < 0.0f || wb < 0.0f || wc < 0.0f)
+				continue;
+			const float z = (wa * a.z + wb * b.z + wc * c.z) * invArea;
+			if (z < row[x]) {
+				row[x] = z;
+				numShaded++;
+			}
+		}
+	}
+}
+
+OverdrawStats AnalyzeOverdraw(const std::vector<VertexPTN>& vertices, const std::vector<SubMesh>& subMeshes)
+{
+	OverdrawStats stats;
+	if (vertices.empty())
+		return stats;
+
+	// Fit the bounding box into the grid, the same scale on every axis.
+	glm::vec3 boundsMin = vertices[0].position;
+	glm::vec3 boundsMax = vertices[0].position;
+	for (const auto& vertex : vertices) {
+		boundsMin = glm::min(boundsMin, vertex.position);
+		boundsMax = glm::max(boundsMax, vertex.position);
+	}
+	const glm::vec3 extent = boundsMax - boundsMin;
+	const float maxExtent = std::max(extent.x, std::max(extent.y, extent.z));
+	if (maxExtent <= 0.0f)
+		return stats;
+	const float scale = OVERDRAW_GRID_SIZE / maxExtent;
+
+	const float farDepth = std::numeric_limits<float>::max();
+	std::vector<float> depth((size_t)OVERDRAW_GRID_SIZE * OVERDRAW_GRID_SIZE);
+	std::vector<GridPoint> points(vertices.size());
+	for (int view = 0; view < 6; view++) {
+		// Looking along +axis or -axis; the other two axes span the grid.
+		const int axis = view / 2;
+		const float direction = (view % 2 == 0) ? 1.0f : -1.0f;
+		for (size_t i = 0; i < vertices.size(); i++) {
+			const glm::vec3 p = (vertices[i].position - boundsMin) * scale;
+			points[i].x = p[(axis + 1) % 3];
+			points[i].y = p[(axis + 2) % 3];
+			points[i].z = p[axis] * direction;
+		}
+		std::fill(depth.begin(), depth.end(), farDepth);
+		for (const auto& subMesh : subMeshes) {
+			const std::vector<unsigned int>& indices = subMesh.vertexIndices;
+			for (size_t i = 0; i + 2 < indices.size(); i += 3)
+				RasterizeTriangle(points[indices[i]], points[indices[i + 1]], points[indices[i + 2]], depth, stats.numShaded);
+		}
+		for (const float z : depth) {
+			if (z != farDepth)
+				stats.numCovered++;
+		}
+	}
+	return stats;
+}
@@ -0,0 +1,30 @@
+#ifndef OVERDRAW_H
+#define OVERDRAW_H
+
+#include "headers.h"
+#include "trianglemesh.h"
+
+// Triangle ordering against overdraw, and its measurement.
+// With the depth test on, a fragment behind one already drawn is rejected before the fragment
+// shader runs, so drawing the triangles that tend to hide others first saves shading work.
+// OptimizeOverdraw() follows the second pass of Tipsify (Sander et al. 2007): the vertex cache
+// ordered list is cut into clusters wherever the cache starts over, and further wherever the
+// miss rate of the cluster so far is within threshold of the whole cluster's, so the cuts cost
+// little cache efficiency. The clusters are then sorted by a view-independent occlusion
+// estimate: outward-facing clusters far from the center of the list are drawn first.
+
+// Side of the square grid AnalyzeOverdraw() renders the views into.
+const int OVERDRAW_GRID_SIZE = 256;
+
+// Reorder the triangles of numIndices indices (a multiple of 3) into vertices in place.
+// threshold >= 1 is the factor by which a cluster's cache miss rate may exceed that of the
+// order it was cut from; larger values give smaller clusters that sort better.
+void OptimizeOverdraw(unsigned int* indices, const size_t numIndices, const VertexPTN* vertices,
+					  const size_t numVertices, const float threshold);
+
+// Render the subMeshes in order from the 6 axis directions with orthographic projection, a
+// less-than depth test and no culling (as the viewer draws them), into a grid fitted to their
+// bounding box, and count the fragments that pass the depth test against the pixels covered.
+OverdrawStats AnalyzeOverdraw(const std::vector<VertexPTN>& vertices, const std::vector<SubMesh>& subMeshes);
+
+#endif
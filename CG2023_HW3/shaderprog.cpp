@@ -134,6 +134,9 @@ PhongShadingDemoShaderProg::PhongShadingDemoShaderProg()
     locM = -1;
     locNM = -1;
     locCameraPos = -1;
+    locPackedVertices = -1;
+    locPositionScale = -1;
+    locPositionOffset = -1;
     locKa = -1;
     locKd = -1;
     locKs = -1;
@@ -153,6 +156,9 @@ PhongShadingDemoShaderProg::PhongShadingDemoShaderProg()
 	// Add your code for initializing the data of textures.
     locMapKd = -1;
     locMapExist = -1;
+    locMapKdArray = -1;
+    locMapKdLayer = -1;
+    locMapKdRegion = -1;
 	// -------------------------------------------------------
 }
 
@@ -165,6 +171,9 @@ void PhongShadingDemoShaderProg::GetUniformVariableLocation()
     locM = glGetUniformLocation(shaderProgId, "worldMatrix");
     locNM = glGetUniformLocation(shaderProgId, "normalMatrix");
     locCameraPos = glGetUniformLocation(shaderProgId, "cameraPos");
+    locPackedVertices = glGetUniformLocation(shaderProgId, "packedVertices");
+    locPositionScale = glGetUniformLocation(shaderProgId, "positionScale");
+    locPositionOffset = glGetUniformLocation(shaderProgId, "positionOffset");
     locKa = glGetUniformLocation(shaderProgId, "Ka");
     locKd = glGetUniformLocation(shaderProgId, "Kd");
     locKs = glGetUniformLocation(shaderProgId, "Ks");
@@ -185,6 +194,9 @@ void PhongShadingDemoShaderProg::GetUniformVariableLocation()
 	// Add your code for getting the location of texture variable.
     locMapKd = glGetUniformLocation(shaderProgId, "mapKd");
     locMapExist = glGetUniformLocation(shaderProgId, "mapExist");
+    locMapKdArray = glGetUniformLocation(shaderProgId, "mapKdArray");
+    locMapKdLayer = glGetUniformLocation(shaderProgId, "mapKdLayer");
+    locMapKdRegion = glGetUniformLocation(shaderProgId, "mapKdRegion");
 	// -------------------------------------------------------
 
 }
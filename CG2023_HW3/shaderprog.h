@@ -88,6 +88,12 @@ public:
 	// Add your methods for supporting textures.
 	GLint GetLocMapKd() const { return locMapKd; }
 	GLint MapKdExist() const { return locMapExist; }
+	GLint GetLocMapKdArray() const { return locMapKdArray; }
+	GLint GetLocMapKdLayer() const { return locMapKdLayer; }
+	GLint GetLocMapKdRegion() const { return locMapKdRegion; }
+	GLint GetLocPackedVertices() const { return locPackedVertices; }
+	GLint GetLocPositionScale() const { return locPositionScale; }
+	GLint GetLocPositionOffset() const { return locPositionOffset; }
 	// -------------------------------------------------------
 
 protected:
@@ -100,6 +106,10 @@ private:
 	GLint locM;
 	GLint locNM;
 	GLint locCameraPos;
+	// Packed vertex decoding.
+	GLint locPackedVertices;
+	GLint locPositionScale;
+	GLint locPositionOffset;
 	// Material properties.
 	GLint locKa;
 	GLint locKd;
@@ -122,6 +132,11 @@ private:
 	// Texture data.
 	GLint locMapKd;
 	GLint locMapExist;
+	// Texture array and layer that replace mapKd if the layer is not negative.
+	GLint locMapKdArray;
+	GLint locMapKdLayer;
+	// Part of the texture to sample (offset xy, scale zw), for atlases.
+	GLint locMapKdRegion;
 	// -------------------------------------------------------
 	// Add your data for supporting textures.
 	// -------------------------------------------------------
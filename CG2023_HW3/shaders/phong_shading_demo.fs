@@ -12,6 +12,11 @@ uniform float Ns;
 
 uniform sampler2D mapKd;
 uniform int mapExist;
+// The texture is layer mapKdLayer of mapKdArray instead, unless the layer is negative.
+uniform sampler2DArray mapKdArray;
+uniform int mapKdLayer;
+// Part of the texture to sample: offset (xy) and scale (zw), for textures in an atlas.
+uniform vec4 mapKdRegion;
 // Light data.
 uniform vec3 ambientLight;
 uniform vec3 dirLightDir;
@@ -67,7 +72,17 @@ void main()
         tex = Kd;
     }
     else{
-        tex = texture2D(mapKd, iTexCoord).rgb;
+        // Repeat within the region; the gradients of the unwrapped texcoords keep the mip
+        // level steady where fract() jumps.
+        vec2 uv = mapKdRegion.xy + fract(iTexCoord) * mapKdRegion.zw;
+        vec2 dx = dFdx(iTexCoord) * mapKdRegion.zw;
+        vec2 dy = dFdy(iTexCoord) * mapKdRegion.zw;
+        if(mapKdLayer >= 0){
+            tex = textureGrad(mapKdArray, vec3(uv, mapKdLayer), dx, dy).rgb;
+        }
+        else{
+            tex = textureGrad(mapKd, uv, dx, dy).rgb;
+        }
     }
     
     vec3 vN = normalize(iNormalWorld);
@@ -8,21 +8,42 @@ layout (location = 2) in vec2 Texcoord;
 uniform mat4 worldMatrix;
 uniform mat4 normalMatrix;
 uniform mat4 MVP;
+// Packed vertices (see vertexpacking.h): Position and Normal.xy arrive as 16-bit integers,
+// the position relative to the mesh bounds and the normal octahedral-encoded.
+uniform int packedVertices;
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
 
 // Data pass to fragment shader.
 out vec3 iPosWorld;
 out vec3 iNormalWorld;
 out vec2 iTexCoord;
 
+vec3 DecodeOctahedral(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += (n.x >= 0.0) ? -t : t;
+    n.y += (n.y >= 0.0) ? -t : t;
+    return normalize(n);
+}
+
 void main()
 {
-    gl_Position = MVP * vec4(Position, 1.0);
+    vec3 position = Position;
+    vec3 normal = Normal;
+    if(packedVertices != 0){
+        position = positionOffset + Position * positionScale;
+        normal = DecodeOctahedral(Normal.xy / 32767.0);
+    }
+
+    gl_Position = MVP * vec4(position, 1.0);
 
     // Pass vertex attributes.
-    vec4 positionTmp = worldMatrix * vec4(Position, 1.0);
+    vec4 positionTmp = worldMatrix * vec4(position, 1.0);
     iPosWorld = positionTmp.xyz / positionTmp.w;
 
-    iNormalWorld = (normalMatrix * vec4(Normal, 0.0)).xyz;
+    iNormalWorld = (normalMatrix * vec4(normal, 0.0)).xyz;
 
     iTexCoord = Texcoord;
 }
\ No newline at end of file
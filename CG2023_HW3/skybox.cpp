@@ -1,11 +1,16 @@
 #include "skybox.h"
 
-Skybox::Skybox(const std::string& texImagePath, const int nSlices, const int nStacks, const float radius)
+Skybox::Skybox(const std::string& texImagePath, const int nSlices, const int nStacks, const float radius,
+			   TextureUploader* uploader)
 {
 	rotationY = 0.0f;
 
 	// Load panorama.
 	panorama = new ImageTexture(texImagePath);
+	if (uploader != nullptr)
+		uploader->Enqueue(panorama);
+	else
+		panorama->Upload();
 	// panorama->Preview();
 
 	// Create material.
@@ -63,7 +68,7 @@ void Skybox::Render(Camera* camera, SkyboxShaderProg* shader)
 	// -------------------------------------------------------
 	glUniformMatrix4fv(shader->GetLocMVP(), 1, GL_FALSE, glm::value_ptr(MVP));
 	// Set material properties.
-	if (material->GetMapKd() != nullptr) {
+	if (material->GetMapKd() != nullptr && material->GetMapKd()->IsUploaded()) {
 		material->GetMapKd()->Bind(GL_TEXTURE0);
         glUniform1i(shader->GetLocMapKd(), 0);
 	}
@@ -6,6 +6,7 @@
 #include "shaderprog.h"
 #include "material.h"
 #include "camera.h"
+#include "textureuploader.h"
 
 
 // VertexPT Declarations.
@@ -29,8 +30,9 @@ class Skybox
 {
 public:
 	// Skybox Public Methods.
+	// The panorama streams in through the uploader if one is given.
 	Skybox(const std::string& texImagePath, const int nSlices, 
-			const int nStacks, const float radius);
+			const int nStacks, const float radius, TextureUploader* uploader = nullptr);
 	~Skybox();
 	void Render(Camera* camera, SkyboxShaderProg* shader);
 	
@@ -0,0 +1,99 @@
+#include "texturearray.h"
+#include "textureresidency.h"
+
+TextureArray::TextureArray()
+{
+	textureObj = 0;
+	sizeInBytes = 0;
+}
+
+TextureArray::~TextureArray()
+{
+	if (textureObj != 0) {
+		glDeleteTextures(1, &textureObj);
+		TextureResidency::ChangeBytes(sizeInBytes, 0);
+	}
+}
+
+bool TextureArray::IsCompatible(const ImageTexture* a, const ImageTexture* b)
+{
+	return a->GetWidth() == b->GetWidth() && a->GetHeight() == b->GetHeight() &&
+		   a->GetInternalFormat() == b->GetInternalFormat() && a->GetNumLevels() == b->GetNumLevels();
+}
+
+int TextureArray::AddLayer(ImageTexture* texture)
+{
+	const auto it = std::find(layers.begin(), layers.end(), texture);
+	if (it != layers.end())
+		return (int)(it - layers.begin());
+	layers.push_back(texture);
+	return (int)layers.size() - 1;
+}
+
+bool TextureArray::Update()
+{
+	if (textureObj != 0 || layers.empty())
+		return IsReady();
+	for (const ImageTexture* texture : layers) {
+		if (!texture->IsFullyResident() || texture->GetNumDroppedLevels() > 0)
+			return false;
+	}
+
+	const ImageTexture* first = layers[0];
+	const GLint internalFormat = first->GetInternalFormat();
+	const int numLevels = first->GetNumLevels();
+	const int numLayers = (int)layers.size();
+	glGenTextures(1, &textureObj);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textureObj);
+	if (GLEW_VERSION_4_2 || GLEW_ARB_texture_storage) {
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, numLevels, internalFormat, first->GetWidth(), first->GetHeight(), numLayers);
+	}
+	else {
+		// Mutable storage, allocated level by level; the layers are copied in below.
+		GLenum format = GL_RGB;
+		if (internalFormat == GL_R8)
+			format = GL_RED;
+		else if (internalFormat == GL_RGBA8)
+			format = GL_RGBA;
+		for (int i = 0; i < numLevels; i++) {
+			const int width = std::max(first->GetWidth() >> i, 1);
+			const int height = std::max(first->GetHeight() >> i, 1);
+			if (first->IsCompressed()) {
+				BlockFormat blockFormat;
+				GetBlockFormat(internalFormat, blockFormat);
+				glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, i, internalFormat, width, height, numLayers, 0,
+									   (GLsizei)(GetCompressedSize(blockFormat, width, height) * numLayers), nullptr);
+			}
+			else {
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, i, internalFormat, width, height, numLayers, 0, format, GL_UNSIGNED_BYTE, nullptr);
+			}
+		}
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
+	}
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	for (int layer = 0; layer < numLayers; layer++) {
+		if (!layers[layer]->CopyToArrayLayer(textureObj, layer)) {
+			std::cerr << "Warning: Failed to build a texture array from " << layers[layer]->GetPath() << std::endl;
+			glDeleteTextures(1, &textureObj);
+			textureObj = 0;
+			layers.clear();
+			return false;
+		}
+	}
+
+	// Same bytes per layer as each member has on the GPU.
+	sizeInBytes = first->GetGpuSizeInBytes() * numLayers;
+	TextureResidency::ChangeBytes(0, sizeInBytes);
+	return true;
+}
+
+void TextureArray::Bind(GLenum textureUnit) const
+{
+	glActiveTexture(textureUnit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textureObj);
+}
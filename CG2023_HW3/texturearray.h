@@ -0,0 +1,48 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include "headers.h"
+#include "imagetexture.h"
+
+// TextureArray Declarations.
+// Textures of one model with the same size, format and number of levels, packed into the layers
+// of a GL_TEXTURE_2D_ARRAY, so every subMesh that uses one of them draws with the same binding
+// and only a per-draw layer index changes. The layers are copied from the member textures on the
+// GPU once all of them are fully resident (they stream in and are budgeted as usual); until then
+// the members are bound one by one. The array is never bound as a member, so TextureResidency may
+// reduce the members once it is built; its own bytes count towards the budget.
+// All methods but the constructor and AddLayer() must be called on the GL thread.
+class TextureArray
+{
+public:
+	// TextureArray Public Methods.
+	TextureArray();
+	~TextureArray();
+
+	// True if two textures can share an array.
+	static bool IsCompatible(const ImageTexture* a, const ImageTexture* b);
+
+	// Add a texture (compatible with the others) as the next layer; returns its layer index.
+	// A texture that is already a layer keeps its index.
+	int AddLayer(ImageTexture* texture);
+	int GetNumLayers() const { return (int)layers.size(); }
+
+	// Build the array once every member is fully resident; returns IsReady(). Cheap once built.
+	bool Update();
+	bool IsReady() const { return textureObj != 0; }
+	void Bind(GLenum textureUnit) const;
+	// GPU memory of the array's storage.
+	size_t GetSizeInBytes() const { return sizeInBytes; }
+
+private:
+	// Not copyable: the texture object is owned by exactly one array.
+	TextureArray(const TextureArray&) = delete;
+	TextureArray& operator=(const TextureArray&) = delete;
+
+	// TextureArray Private Data.
+	std::vector<ImageTexture*> layers;
+	GLuint textureObj;
+	size_t sizeInBytes;
+};
+
+#endif
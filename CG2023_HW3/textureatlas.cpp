@@ -0,0 +1,172 @@
+#include "textureatlas.h"
+
+// Pixels of each texture repeated around its cell.
+static const int ATLAS_PADDING = 8;
+// Cell positions and sizes are multiples of this.
+static const int ATLAS_ALIGNMENT = 16;
+// Largest side of an atlas.
+static const int MAX_ATLAS_SIZE = 2048;
+
+// A texture's place in the atlas, padding included.
+struct AtlasCell
+{
+	int index;
+	int width;
+	int height;
+	int x;
+	int y;
+};
+
+static int AlignUp(const int value)
+{
+	return (value + ATLAS_ALIGNMENT - 1) / ATLAS_ALIGNMENT * ATLAS_ALIGNMENT;
+}
+
+// Place the cells (tallest first) on shelves of the given width; returns the height used.
+static int PackShelves(std::vector<AtlasCell>& cells, const int atlasWidth)
+{
+	int x = 0;
+	int y = 0;
+	int shelfHeight = 0;
+	for (auto& cell : cells) {
+		if (x + cell.width > atlasWidth) {
+			x = 0;
+			y += shelfHeight;
+			shelfHeight = 0;
+		}
+		cell.x = x;
+		cell.y = y;
+		x += cell.width;
+		shelfHeight = std::max(shelfHeight, cell.height);
+	}
+	return y + shelfHeight;
+}
+
+// Smallest atlas (by area, then by its longer side) the cells fit into; false if they do not fit.
+static bool PackCells(std::vector<AtlasCell>& cells, int& atlasWidth, int& atlasHeight)
+{
+	int widest = 0;
+	for (const auto& cell : cells)
+		widest = std::max(widest, cell.width);
+	int bestWidth = 0;
+	int bestHeight = 0;
+	for (int width = widest; width <= MAX_ATLAS_SIZE; width += ATLAS_ALIGNMENT) {
+		const int height = PackShelves(cells, width);
+		if (height > MAX_ATLAS_SIZE)
+			continue;
+		const long long area = (long long)width * height;
+		const long long bestArea = (long long)bestWidth * bestHeight;
+		if (bestWidth == 0 || area < bestArea || (area == bestArea && std::max(width, height) < std::max(bestWidth, bestHeight))) {
+			bestWidth = width;
+			bestHeight = height;
+		}
+	}
+	if (bestWidth == 0)
+		return false;
+	atlasWidth = bestWidth;
+	atlasHeight = bestHeight;
+	PackShelves(cells, atlasWidth);
+	return true;
+}
+
+bool TextureAtlas::IsCandidate(const ImageTexture* texture, const int maxTextureSize)
+{
+	return texture->IsValid() && texture->GetWidth() <= maxTextureSize && texture->GetHeight() <= maxTextureSize;
+}
+
+// Path the MipCache of an atlas is named after: the folder of its first member and a hash of
+// all member paths, in packing order.
+static std::string GetCacheKeyPath(const std::vector<std::string>& memberPaths)
+{
+	unsigned long long hash = 1469598103934665603ull;
+	for (const auto& path : memberPaths) {
+		for (const char c : path + "\n") {
+			hash ^= (unsigned char)c;
+			hash *= 1099511628211ull;
+		}
+	}
+	std::ostringstream name;
+	name << "atlas-" << std::hex << std::setw(16) << std::setfill('0') << hash;
+	const std::string& first = memberPaths[0];
+	return first.substr(0, first.find_last_of('/') + 1) + name.str();
+}
+
+std::shared_ptr<ImageTexture> TextureAtlas::Build(const std::vector<ImageTexture*>& textures, std::vector<glm::vec4>& regions)
+{
+	const int numChannels = 3;
+	const TextureDecodeOptions options = ImageTexture::GetDecodeOptions();
+	// Textures whose images could not be read again; the rest are packed anew without them.
+	std::vector<bool> unreadable(textures.size(), false);
+	for (;;) {
+		regions.assign(textures.size(), glm::vec4(0.0f));
+		std::vector<AtlasCell> cells;
+		for (size_t i = 0; i < textures.size(); i++) {
+			if (unreadable[i])
+				continue;
+			AtlasCell cell;
+			cell.index = (int)i;
+			cell.width = AlignUp(textures[i]->GetWidth() + 2 * ATLAS_PADDING);
+			cell.height = AlignUp(textures[i]->GetHeight() + 2 * ATLAS_PADDING);
+			cell.x = 0;
+			cell.y = 0;
+			cells.push_back(cell);
+		}
+		std::stable_sort(cells.begin(), cells.end(), [](const AtlasCell& a, const AtlasCell& b) { return a.height > b.height; });
+		// Leave out the smallest textures until the rest fit.
+		int atlasWidth = 0;
+		int atlasHeight = 0;
+		while (cells.size() >= 2 && !PackCells(cells, atlasWidth, atlasHeight))
+			cells.pop_back();
+		if (cells.size() < 2)
+			return nullptr;
+
+		std::vector<std::string> memberPaths;
+		for (const auto& cell : cells) {
+			const ImageTexture* texture = textures[cell.index];
+			memberPaths.push_back(texture->GetPath());
+			regions[cell.index] = glm::vec4((float)(cell.x + ATLAS_PADDING) / atlasWidth, (float)(cell.y + ATLAS_PADDING) / atlasHeight,
+											(float)texture->GetWidth() / atlasWidth, (float)texture->GetHeight() / atlasHeight);
+		}
+		const std::string keyPath = GetCacheKeyPath(memberPaths);
+		const std::string name = keyPath.substr(0, keyPath.find_last_of('/') + 1) + "[atlas of " + std::to_string(cells.size()) + " textures]";
+		DecodedTexture texture;
+		if (ImageTexture::LoadCachedLevels(keyPath, options, texture, memberPaths))
+			return std::make_shared<ImageTexture>(name, std::move(texture));
+
+		// The pixels as they are in the files; the textures themselves may be compressed or released.
+		std::vector<TextureLevel> images(textures.size());
+		bool complete = true;
+		for (size_t c = 0; c < cells.size(); c++) {
+			const AtlasCell& cell = cells[c];
+			TextureLevel& image = images[cell.index];
+			if (!ImageTexture::ReadImage(memberPaths[c], image) ||
+				image.width != textures[cell.index]->GetWidth() || image.height != textures[cell.index]->GetHeight()) {
+				unreadable[cell.index] = true;
+				complete = false;
+			}
+		}
+		if (!complete)
+			continue;
+
+		// Fill each cell with its texture, wrapped around into the padding.
+		TextureLevel atlas;
+		atlas.width = atlasWidth;
+		atlas.height = atlasHeight;
+		atlas.data.assign((size_t)atlasWidth * atlasHeight * numChannels, 0);
+		for (const auto& cell : cells) {
+			const TextureLevel& image = images[cell.index];
+			for (int y = 0; y < cell.height; y++) {
+				const int sourceY = ((y - ATLAS_PADDING) % image.height + image.height) % image.height;
+				const unsigned char* source = image.data.data() + (size_t)sourceY * image.width * numChannels;
+				unsigned char* target = atlas.data.data() + ((size_t)(cell.y + y) * atlasWidth + cell.x) * numChannels;
+				for (int x = 0; x < cell.width; x++) {
+					const int sourceX = ((x - ATLAS_PADDING) % image.width + image.width) % image.width;
+					std::memcpy(target + (size_t)x * numChannels, source + (size_t)sourceX * numChannels, numChannels);
+				}
+			}
+		}
+		if (!ImageTexture::BuildLevels(keyPath, std::move(atlas), numChannels, options, texture, memberPaths))
+			return nullptr;
+		return std::make_shared<ImageTexture>(name, std::move(texture));
+	}
+}
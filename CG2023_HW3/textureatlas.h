@@ -0,0 +1,33 @@
+#ifndef TEXTURE_ATLAS_H
+#define TEXTURE_ATLAS_H
+
+#include "headers.h"
+#include "imagetexture.h"
+
+// TextureAtlas Declarations.
+// Packs small textures (eyes, irises, ...) into one shared texture, so the materials that use
+// them need a single texture object, mip chain and binding. Each texture gets a cell of the
+// atlas with a border of its own pixels wrapped around (so repeating and bilinear filtering at
+// the edges see the right neighbours, and the first mip levels do not bleed into other cells);
+// cells are aligned to 16 pixels, which keeps them on whole blocks of compressed levels and
+// within the same pixels down to level 4. A material then samples its region of the atlas:
+// texcoords are wrapped into [0, 1) and mapped to offset + texcoord * scale in the shader.
+class TextureAtlas
+{
+public:
+	// Textures with no side larger than this are packed by default.
+	static const int DEFAULT_MAX_TEXTURE_SIZE = 256;
+
+	// True if a texture is small enough for an atlas.
+	static bool IsCandidate(const ImageTexture* texture, const int maxTextureSize);
+
+	// Pack textures into a new atlas with the current decode options. The layout only depends on
+	// the texture sizes; the mip chain comes from a MipCache file next to the first member that
+	// is current while all members are, or else from the images read again from their files
+	// (and is then written there). Runs on any thread. regions gets one entry per texture:
+	// offset (xy) and scale (zw) of its part of the atlas, or (0, 0, 0, 0) if it was left out
+	// (unreadable, or no room). Returns nullptr if fewer than two textures could be packed.
+	static std::shared_ptr<ImageTexture> Build(const std::vector<ImageTexture*>& textures, std::vector<glm::vec4>& regions);
+};
+
+#endif
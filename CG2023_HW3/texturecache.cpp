@@ -0,0 +1,259 @@
+#include "texturecache.h"
+#include "mappedfile.h"
+
+// One cached texture.
+struct TextureCacheEntry
+{
+	std::shared_ptr<ImageTexture> texture;
+	unsigned long long contentHash;
+	unsigned long long lastUse;
+};
+
+// TextureCache Private Data.
+static std::mutex cacheMutex;
+// Canonical path -> texture; several paths may share one texture through the content hash.
+static std::unordered_map<std::string, TextureCacheEntry> entries;
+static std::unordered_map<unsigned long long, std::string> contentIndex;
+static size_t residentBudget = 256 * 1024 * 1024;
+static bool matchContent = true;
+static unsigned long long useCounter = 0;
+static unsigned long long numHits = 0;
+static unsigned long long numMisses = 0;
+
+ThreadPool& TextureCache::GetDecodePool()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+// Key of a path: the same file reached through "..", "./" or another spelling maps to one key.
+static std::string CanonicalizePath(const std::string& filePath)
+{
+	std::error_code error;
+	std::filesystem::path path = std::filesystem::weakly_canonical(std::filesystem::path(filePath), error);
+	std::string key = error ? std::filesystem::path(filePath).lexically_normal().generic_string() : path.generic_string();
+#ifdef _WIN32
+	// Windows paths are case-insensitive.
+	std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+#endif
+	return key;
+}
+
+// FNV-1a hash of the file contents (0 if the file cannot be read).
+static unsigned long long HashFileContents(const std::string& filePath)
+{
+	MappedFile file;
+	if (!file.Open(filePath) || file.GetSize() == 0)
+		return 0;
+	unsigned long long hash = 1469598103934665603ull ^ (unsigned long long)file.GetSize();
+	const unsigned char* data = (const unsigned char*)file.GetData();
+	for (size_t i = 0; i < file.GetSize(); i++) {
+		hash ^= data[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+std::shared_ptr<ImageTexture> TextureCache::Acquire(const std::string& filePath)
+{
+	const std::string key = CanonicalizePath(filePath);
+	{
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		auto found = entries.find(key);
+		if (found != entries.end()) {
+			found->second.lastUse = ++useCounter;
+			numHits++;
+			return found->second.texture;
+		}
+	}
+
+	// Hash and decode without holding the lock, so several loader threads can work at once.
+	const unsigned long long contentHash = matchContent ? HashFileContents(filePath) : 0;
+	if (contentHash != 0) {
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		auto sameContent = contentIndex.find(contentHash);
+		if (sameContent != contentIndex.end()) {
+			TextureCacheEntry entry = entries[sameContent->second];
+			entry.lastUse = ++useCounter;
+			entries[key] = entry;
+			numHits++;
+			return entry.texture;
+		}
+	}
+
+	std::shared_ptr<ImageTexture> texture;
+	{
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		// Another thread may have added the same file in the meantime; keep the first copy.
+		auto found = entries.find(key);
+		if (found != entries.end()) {
+			found->second.lastUse = ++useCounter;
+			return found->second.texture;
+		}
+		texture = std::make_shared<ImageTexture>(filePath, false);
+		TextureCacheEntry entry;
+		entry.texture = texture;
+		entry.contentHash = contentHash;
+		entry.lastUse = ++useCounter;
+		entries[key] = entry;
+		if (contentHash != 0)
+			contentIndex.emplace(contentHash, key);
+		numMisses++;
+	}
+
+	// Decode on the pool; whoever needs the pixels first calls Decode() and waits (or decodes
+	// it right there if no worker got to it yet). A texture dropped before that is skipped.
+	std::weak_ptr<ImageTexture> pending = texture;
+	GetDecodePool().Submit([pending]() {
+		if (std::shared_ptr<ImageTexture> texture = pending.lock())
+			texture->Decode();
+	});
+	return texture;
+}
+
+// Textures only the cache still refers to (once per path they are cached under),
+// with the last time any of their paths was acquired. Call with the lock held.
+static std::unordered_map<const ImageTexture*, unsigned long long> FindUnusedTextures()
+{
+	struct Usage { size_t numKeys; long useCount; unsigned long long lastUse; };
+	std::unordered_map<const ImageTexture*, Usage> usages;
+	for (const auto& entry : entries) {
+		Usage& usage = usages.emplace(entry.second.texture.get(), Usage{ 0, 0, 0 }).first->second;
+		usage.numKeys++;
+		usage.useCount = entry.second.texture.use_count();
+		usage.lastUse = std::max(usage.lastUse, entry.second.lastUse);
+	}
+	std::unordered_map<const ImageTexture*, unsigned long long> unused;
+	for (const auto& usage : usages) {
+		if ((size_t)usage.second.useCount == usage.second.numKeys)
+			unused.emplace(usage.first, usage.second.lastUse);
+	}
+	return unused;
+}
+
+// Remove the entries of the given textures, handing their handles to released. Call with the lock held.
+static void EraseEntries(const std::unordered_map<const ImageTexture*, bool>& evict, std::vector<std::shared_ptr<ImageTexture>>& released)
+{
+	for (auto it = entries.begin(); it != entries.end();) {
+		if (evict.count(it->second.texture.get()) == 0) {
+			++it;
+			continue;
+		}
+		if (it->second.contentHash != 0)
+			contentIndex.erase(it->second.contentHash);
+		released.push_back(std::move(it->second.texture));
+		it = entries.erase(it);
+	}
+}
+
+void TextureCache::Trim()
+{
+	std::vector<std::shared_ptr<ImageTexture>> released;
+	{
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		std::vector<std::pair<unsigned long long, const ImageTexture*>> unused;
+		size_t unusedBytes = 0;
+		std::unordered_map<const ImageTexture*, bool> evict;
+		for (const auto& texture : FindUnusedTextures()) {
+			// Images that failed to decode are dropped, so a fixed file is read again.
+			if (texture.first->IsDecoded() && !texture.first->IsValid()) {
+				evict[texture.first] = true;
+				continue;
+			}
+			unused.push_back(std::make_pair(texture.second, texture.first));
+			// Host pixels are freed after upload, so the GL memory is most of what a texture holds.
+			unusedBytes += texture.first->GetSizeInBytes() + texture.first->GetGpuSizeInBytes();
+		}
+		std::sort(unused.begin(), unused.end());
+
+		for (const auto& candidate : unused) {
+			if (unusedBytes <= residentBudget)
+				break;
+			unusedBytes -= candidate.second->GetSizeInBytes() + candidate.second->GetGpuSizeInBytes();
+			evict[candidate.second] = true;
+		}
+		EraseEntries(evict, released);
+	}
+	// The textures (and their GL objects) are freed here, outside the lock.
+}
+
+void TextureCache::ReleaseUnusedPixels(const std::vector<std::weak_ptr<ImageTexture>>& textures)
+{
+	// Under the lock, so no Acquire() hands the texture out while its levels go. The handles are
+	// only locked after the usage counts are taken, so they do not count as a use themselves.
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	const auto unused = FindUnusedTextures();
+	for (const auto& handle : textures) {
+		const std::shared_ptr<ImageTexture> texture = handle.lock();
+		if (texture != nullptr && unused.count(texture.get()) != 0)
+			texture->ReleaseDecodedLevels();
+	}
+}
+
+size_t TextureCache::EvictUnused(const size_t bytes)
+{
+	std::vector<std::shared_ptr<ImageTexture>> released;
+	std::unordered_map<const ImageTexture*, bool> evict;
+	{
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		std::vector<std::pair<unsigned long long, const ImageTexture*>> unused;
+		for (const auto& texture : FindUnusedTextures())
+			unused.push_back(std::make_pair(texture.second, texture.first));
+		std::sort(unused.begin(), unused.end());
+
+		size_t freedBytes = 0;
+		for (const auto& candidate : unused) {
+			if (freedBytes >= bytes)
+				break;
+			freedBytes += candidate.second->GetSizeInBytes() + candidate.second->GetGpuSizeInBytes();
+			evict[candidate.second] = true;
+		}
+		EraseEntries(evict, released);
+	}
+	return evict.size();
+}
+
+void TextureCache::Clear()
+{
+	std::unordered_map<std::string, TextureCacheEntry> released;
+	{
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		released.swap(entries);
+		contentIndex.clear();
+	}
+}
+
+void TextureCache::SetResidentBudget(const size_t bytes)
+{
+	{
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		residentBudget = bytes;
+	}
+	Trim();
+}
+
+void TextureCache::SetMatchContent(const bool match)
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	matchContent = match;
+}
+
+TextureCacheStats TextureCache::GetStats()
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	TextureCacheStats stats = {};
+	std::unordered_map<const ImageTexture*, bool> counted;
+	for (const auto& entry : entries) {
+		if (counted.emplace(entry.second.texture.get(), true).second) {
+			stats.numTextures++;
+			stats.totalBytes += entry.second.texture->GetSizeInBytes();
+		}
+	}
+	for (const auto& texture : FindUnusedTextures()) {
+		stats.numUnused++;
+		stats.unusedBytes += texture.first->GetSizeInBytes();
+	}
+	stats.numHits = numHits;
+	stats.numMisses = numMisses;
+	return stats;
+}
@@ -0,0 +1,62 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include "headers.h"
+#include "imagetexture.h"
+#include "threadpool.h"
+
+// Process-wide cache of decoded textures, shared by all materials.
+// Textures are keyed by their canonical path, and also by a hash of the file contents so
+// identical files under different names are decoded once. Materials hold shared handles;
+// a texture nobody uses any more stays resident (decoded and on the GPU) while it fits in
+// the resident budget, so switching back to a model does not decode it again. Trim() drops
+// the least recently used of those once the budget is exceeded.
+// Acquire() may be called from loader threads; Trim(), ReleaseUnusedPixels() and Clear() belong
+// on the GL thread, because dropping the last handle deletes the GL texture and releasing pixels
+// depends on the GL state of the texture.
+
+// TextureCacheStats Declarations.
+struct TextureCacheStats
+{
+	size_t numTextures;
+	size_t numUnused;
+	size_t totalBytes;
+	size_t unusedBytes;
+	unsigned long long numHits;
+	unsigned long long numMisses;
+};
+
+// TextureCache Declarations.
+class TextureCache
+{
+public:
+	// Shared texture of an image file. A new image is decoded on a pool of worker threads;
+	// call ImageTexture::Decode() to wait for it, and IsValid() to see whether it loaded.
+	static std::shared_ptr<ImageTexture> Acquire(const std::string& filePath);
+
+	// Free unused textures, least recently used first, until their host and GPU memory fits in
+	// the resident budget.
+	static void Trim();
+	// Free unused textures, least recently used first, until at least bytes of host and GPU
+	// memory are released (for TextureResidency); returns how many were freed.
+	static size_t EvictUnused(const size_t bytes);
+	// Free the host pixels of those of textures that no material uses and that are not on the
+	// GPU (e.g. the ones a TextureAtlas replaced); they are decoded again, from their MipCache,
+	// when a material needs them.
+	// Textures that are gone already are skipped.
+	static void ReleaseUnusedPixels(const std::vector<std::weak_ptr<ImageTexture>>& textures);
+	// Drop every cached handle (before the GL context goes away).
+	static void Clear();
+
+	// Host and GPU bytes of unused textures to keep for later reuse (default 256 MB; 0 = none).
+	static void SetResidentBudget(const size_t bytes);
+	// Also match files by content hash (on by default).
+	static void SetMatchContent(const bool match);
+
+	static TextureCacheStats GetStats();
+
+	// Workers that decode the images; created on first use.
+	static ThreadPool& GetDecodePool();
+};
+
+#endif
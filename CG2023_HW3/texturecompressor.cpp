@@ -0,0 +1,455 @@
+#include "texturecompressor.h"
+
+// BC7 interpolation weights for 4-bit indices (out of 64).
+static const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+GLenum GetBlockFormatGL(const BlockFormat format)
+{
+	switch (format) {
+	case BLOCK_FORMAT_BC1:
+		return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case BLOCK_FORMAT_BC3:
+		return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	default:
+		return GL_COMPRESSED_RGBA_BPTC_UNORM;
+	}
+}
+
+bool GetBlockFormat(const GLenum internalFormat, BlockFormat& format)
+{
+	switch (internalFormat) {
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+		format = BLOCK_FORMAT_BC1;
+		return true;
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		format = BLOCK_FORMAT_BC3;
+		return true;
+	case GL_COMPRESSED_RGBA_BPTC_UNORM:
+		format = BLOCK_FORMAT_BC7;
+		return true;
+	default:
+		return false;
+	}
+}
+
+size_t GetCompressedSize(const BlockFormat format, const int width, const int height)
+{
+	const size_t blockBytes = (format == BLOCK_FORMAT_BC1) ? 8 : 16;
+	return (size_t)((width + 3) / 4) * (size_t)((height + 3) / 4) * blockBytes;
+}
+
+// Endpoint search.
+
+// Principal axis of the points' covariance by power iteration (zero if they are all equal).
+static glm::vec4 GetPrincipalAxis(const glm::vec4 points[16], const glm::vec4& mean)
+{
+	glm::mat4 covariance(0.0f);
+	for (int i = 0; i < 16; i++) {
+		const glm::vec4 d = points[i] - mean;
+		covariance += glm::outerProduct(d, d);
+	}
+	// Start from the column of the channel with the largest variance, which is never
+	// orthogonal to the principal axis.
+	int largest = 0;
+	for (int c = 1; c < 4; c++) {
+		if (covariance[c][c] > covariance[largest][largest])
+			largest = c;
+	}
+	glm::vec4 axis = covariance[largest];
+	for (int iteration = 0; iteration < 8; iteration++) {
+		const float length = glm::length(axis);
+		if (length < 1e-6f)
+			return glm::vec4(0.0f);
+		axis = covariance * (axis / length);
+	}
+	const float length = glm::length(axis);
+	return (length < 1e-6f) ? glm::vec4(0.0f) : axis / length;
+}
+
+// Two endpoints that span the points (0..255 per channel).
+static void FindEndpoints(const glm::vec4 points[16], const CompressionQuality quality, glm::vec4& e0, glm::vec4& e1)
+{
+	glm::vec4 mean(0.0f);
+	glm::vec4 minimum(255.0f);
+	glm::vec4 maximum(0.0f);
+	for (int i = 0; i < 16; i++) {
+		mean += points[i];
+		minimum = glm::min(minimum, points[i]);
+		maximum = glm::max(maximum, points[i]);
+	}
+	mean /= 16.0f;
+
+	if (quality == COMPRESSION_FAST) {
+		// Bounding box diagonal; channels that fall while the widest one rises are flipped.
+		const glm::vec4 extent = maximum - minimum;
+		int widest = 0;
+		for (int c = 1; c < 4; c++) {
+			if (extent[c] > extent[widest])
+				widest = c;
+		}
+		e0 = maximum;
+		e1 = minimum;
+		for (int c = 0; c < 4; c++) {
+			float covariance = 0.0f;
+			for (int i = 0; i < 16; i++)
+				covariance += (points[i][widest] - mean[widest]) * (points[i][c] - mean[c]);
+			if (covariance < 0.0f)
+				std::swap(e0[c], e1[c]);
+		}
+		return;
+	}
+
+	const glm::vec4 axis = GetPrincipalAxis(points, mean);
+	float minT = 0.0f;
+	float maxT = 0.0f;
+	for (int i = 0; i < 16; i++) {
+		const float t = glm::dot(points[i] - mean, axis);
+		minT = std::min(minT, t);
+		maxT = std::max(maxT, t);
+	}
+	e0 = glm::clamp(mean + axis * maxT, 0.0f, 255.0f);
+	e1 = glm::clamp(mean + axis * minT, 0.0f, 255.0f);
+}
+
+// Endpoints that minimize the squared error of points[i] ~ lerp(e0, e1, weights[i]).
+// Returns false if the weights do not determine them (e.g. all pixels use one endpoint).
+static bool SolveEndpoints(const glm::vec4 points[16], const float weights[16], glm::vec4& e0, glm::vec4& e1)
+{
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+	glm::vec4 ax(0.0f), bx(0.0f);
+	for (int i = 0; i < 16; i++) {
+		const float b = weights[i];
+		const float a = 1.0f - b;
+		aa += a * a;
+		ab += a * b;
+		bb += b * b;
+		ax += a * points[i];
+		bx += b * points[i];
+	}
+	const float det = aa * bb - ab * ab;
+	if (std::fabs(det) < 1e-6f)
+		return false;
+	e0 = glm::clamp((ax * bb - bx * ab) / det, 0.0f, 255.0f);
+	e1 = glm::clamp((bx * aa - ax * ab) / det, 0.0f, 255.0f);
+	return true;
+}
+
+static float SquaredDistance(const glm::vec4& a, const glm::vec4& b)
+{
+	const glm::vec4 d = a - b;
+	return glm::dot(d, d);
+}
+
+// BC1 color block.
+
+static unsigned short PackColor565(const glm::vec4& color)
+{
+	const int r = (int)std::lround(color.r * 31.0f / 255.0f);
+	const int g = (int)std::lround(color.g * 63.0f / 255.0f);
+	const int b = (int)std::lround(color.b * 31.0f / 255.0f);
+	return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+static glm::vec4 UnpackColor565(const unsigned short packed)
+{
+	const int r = (packed >> 11) & 31;
+	const int g = (packed >> 5) & 63;
+	const int b = packed & 31;
+	return glm::vec4((float)((r << 3) | (r >> 2)), (float)((g << 2) | (g >> 4)), (float)((b << 3) | (b >> 2)), 0.0f);
+}
+
+// Weight of color1 for each BC1 index in four-color mode.
+static const float BC1_WEIGHTS[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+// Order the endpoints for four-color mode and pick each pixel's index; returns the squared error.
+static float ChooseColorIndices(const glm::vec4 points[16], unsigned short& color0, unsigned short& color1, unsigned char indices[16])
+{
+	if (color0 < color1)
+		std::swap(color0, color1);
+	const glm::vec4 c0 = UnpackColor565(color0);
+	const glm::vec4 c1 = UnpackColor565(color1);
+	glm::vec4 palette[4];
+	const int numColors = (color0 == color1) ? 1 : 4;  // Equal endpoints would select three-color mode
+	for (int k = 0; k < 4; k++)
+		palette[k] = glm::mix(c0, c1, BC1_WEIGHTS[k]);
+
+	float error = 0.0f;
+	for (int i = 0; i < 16; i++) {
+		int best = 0;
+		float bestDistance = SquaredDistance(points[i], palette[0]);
+		for (int k = 1; k < numColors; k++) {
+			const float distance = SquaredDistance(points[i], palette[k]);
+			if (distance < bestDistance) {
+				bestDistance = distance;
+				best = k;
+			}
+		}
+		indices[i] = (unsigned char)best;
+		error += bestDistance;
+	}
+	return error;
+}
+
+// points hold RGB with alpha 0.
+static void CompressColorBlock(const glm::vec4 points[16], const CompressionQuality quality, unsigned char* output)
+{
+	glm::vec4 e0, e1;
+	FindEndpoints(points, quality, e0, e1);
+	unsigned short color0 = PackColor565(e0);
+	unsigned short color1 = PackColor565(e1);
+	unsigned char indices[16];
+	float error = ChooseColorIndices(points, color0, color1, indices);
+
+	if (quality == COMPRESSION_HIGH) {
+		for (int iteration = 0; iteration < 2 && error > 0.0f; iteration++) {
+			float weights[16];
+			for (int i = 0; i < 16; i++)
+				weights[i] = BC1_WEIGHTS[indices[i]];
+			if (!SolveEndpoints(points, weights, e0, e1))
+				break;
+			unsigned short refined0 = PackColor565(e0);
+			unsigned short refined1 = PackColor565(e1);
+			unsigned char refinedIndices[16];
+			const float refinedError = ChooseColorIndices(points, refined0, refined1, refinedIndices);
+			if (refinedError >= error)
+				break;
+			error = refinedError;
+			color0 = refined0;
+			color1 = refined1;
+			std::memcpy(indices, refinedIndices, sizeof(indices));
+		}
+	}
+
+	unsigned int bits = 0;
+	for (int i = 0; i < 16; i++)
+		bits |= (unsigned int)indices[i] << (2 * i);
+	output[0] = (unsigned char)(color0 & 0xFF);
+	output[1] = (unsigned char)(color0 >> 8);
+	output[2] = (unsigned char)(color1 & 0xFF);
+	output[3] = (unsigned char)(color1 >> 8);
+	for (int i = 0; i < 4; i++)
+		output[4 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+// BC3 alpha block.
+
+// Eight-value mode between the block's extreme alphas, which are always exact.
+static void CompressAlphaBlock(const unsigned char rgba[64], unsigned char* output)
+{
+	int alpha0 = 0;
+	int alpha1 = 255;
+	for (int i = 0; i < 16; i++) {
+		alpha0 = std::max(alpha0, (int)rgba[4 * i + 3]);
+		alpha1 = std::min(alpha1, (int)rgba[4 * i + 3]);
+	}
+	output[0] = (unsigned char)alpha0;
+	output[1] = (unsigned char)alpha1;
+
+	unsigned long long bits = 0;
+	if (alpha0 > alpha1) {
+		int palette[8];
+		palette[0] = alpha0;
+		palette[1] = alpha1;
+		for (int k = 2; k < 8; k++)
+			palette[k] = ((8 - k) * alpha0 + (k - 1) * alpha1) / 7;
+		for (int i = 0; i < 16; i++) {
+			const int alpha = rgba[4 * i + 3];
+			int best = 0;
+			for (int k = 1; k < 8; k++) {
+				if (std::abs(palette[k] - alpha) < std::abs(palette[best] - alpha))
+					best = k;
+			}
+			bits |= (unsigned long long)best << (3 * i);
+		}
+	}
+	for (int i = 0; i < 6; i++)
+		output[2 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+// BC7 mode 6.
+
+// Quantize an endpoint to 7 bits per channel plus the p-bit that fits it best.
+// Opaque endpoints always take p = 1, so opaque images stay exactly opaque.
+static void QuantizeEndpointBC7(const glm::vec4& endpoint, int quantized[4], int& pBit)
+{
+	float bestError = std::numeric_limits<float>::max();
+	for (int p = (endpoint.a >= 255.0f) ? 1 : 0; p < 2; p++) {
+		int candidate[4];
+		float error = 0.0f;
+		for (int c = 0; c < 4; c++) {
+			candidate[c] = glm::clamp((int)std::lround((endpoint[c] - p) / 2.0f), 0, 127);
+			const float d = (float)(candidate[c] * 2 + p) - endpoint[c];
+			error += d * d;
+		}
+		if (error < bestError) {
+			bestError = error;
+			pBit = p;
+			std::memcpy(quantized, candidate, sizeof(candidate));
+		}
+	}
+}
+
+static glm::ivec4 DequantizeEndpointBC7(const int quantized[4], const int pBit)
+{
+	return glm::ivec4(quantized[0] * 2 + pBit, quantized[1] * 2 + pBit, quantized[2] * 2 + pBit, quantized[3] * 2 + pBit);
+}
+
+static float ChooseIndicesBC7(const glm::vec4 points[16], const glm::ivec4& e0, const glm::ivec4& e1, unsigned char indices[16])
+{
+	glm::vec4 palette[16];
+	for (int k = 0; k < 16; k++)
+		palette[k] = glm::vec4((e0 * (64 - BC7_WEIGHTS[k]) + e1 * BC7_WEIGHTS[k] + 32) >> 6);
+
+	float error = 0.0f;
+	for (int i = 0; i < 16; i++) {
+		int best = 0;
+		float bestDistance = SquaredDistance(points[i], palette[0]);
+		for (int k = 1; k < 16; k++) {
+			const float distance = SquaredDistance(points[i], palette[k]);
+			if (distance < bestDistance) {
+				bestDistance = distance;
+				best = k;
+			}
+		}
+		indices[i] = (unsigned char)best;
+		error += bestDistance;
+	}
+	return error;
+}
+
+// Writes a block LSB first, as BC7 is laid out.
+class BlockBitWriter
+{
+public:
+	explicit BlockBitWriter(unsigned char* block) : data(block), position(0) { std::memset(data, 0, 16); }
+
+	void Write(const unsigned int value, const int numBits) {
+		for (int bit = 0; bit < numBits; bit++, position++) {
+			if ((value >> bit) & 1)
+				data[position >> 3] |= (unsigned char)(1 << (position & 7));
+		}
+	}
+
+private:
+	unsigned char* data;
+	int position;
+};
+
+static void CompressBlockBC7(const glm::vec4 points[16], const CompressionQuality quality, unsigned char* output)
+{
+	glm::vec4 e0, e1;
+	FindEndpoints(points, quality, e0, e1);
+	int q0[4], q1[4];
+	int p0 = 0, p1 = 0;
+	QuantizeEndpointBC7(e0, q0, p0);
+	QuantizeEndpointBC7(e1, q1, p1);
+	unsigned char indices[16];
+	float error = ChooseIndicesBC7(points, DequantizeEndpointBC7(q0, p0), DequantizeEndpointBC7(q1, p1), indices);
+
+	if (quality == COMPRESSION_HIGH) {
+		for (int iteration = 0; iteration < 2 && error > 0.0f; iteration++) {
+			float weights[16];
+			for (int i = 0; i < 16; i++)
+				weights[i] = BC7_WEIGHTS[indices[i]] / 64.0f;
+			if (!SolveEndpoints(points, weights, e0, e1))
+				break;
+			int r0[4], r1[4];
+			int rp0 = 0, rp1 = 0;
+			QuantizeEndpointBC7(e0, r0, rp0);
+			QuantizeEndpointBC7(e1, r1, rp1);
+			unsigned char refinedIndices[16];
+			const float refinedError = ChooseIndicesBC7(points, DequantizeEndpointBC7(r0, rp0), DequantizeEndpointBC7(r1, rp1), refinedIndices);
+			if (refinedError >= error)
+				break;
+			error = refinedError;
+			std::memcpy(q0, r0, sizeof(q0));
+			std::memcpy(q1, r1, sizeof(q1));
+			p0 = rp0;
+			p1 = rp1;
+			std::memcpy(indices, refinedIndices, sizeof(indices));
+		}
+	}
+
+	// The first pixel's index is stored without its top bit, which must therefore be zero.
+	if (indices[0] >= 8) {
+		for (int c = 0; c < 4; c++)
+			std::swap(q0[c], q1[c]);
+		std::swap(p0, p1);
+		for (int i = 0; i < 16; i++)
+			indices[i] = (unsigned char)(15 - indices[i]);
+	}
+
+	BlockBitWriter writer(output);
+	writer.Write(1 << 6, 7);  // Mode 6
+	for (int c = 0; c < 4; c++) {
+		writer.Write(q0[c], 7);
+		writer.Write(q1[c], 7);
+	}
+	writer.Write(p0, 1);
+	writer.Write(p1, 1);
+	for (int i = 0; i < 16; i++)
+		writer.Write(indices[i], (i == 0) ? 3 : 4);
+}
+
+// Images.
+
+void CompressBlock(const BlockFormat format, const CompressionQuality quality, const unsigned char rgba[64], unsigned char* output)
+{
+	glm::vec4 points[16];
+	for (int i = 0; i < 16; i++)
+		points[i] = glm::vec4(rgba[4 * i], rgba[4 * i + 1], rgba[4 * i + 2], rgba[4 * i + 3]);
+
+	switch (format) {
+	case BLOCK_FORMAT_BC1:
+	case BLOCK_FORMAT_BC3: {
+		unsigned char* colorBlock = output;
+		if (format == BLOCK_FORMAT_BC3) {
+			CompressAlphaBlock(rgba, output);
+			colorBlock = output + 8;
+		}
+		for (int i = 0; i < 16; i++)
+			points[i].a = 0.0f;
+		CompressColorBlock(points, quality, colorBlock);
+		break;
+	}
+	case BLOCK_FORMAT_BC7:
+		CompressBlockBC7(points, quality, output);
+		break;
+	}
+}
+
+std::vector<unsigned char> CompressImage(const BlockFormat format, const CompressionQuality quality, const unsigned char* pixels,
+										 const int width, const int height, const int numChannels, const size_t rowBytes)
+{
+	const size_t blockBytes = (format == BLOCK_FORMAT_BC1) ? 8 : 16;
+	const int numBlocksX = (width + 3) / 4;
+	const int numBlocksY = (height + 3) / 4;
+	std::vector<unsigned char> output(GetCompressedSize(format, width, height));
+
+	unsigned char rgba[64];
+	unsigned char* block = output.data();
+	for (int by = 0; by < numBlocksY; by++) {
+		for (int bx = 0; bx < numBlocksX; bx++) {
+			for (int y = 0; y < 4; y++) {
+				const unsigned char* row = pixels + rowBytes * std::min(by * 4 + y, height - 1);
+				for (int x = 0; x < 4; x++) {
+					const unsigned char* pixel = row + (size_t)numChannels * std::min(bx * 4 + x, width - 1);
+					unsigned char* texel = rgba + 4 * (4 * y + x);
+					if (numChannels >= 3) {
+						texel[0] = pixel[0];
+						texel[1] = pixel[1];
+						texel[2] = pixel[2];
+						texel[3] = (numChannels == 4) ? pixel[3] : 255;
+					}
+					else {
+						texel[0] = texel[1] = texel[2] = pixel[0];
+						texel[3] = 255;
+					}
+				}
+			}
+			CompressBlock(format, quality, rgba, block);
+			block += blockBytes;
+		}
+	}
+	return output;
+}
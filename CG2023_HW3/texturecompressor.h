@@ -0,0 +1,45 @@
+#ifndef TEXTURE_COMPRESSOR_H
+#define TEXTURE_COMPRESSOR_H
+
+#include "headers.h"
+
+// BCn (S3TC / BPTC) texture compression on the CPU.
+// An image is cut into 4x4 blocks that are encoded independently; blocks on the right and
+// top edges repeat the last column / row of the image.
+//   BC1: 8 bytes per block, RGB as two 5:6:5 endpoints and a 2-bit index per pixel.
+//   BC3: 16 bytes, a BC1 color block plus an alpha block (8-bit endpoints, 3-bit indices).
+//   BC7: 16 bytes; only mode 6 is used (one RGBA line with 7-bit endpoints and p-bits,
+//        4-bit indices), which is fast to search and still more accurate than BC1.
+
+enum BlockFormat
+{
+	BLOCK_FORMAT_BC1,
+	BLOCK_FORMAT_BC3,
+	BLOCK_FORMAT_BC7,
+};
+
+// Encoding speed versus quality.
+//   FAST: endpoints from the bounding box of the block's colors.
+//   NORMAL: endpoints along the principal axis of the colors.
+//   HIGH: NORMAL, then refined by least squares over the chosen indices.
+enum CompressionQuality
+{
+	COMPRESSION_FAST,
+	COMPRESSION_NORMAL,
+	COMPRESSION_HIGH,
+};
+
+// OpenGL internal format of a block format.
+GLenum GetBlockFormatGL(const BlockFormat format);
+// Block format of an OpenGL internal format; false if it is not one of ours.
+bool GetBlockFormat(const GLenum internalFormat, BlockFormat& format);
+// Bytes of a width x height image in a block format.
+size_t GetCompressedSize(const BlockFormat format, const int width, const int height);
+
+// Encode 16 RGBA pixels (4 rows of 4, 8 bits per channel) into one block.
+void CompressBlock(const BlockFormat format, const CompressionQuality quality, const unsigned char rgba[64], unsigned char* output);
+// Encode an image with 1, 3 or 4 channels in RGB(A) order; rows are rowBytes apart.
+std::vector<unsigned char> CompressImage(const BlockFormat format, const CompressionQuality quality, const unsigned char* pixels,
+										 const int width, const int height, const int numChannels, const size_t rowBytes);
+
+#endif
@@ -0,0 +1,110 @@
+#include "textureresidency.h"
+#include "texturecache.h"
+
+// Restores wait until the total stays below this fraction of the budget, so a texture is not
+// reduced and restored on alternate frames.
+static const double RESTORE_HEADROOM = 0.9;
+// A reduced texture is restored only if it was bound within this many frames.
+static const unsigned long long RESTORE_RECENT_FRAMES = 2;
+
+// TextureResidency Private Data.
+static std::mutex registryMutex;
+static std::unordered_set<ImageTexture*> textures;
+static std::atomic<size_t> currentBytes(0);
+static std::atomic<size_t> peakBytes(0);
+static size_t budget = 512 * 1024 * 1024;
+static std::atomic<unsigned long long> frame(0);
+static unsigned long long numDroppedLevels = 0;
+static unsigned long long numEvicted = 0;
+static unsigned long long numRestored = 0;
+
+void TextureResidency::Register(ImageTexture* texture)
+{
+	std::lock_guard<std::mutex> lock(registryMutex);
+	textures.insert(texture);
+}
+
+void TextureResidency::Unregister(ImageTexture* texture)
+{
+	std::lock_guard<std::mutex> lock(registryMutex);
+	textures.erase(texture);
+	currentBytes -= texture->trackedBytes;
+}
+
+void TextureResidency::ChangeBytes(const size_t oldBytes, const size_t newBytes)
+{
+	const size_t bytes = (currentBytes += newBytes - oldBytes);
+	size_t peak = peakBytes.load();
+	while (bytes > peak && !peakBytes.compare_exchange_weak(peak, bytes)) {}
+}
+
+unsigned long long TextureResidency::GetFrame()
+{
+	return frame.load(std::memory_order_relaxed);
+}
+
+void TextureResidency::SetBudget(const size_t bytes)
+{
+	budget = bytes;
+}
+
+void TextureResidency::Update(TextureUploader* uploader)
+{
+	const unsigned long long currentFrame = ++frame;
+
+	// Unused textures go first, and entirely. Done without the registry lock: the cache
+	// creates textures (which register) while holding its own lock.
+	if (budget != 0 && currentBytes > budget)
+		numEvicted += TextureCache::EvictUnused(currentBytes - budget);
+
+	std::lock_guard<std::mutex> lock(registryMutex);
+	for (ImageTexture* texture : textures) {
+		if (texture->FinishRestore(uploader))
+			numRestored++;
+	}
+	if (budget == 0)
+		return;
+
+	// Then the largest level of whichever texture was bound longest ago, until the rest fits.
+	while (currentBytes > budget) {
+		ImageTexture* victim = nullptr;
+		for (ImageTexture* texture : textures) {
+			if (texture->CanDropLevel() && (victim == nullptr || texture->lastBoundFrame < victim->lastBoundFrame))
+				victim = texture;
+		}
+		if (victim == nullptr)
+			break;
+		victim->DropTopLevel();
+		numDroppedLevels++;
+	}
+
+	// With room to spare, read back the levels of the reduced texture drawn most recently
+	// (one a frame; the reads run on the decode workers).
+	ImageTexture* candidate = nullptr;
+	for (ImageTexture* texture : textures) {
+		if (texture->lastBoundFrame + RESTORE_RECENT_FRAMES < currentFrame || !texture->CanRestore())
+			continue;
+		if (candidate == nullptr || texture->lastBoundFrame > candidate->lastBoundFrame)
+			candidate = texture;
+	}
+	if (candidate != nullptr && currentBytes + candidate->GetRestoreBytes() <= RESTORE_HEADROOM * budget)
+		candidate->BeginRestore(TextureCache::GetDecodePool());
+}
+
+TextureMemoryStats TextureResidency::GetStats()
+{
+	std::lock_guard<std::mutex> lock(registryMutex);
+	TextureMemoryStats stats = {};
+	stats.currentBytes = currentBytes;
+	stats.peakBytes = peakBytes;
+	stats.budgetBytes = budget;
+	stats.numTextures = textures.size();
+	for (const ImageTexture* texture : textures) {
+		if (texture->GetNumDroppedLevels() > 0)
+			stats.numReduced++;
+	}
+	stats.numDroppedLevels = numDroppedLevels;
+	stats.numEvicted = numEvicted;
+	stats.numRestored = numRestored;
+	return stats;
+}
@@ -0,0 +1,56 @@
+#ifndef TEXTURE_RESIDENCY_H
+#define TEXTURE_RESIDENCY_H
+
+#include "headers.h"
+#include "imagetexture.h"
+
+class TextureUploader;
+
+// Process-wide budget for texture memory.
+// Every ImageTexture (cached or not, e.g. the skybox panorama) reports the host bytes of its
+// mip chain and the GPU bytes of its storage here. Once a frame, Update() brings the total back
+// under the budget: first by freeing unused textures in the TextureCache (they are decoded again,
+// usually from their MipCache file, when acquired), then by dropping the largest level of the
+// texture bound least recently, one level at a time. A reduced texture that is drawn again gets
+// its levels back, read on the decode workers and streamed in, once there is room for them.
+
+// TextureMemoryStats Declarations.
+struct TextureMemoryStats
+{
+	size_t currentBytes;
+	size_t peakBytes;
+	size_t budgetBytes;
+	size_t numTextures;
+	// Textures currently without some of their top levels.
+	size_t numReduced;
+	unsigned long long numDroppedLevels;
+	unsigned long long numEvicted;
+	unsigned long long numRestored;
+};
+
+// TextureResidency Declarations.
+class TextureResidency
+{
+public:
+	// Enforce the budget; called once per frame on the GL thread, after TextureUploader::Update().
+	// Restored levels stream in through uploader (may be nullptr).
+	static void Update(TextureUploader* uploader);
+
+	// Host and GPU bytes of all textures (default 512 MB; 0 = no limit).
+	static void SetBudget(const size_t bytes);
+	static TextureMemoryStats GetStats();
+	// Frames since start; ImageTexture::Bind() records it.
+	static unsigned long long GetFrame();
+
+private:
+	friend class ImageTexture;
+	friend class TextureArray;
+
+	// TextureResidency Private Methods.
+	static void Register(ImageTexture* texture);
+	static void Unregister(ImageTexture* texture);
+	// A texture's bytes changed from oldBytes to newBytes.
+	static void ChangeBytes(const size_t oldBytes, const size_t newBytes);
+};
+
+#endif
@@ -0,0 +1,195 @@
+#include "textureuploader.h"
+
+// Levels are uploaded directly by Enqueue() while they add up to at most this many bytes.
+static const size_t IMMEDIATE_UPLOAD_BYTES = 64 * 1024;
+// GL_TEXTURE_MIN_LOD change per frame while a new level fades in.
+static const float LOD_FADE_PER_FRAME = 0.25f;
+
+TextureUploader::TextureUploader(const int numBuffers, const size_t bufferSize, const size_t bytesPerFrame)
+	: bytesPerFrame(bytesPerFrame)
+{
+	pendingBytes = 0;
+	inFlightBytes = 0;
+	for (int i = 0; i < std::max(numBuffers, 1); i++) {
+		Slot slot;
+		glGenBuffers(1, &slot.pbo);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, bufferSize, nullptr, GL_STREAM_DRAW);
+		slot.capacity = bufferSize;
+		slot.fence = 0;
+		slot.texture = nullptr;
+		slot.numBytes = 0;
+		slot.completedLevel = -1;
+		slots.push_back(slot);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+TextureUploader::~TextureUploader()
+{
+	for (auto& slot : slots) {
+		if (slot.texture != nullptr)
+			slot.texture->uploader = nullptr;
+		if (slot.fence != 0)
+			glDeleteSync(slot.fence);
+		glDeleteBuffers(1, &slot.pbo);
+	}
+	for (ImageTexture* texture : queue)
+		texture->uploader = nullptr;
+	for (ImageTexture* texture : fadingTextures)
+		texture->uploader = nullptr;
+}
+
+bool TextureUploader::IsSupported()
+{
+	return (GLEW_VERSION_3_2 || GLEW_ARB_sync) && (GLEW_VERSION_2_1 || GLEW_ARB_pixel_buffer_object);
+}
+
+bool TextureUploader::Enqueue(ImageTexture* texture)
+{
+	// Done already (if perhaps reduced by TextureResidency since), or queued.
+	if ((texture->IsUploaded() && texture->uploadLevel < 0) || texture->uploader == this)
+		return true;
+	if (!texture->IsValid())
+		return false;
+	if (!texture->BeginUpload())
+		return false;
+
+	// The smallest levels (at least the 1x1 one) go up now, so the texture can be drawn this frame.
+	size_t immediateBytes = 0;
+	while (texture->uploadLevel >= 0 && texture->numUploadedRows == 0) {
+		const int level = texture->uploadLevel;
+		const TextureLevel& data = texture->levels[level];
+		if (level < texture->numLevels - 1 && immediateBytes + data.data.size() > IMMEDIATE_UPLOAD_BYTES)
+			break;
+		texture->UploadRows(level, 0, texture->GetNumRows(level), data.data.data());
+		immediateBytes += data.data.size();
+		texture->ReleaseLevelPixels(level);
+		texture->uploadLevel--;
+	}
+	texture->SetResidentBaseLevel(texture->uploadLevel + 1, false);
+	if (texture->uploadLevel < 0)
+		return true;
+
+	texture->uploader = this;
+	queue.push_back(texture);
+	pendingBytes += texture->GetPendingUploadBytes();
+	return true;
+}
+
+void TextureUploader::Remove(ImageTexture* texture)
+{
+	for (auto& slot : slots) {
+		if (slot.texture == texture)
+			slot.texture = nullptr;  // The slot is still recycled once its fence signals.
+	}
+	auto found = std::find(queue.begin(), queue.end(), texture);
+	if (found != queue.end()) {
+		pendingBytes -= texture->GetPendingUploadBytes();
+		queue.erase(found);
+	}
+	fadingTextures.erase(std::remove(fadingTextures.begin(), fadingTextures.end(), texture), fadingTextures.end());
+	texture->uploader = nullptr;
+}
+
+void TextureUploader::Update()
+{
+	RetireFinishedTransfers();
+
+	for (auto it = fadingTextures.begin(); it != fadingTextures.end();) {
+		ImageTexture* texture = *it;
+		if (texture->FadeInLevel(LOD_FADE_PER_FRAME)) {
+			++it;
+			continue;
+		}
+		// Fully resident and faded in: the texture is done.
+		if (texture->IsFullyResident() && std::find(queue.begin(), queue.end(), texture) == queue.end())
+			texture->uploader = nullptr;
+		it = fadingTextures.erase(it);
+	}
+
+	size_t bytesStarted = 0;
+	for (auto& slot : slots) {
+		if (queue.empty() || bytesStarted >= bytesPerFrame)
+			break;
+		if (slot.fence != 0)
+			continue;
+		// Smallest pending level first, across all textures.
+		auto next = std::min_element(queue.begin(), queue.end(), [](const ImageTexture* a, const ImageTexture* b) {
+			return a->levels[a->uploadLevel].data.size() < b->levels[b->uploadLevel].data.size();
+		});
+		ImageTexture* texture = *next;
+		if (StartTransfer(slot, texture))
+			bytesStarted += slot.numBytes;
+		if (texture->uploadLevel < 0)
+			queue.erase(next);
+	}
+}
+
+// Poll the fences without waiting; a signalled one frees its PBO.
+void TextureUploader::RetireFinishedTransfers()
+{
+	for (auto& slot : slots) {
+		if (slot.fence == 0)
+			continue;
+		const GLenum status = glClientWaitSync(slot.fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			continue;
+		glDeleteSync(slot.fence);
+		slot.fence = 0;
+		inFlightBytes -= slot.numBytes;
+		ImageTexture* texture = slot.texture;
+		if (texture != nullptr && slot.completedLevel >= 0) {
+			texture->SetResidentBaseLevel(slot.completedLevel, true);
+			if (std::find(fadingTextures.begin(), fadingTextures.end(), texture) == fadingTextures.end())
+				fadingTextures.push_back(texture);
+		}
+		slot.texture = nullptr;
+		slot.completedLevel = -1;
+	}
+}
+
+// Copy the next band of rows of a texture's current level into the slot's PBO and start its transfer.
+bool TextureUploader::StartTransfer(Slot& slot, ImageTexture* texture)
+{
+	const int level = texture->uploadLevel;
+	const size_t rowBytes = texture->GetRowBytes(level);
+	const int numLevelRows = texture->GetNumRows(level);
+	const int firstRow = texture->numUploadedRows;
+	if (slot.capacity < rowBytes) {  // A single row must fit
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, rowBytes, nullptr, GL_STREAM_DRAW);
+		slot.capacity = rowBytes;
+	}
+	const int numRows = std::min(numLevelRows - firstRow, (int)(slot.capacity / rowBytes));
+	const size_t numBytes = rowBytes * numRows;
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+	// The slot's previous transfer has completed, so the old contents can be discarded.
+	unsigned char* destination = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, numBytes,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (destination == nullptr) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return false;
+	}
+	std::memcpy(destination, texture->levels[level].data.data() + firstRow * rowBytes, numBytes);
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	texture->UploadRows(level, firstRow, numRows, (const GLvoid*)0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.texture = texture;
+	slot.numBytes = numBytes;
+	slot.completedLevel = -1;
+	texture->numUploadedRows += numRows;
+	if (texture->numUploadedRows == numLevelRows) {
+		// The PBO holds the last rows now; the host copy is no longer needed.
+		texture->ReleaseLevelPixels(level);
+		slot.completedLevel = level;
+		texture->uploadLevel--;
+		texture->numUploadedRows = 0;
+	}
+	pendingBytes -= numBytes;
+	inFlightBytes += numBytes;
+	return true;
+}
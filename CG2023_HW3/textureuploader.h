@@ -0,0 +1,69 @@
+#ifndef TEXTURE_UPLOADER_H
+#define TEXTURE_UPLOADER_H
+
+#include "headers.h"
+#include "imagetexture.h"
+
+// TextureUploader Declarations.
+// Streams decoded texture pixels to the GPU through a ring of pixel buffer objects.
+// Enqueue() uploads the smallest mip levels of a texture directly, so it can be drawn at once,
+// whatever its size. Each frame, Update() then copies the next rows of the larger levels into
+// free PBOs, coarsest levels of all queued textures first, and issues glTexSubImage2D from them,
+// which returns without waiting for the transfer. A fence after each copy tells a later frame
+// when the PBO can be reused; once a level has landed it becomes the texture's base level and
+// fades in over a few frames. No call ever blocks the CPU.
+// All methods must be called on the GL thread.
+class TextureUploader
+{
+public:
+	// TextureUploader Public Methods.
+	// numBuffers PBOs of bufferSize bytes; at most bytesPerFrame are started per Update().
+	TextureUploader(const int numBuffers = 4, const size_t bufferSize = 4 * 1024 * 1024,
+					const size_t bytesPerFrame = 8 * 1024 * 1024);
+	~TextureUploader();
+
+	// PBOs and fence sync objects need OpenGL 3.2 (or the ARB extensions).
+	static bool IsSupported();
+
+	// Queue a decoded texture; it can be bound right away and is complete on a later frame.
+	// Returns false if the texture is not decoded yet (queue it again later).
+	bool Enqueue(ImageTexture* texture);
+	// Forget a texture that is being deleted.
+	void Remove(ImageTexture* texture);
+	// Called once per frame.
+	void Update();
+
+	// Pixel bytes queued but not copied to a PBO yet.
+	size_t GetPendingBytes() const { return pendingBytes; }
+	// Pixel bytes handed to the GPU whose transfer has not been seen to complete.
+	size_t GetInFlightBytes() const { return inFlightBytes; }
+	size_t GetOutstandingBytes() const { return pendingBytes + inFlightBytes; }
+
+private:
+	// One PBO of the ring and the transfer it is used for.
+	struct Slot
+	{
+		GLuint pbo;
+		size_t capacity;
+		GLsync fence;
+		ImageTexture* texture;
+		size_t numBytes;
+		// Level whose last rows the transfer holds (-1 if none).
+		int completedLevel;
+	};
+
+	// TextureUploader Private Methods.
+	void RetireFinishedTransfers();
+	bool StartTransfer(Slot& slot, ImageTexture* texture);
+
+	// TextureUploader Private Data.
+	std::vector<Slot> slots;
+	std::deque<ImageTexture*> queue;
+	// Textures whose newest level is still fading in.
+	std::vector<ImageTexture*> fadingTextures;
+	size_t bytesPerFrame;
+	size_t pendingBytes;
+	size_t inFlightBytes;
+};
+
+#endif
@@ -0,0 +1,45 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(const int numThreads)
+{
+	stopping = false;
+	const int count = numThreads > 0 ? numThreads : std::max(1, (int)std::thread::hardware_concurrency());
+	for (int i = 0; i < count; i++)
+		workers.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	jobAvailable.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+}
+
+void ThreadPool::Submit(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(std::move(job));
+	}
+	jobAvailable.notify_one();
+}
+
+void ThreadPool::WorkerLoop()
+{
+	for (;;) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+			if (jobs.empty())
+				return;  // Stopping, and every queued job has run.
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		job();
+	}
+}
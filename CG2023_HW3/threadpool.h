@@ -0,0 +1,36 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include "headers.h"
+
+// ThreadPool Declarations.
+// Fixed set of worker threads running submitted jobs in submission order.
+class ThreadPool
+{
+public:
+	// ThreadPool Public Methods.
+	// numThreads = 0 starts one worker per core.
+	ThreadPool(const int numThreads = 0);
+	// Finishes the queued jobs, then joins the workers.
+	~ThreadPool();
+
+	void Submit(std::function<void()> job);
+	int GetNumThreads() const { return (int)workers.size(); }
+
+private:
+	// Not copyable: the workers refer to this object.
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// ThreadPool Private Methods.
+	void WorkerLoop();
+
+	// ThreadPool Private Data.
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable jobAvailable;
+	bool stopping;
+};
+
+#endif
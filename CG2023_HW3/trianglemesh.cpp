@@ -1,4 +1,14 @@
 #include "trianglemesh.h"
+#include "mappedfile.h"
+#include "objparser.h"
+#include "meshcache.h"
+#include "meshstream.h"
+#include "texturecache.h"
+#include "textureuploader.h"
+#include "texturearray.h"
+#include "textureatlas.h"
+#include "vertexpacking.h"
+#include "overdraw.h"
 
 // Constructor of a triangle mesh.
 TriangleMesh::TriangleMesh()
@@ -7,127 +17,726 @@ TriangleMesh::TriangleMesh()
 	numTriangles = 0;
 	objCenter = glm::vec3(0.0f, 0.0f, 0.0f);
 	vboId = 0;
+	reportLoadStats = false;
+	numLoadThreads = 0;
+	weldVertices = true;
+	useCache = true;
+	optimizeVertexCache = true;
+	optimizeOverdraw = true;
+	overdrawThreshold = 1.05f;
+	optimizeVertexFetch = true;
+	useTextureArrays = true;
+	atlasTextureSize = TextureAtlas::DEFAULT_MAX_TEXTURE_SIZE;
+	numAtlasTextures = 0;
+	vertexFormat = VERTEX_FORMAT_FLOAT;
+	bufferFormat = VERTEX_FORMAT_FLOAT;
+	packedPositionScale = glm::vec3(1.0f, 1.0f, 1.0f);
+	packedPositionOffset = glm::vec3(0.0f, 0.0f, 0.0f);
+	cancelFlag = nullptr;
+	weldEpsilon = 0.0f;
+	numVerticesBeforeWeld = 0;
 	objExtent = glm::vec3(0.0f, 0.0f, 0.0f);
+	stream = nullptr;
+	streaming = false;
+	vboCapacity = 0;
+	streamBoundsMin = glm::vec3(0.0f, 0.0f, 0.0f);
+	streamBoundsMax = glm::vec3(0.0f, 0.0f, 0.0f);
 }
 
 // Destructor of a triangle mesh.
 TriangleMesh::~TriangleMesh()
 {
 	vertices.clear();
-	glDeleteBuffers(1, &vboId);
+	// A mesh whose load was cancelled never created GL buffers (and may not be on the GL thread).
+	if (vboId != 0)
+		glDeleteBuffers(1, &vboId);
+	// The arrays refer to the material textures, so they go first.
+	for (TextureArray* textureArray : textureArrays)
+		delete textureArray;
+	for (auto& submesh : subMeshes) {
+		if (submesh.iboId != 0)
+			glDeleteBuffers(1, &submesh.iboId);
+		// Releases the material's texture handle too; TextureCache::Trim() frees unused ones.
+		delete submesh.material;
+	}
+}
+
+// Run function(i) for i in [0, count), one thread per index.
+template <typename Function>
+static void ParallelFor(const size_t count, Function function)
+{
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < count; i++)
+        workers.emplace_back(function, i);
+    if (count > 0)
+        function(0);
+    for (auto& worker : workers)
+        worker.join();
 }
 
-// Load the geometry and material data from an OBJ file.
+// Load the geometry and material data from an OBJ or OBJM file.
 bool TriangleMesh::LoadFromFile(const std::string& filePath, const bool normalized)
 {	
-    std::ifstream f(filePath);  // Open the file
-    if (!f.is_open()) {  // If the file cannot be opened, report an error and return false
+    // A current binary cache replaces the whole text parse.
+    const MeshLoadOptions loadOptions = GetLoadOptions(normalized);
+    if (useCache) {
+        const auto cacheStartTime = std::chrono::steady_clock::now();
+        if (LoadFromCache(filePath, loadOptions)) {
+            if (reportLoadStats) {
+                const double cacheSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - cacheStartTime).count();
+                std::cout << "[INFO] Loaded " << MeshCache::GetCachePath(filePath) << " in " << std::fixed << std::setprecision(2)
+                          << cacheSeconds * 1000.0 << " ms" << std::defaultfloat << std::endl;
+            }
+            return true;
+        }
+    }
+
+    // Map the whole file and scan it in place; no per-line strings or streams are built.
+    MappedFile file;
+    if (!file.Open(filePath)) {  // If the file cannot be opened, report an error and return false
         std::cerr << "Error: Could not open the file " << filePath << std::endl;
         return false;
     }
 
-    std::string line;
-    std::vector<glm::vec3> positions;
-    std::vector<glm::vec3> normals;
-    std::vector<glm::vec2> textures;
-    VertexPTN newVertex;
+    const auto startTime = std::chrono::steady_clock::now();
 
-    int point_count = 0;  // Count the number of points
-    auto subMesh_pointer = subMeshes.end();
-    std::vector<unsigned int> currentVertexIndices;
+    // *.OBJM files are triangle soups of "vtx" records and have their own reader.
+    std::string extension = std::filesystem::path(filePath).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    const bool isObjm = (extension == ".objm");
 
-    while (std::getline(f, line)) {
-        if (line.substr(0, 2) == "v ") {
-            std::istringstream iss(line.substr(2));
-            glm::vec3 pos;
-            iss >> pos.x >> pos.y >> pos.z;
-            positions.push_back(pos);
+    // Load the material libraries declared at the top of the file right away, so their
+    // textures decode on the texture pool while the geometry is parsed.
+    const std::string folder = filePath.substr(0, filePath.find_last_of('/') + 1);
+    std::vector<std::string> prefetchedLibraries;
+    for (const auto& name : ScanHeaderMaterialLibraries(file.GetData(), file.GetData() + file.GetSize())) {
+        prefetchedLibraries.push_back(folder + name);
+        LoadMaterialsFromFile(prefetchedLibraries.back());
+    }
+    size_t numPrefetchedUsed = 0;
+
+    // Split the file at line boundaries and parse the chunks on separate threads.
+    // Small files end up as a single chunk, which is the serial path.
+    // All chunks normally form a single wave. A streamed load cuts the file into many small
+    // chunks instead and parses, resolves and publishes them a wave (one chunk per thread)
+    // at a time, so the first geometry shows up long before the end of the file is reached.
+    const bool streamed = (stream != nullptr);
+    const size_t minChunkSize = streamed ? 1024 * 1024 : 4 * 1024 * 1024;
+    const int numThreads = numLoadThreads > 0 ? numLoadThreads : std::max(1, (int)std::thread::hardware_concurrency());
+    std::vector<ParsedChunk> chunks = SplitIntoChunks(file.GetData(), file.GetData() + file.GetSize(),
+                                                      streamed ? INT_MAX : numThreads, minChunkSize);
+    for (auto& chunk : chunks)
+        chunk.cancelFlag = cancelFlag;
+    const size_t waveSize = streamed ? (size_t)numThreads : chunks.size();
+
+    const size_t firstVertex = vertices.size();
+    size_t numPositions = 0, numTexcoords = 0, numNormals = 0, numNewVertices = 0;
+
+    // Merge in file order: load material libraries and hand each triangle range to its subMesh.
+    // Faces before any "usemtl" or after an unknown material name go to a default subMesh.
+    int subMeshIndex = -1;
+    int defaultSubMeshIndex = -1;
+    size_t numInvalidCorners = 0;
+    auto appendTriangles = [&](const ParsedChunk& chunk, const size_t first, const size_t last) {
+        if (first == last)
+            return;
+        if (subMeshIndex < 0) {
+            if (defaultSubMeshIndex < 0)
+                defaultSubMeshIndex = AddDefaultSubMesh();
+            subMeshIndex = defaultSubMeshIndex;
         }
-        else if (line.substr(0, 3) == "vt ") {
-            std::istringstream iss(line.substr(3));
-            glm::vec2 tex;
-            iss >> tex.x >> tex.y;
-            textures.push_back(tex);
+        auto& indices = subMeshes[subMeshIndex].vertexIndices;
+        indices.insert(indices.end(), chunk.triangles.begin() + first * 3, chunk.triangles.begin() + last * 3);
+    };
+
+    for (size_t waveBegin = 0; waveBegin < chunks.size(); waveBegin += waveSize) {
+        const size_t waveEnd = std::min(chunks.size(), waveBegin + waveSize);
+        ParallelFor(waveEnd - waveBegin, [&chunks, waveBegin, isObjm](const size_t i) {
+            if (isObjm)
+                ParseObjmChunk(chunks[waveBegin + i]);
+            else
+                ParseObjChunk(chunks[waveBegin + i]);
+        });
+
+        if (IsCancelled())
+            return false;
+
+        // Now that the per-chunk counts are known, give every chunk its global offsets.
+        const size_t waveFirstVertex = firstVertex + numNewVertices;
+        for (size_t i = waveBegin; i < waveEnd; i++) {
+            ParsedChunk& chunk = chunks[i];
+            chunk.positionOffset = numPositions;
+            chunk.texcoordOffset = numTexcoords;
+            chunk.normalOffset = numNormals;
+            chunk.vertexOffset = firstVertex + numNewVertices;
+            numPositions += chunk.positions.size();
+            numTexcoords += chunk.texcoords.size();
+            numNormals += chunk.normals.size();
+            numNewVertices += chunk.numVertices;
         }
-        else if (line.substr(0, 3) == "vn ") {
-            std::istringstream iss(line.substr(3));
-            glm::vec3 nor;
-            iss >> nor.x >> nor.y >> nor.z;
-            normals.push_back(nor);
+        if (isObjm && waveEnd == chunks.size() && numNewVertices % 3 != 0) {
+            std::cerr << "Warning: " << filePath << " ends with an incomplete triangle" << std::endl;
+            numNewVertices -= numNewVertices % 3;
         }
-        else if (line.substr(0, 2) == "f ") {
-            std::istringstream iss(line.substr(2));
-            std::string vertexIndicesStr;
-            std::vector<unsigned int> tempVertexIndices;
-
-            while (iss >> vertexIndicesStr) { // Read a whole line
-                std::istringstream vertexIndicesStream(vertexIndicesStr);
-                std::string str;
-                while (std::getline(vertexIndicesStream, str, '/'))   // Remove slashes
-                    tempVertexIndices.push_back(std::stoi(str) - 1);  // Convert to 0 base
-            }
 
-            for (int i = 0; i < tempVertexIndices.size(); i += 3) {
-                // Store a PTN for one point in the structure
-                vertices.push_back(VertexPTN(positions[tempVertexIndices[i]], normals[tempVertexIndices[i + 2]], textures[tempVertexIndices[i + 1]]));
-            }
-            int points_number = tempVertexIndices.size() / 3;  // How many points in one line
-            if (points_number == 3) {  // Only one triangle
-                for (int i = 0; i < 3; i++) {
-                    currentVertexIndices.push_back(point_count);
-                    point_count++;
+        // Build the vertices and per-chunk triangles in parallel.
+        vertices.resize(firstVertex + numNewVertices);
+        VertexPTN* output = vertices.data();
+        const size_t totalVertices = firstVertex + numNewVertices;
+        ParallelFor(waveEnd - waveBegin, [&, output](const size_t i) {
+            if (isObjm)
+                ResolveObjmChunk(chunks[waveBegin + i], totalVertices, output);
+            else
+                ResolveObjChunk(chunks[waveBegin + i], numPositions, numTexcoords, numNormals, chunks.data(), waveEnd, output);
+        });
+
+        std::vector<size_t> firstIndices;
+        if (streamed) {
+            for (const auto& subMesh : subMeshes)
+                firstIndices.push_back(subMesh.vertexIndices.size());
+        }
+        for (size_t i = waveBegin; i < waveEnd; i++) {
+            const ParsedChunk& chunk = chunks[i];
+            size_t triangleBegin = 0;
+            for (const auto& event : chunk.events) {
+                appendTriangles(chunk, triangleBegin, event.triangleOffset);
+                triangleBegin = event.triangleOffset;
+
+                if (event.isLibrary) {  // The material library sits next to the model
+                    materialLibraries.push_back(folder + event.name);
+                    if (numPrefetchedUsed < prefetchedLibraries.size() && prefetchedLibraries[numPrefetchedUsed] == materialLibraries.back())
+                        numPrefetchedUsed++;  // Already loaded before parsing
+                    else
+                        LoadMaterialsFromFile(materialLibraries.back());
+                    subMeshIndex = -1;
                 }
-            }
-            else {  // Split triangles (more than one point in a line)
-                for (int i = 2; i < points_number; i++) {
-                    currentVertexIndices.push_back(point_count);
-                    currentVertexIndices.push_back(point_count + i - 1);
-                    currentVertexIndices.push_back(point_count + i);
+                else {  // Choose the material for the following faces
+                    const auto found = materialIndex.find(event.name);
+                    if (found != materialIndex.end()) {
+                        subMeshIndex = found->second;
+                    }
+                    else {
+                        std::cerr << "Warning: Unknown material " << event.name << " in " << filePath << std::endl;
+                        subMeshIndex = -1;
+                    }
                 }
-                point_count += points_number;
             }
-            if (subMesh_pointer != subMeshes.end()) {  // snIivertexIndices
-                subMesh_pointer->vertexIndices.insert(subMesh_pointer->vertexIndices.end(), currentVertexIndices.begin(), currentVertexIndices.end());
+            appendTriangles(chunk, triangleBegin, chunk.triangles.size() / 3);
+            numTriangles += (int)(chunk.triangles.size() / 3);
+            numInvalidCorners += chunk.numInvalidCorners;
+        }
+        if (IsCancelled())
+            return false;
+        if (streamed)
+            PublishBatch(waveFirstVertex, firstIndices);
+    }
+    if (numInvalidCorners > 0)
+        std::cerr << "Warning: Skipped " << numInvalidCorners << " invalid face corners in " << filePath << std::endl;
+
+    const auto parseTime = std::chrono::steady_clock::now();
+    const size_t fileSize = file.GetSize();
+    const size_t numChunks = chunks.size();
+    chunks.clear();
+    file.Close();
+
+    numVertices = vertices.size();
+
+    // Share the vertices of neighbouring corners instead of keeping one per corner.
+    numVerticesBeforeWeld = numVertices;
+    if (weldVertices) {
+        WeldVertices(weldEpsilon);
+    }
+
+    // Normalize the geometry data.
+    if (normalized) {
+        Normalize();
+    }
+
+    // Put the triangles in an order the post-transform vertex cache and the depth test like.
+    if (IsCancelled())
+        return false;
+    OptimizeIndexOrder();
+    // Then lay the vertices out in the order the reordered indices reach them.
+    if (optimizeVertexFetch)
+        OptimizeVertexFetch();
+
+    // The textures have been decoding in the background all along.
+    WaitForTextures();
+    if (IsCancelled())
+        return false;
+
+    if (reportLoadStats) {
+        const double parseSeconds = std::chrono::duration<double>(parseTime - startTime).count();
+        const double totalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        const double megaBytes = fileSize / (1024.0 * 1024.0);
+        std::cout << "[INFO] Parsed " << std::fixed << std::setprecision(2) << megaBytes << " MB in "
+                  << parseSeconds * 1000.0 << " ms (" << (parseSeconds > 0.0 ? megaBytes / parseSeconds : 0.0)
+                  << " MB/s, " << numChunks << " chunks), total load " << totalSeconds * 1000.0 << " ms" << std::defaultfloat << std::endl;
+    }
+
+    // Write the cache for the next load (not for a cancelled one, which may not have finished);
+    // failing to do so (e.g. a read-only folder) is harmless.
+    if (useCache && !IsCancelled() && !SaveToCache(filePath, loadOptions))
+        std::cerr << "Warning: Could not write " << MeshCache::GetCachePath(filePath) << std::endl;
+    // The atlas comes last: the cache records the textures the materials name, not the atlas.
+    CreateTextureAtlas();
+    return !IsCancelled();
+}
+
+// Add the subMesh that collects faces without a (known) material; returns its index.
+int TriangleMesh::AddDefaultSubMesh()
+{
+    PhongMaterial* material = new PhongMaterial();  // Named "Default"
+    material->SetKa(glm::vec3(0.2f, 0.2f, 0.2f));
+    material->SetKd(glm::vec3(0.8f, 0.8f, 0.8f));
+    material->SetKs(glm::vec3(0.0f, 0.0f, 0.0f));
+    material->SetNs(1.0f);
+
+    SubMesh subMesh;
+    subMesh.material = material;
+    subMeshes.push_back(subMesh);
+    return (int)subMeshes.size() - 1;
+}
+
+// Everything that changes the loader output has to be part of the cache key.
+MeshLoadOptions TriangleMesh::GetLoadOptions(const bool normalized) const
+{
+    MeshLoadOptions options;
+    options.flags = (normalized ? MESH_LOAD_NORMALIZE : 0u) | (weldVertices ? MESH_LOAD_WELD : 0u)
+                  | (optimizeVertexCache ? MESH_LOAD_OPTIMIZE_VERTEX_CACHE : 0u) | (optimizeOverdraw ? MESH_LOAD_OPTIMIZE_OVERDRAW : 0u)
+                  | (optimizeVertexFetch ? MESH_LOAD_OPTIMIZE_VERTEX_FETCH : 0u);
+    // A setting that is switched off does not change the output, so it does not invalidate the cache either.
+    options.weldEpsilon = weldVertices ? weldEpsilon : 0.0f;
+    options.overdrawThreshold = optimizeOverdraw ? overdrawThreshold : 0.0f;
+    return options;
+}
+
+// Fill the mesh from its binary cache; false if there is no current cache.
+bool TriangleMesh::LoadFromCache(const std::string& filePath, const MeshLoadOptions& loadOptions)
+{
+    MeshCacheData data;
+    if (!MeshCache::Load(filePath, loadOptions, data))
+        return false;
+
+    vertices = std::move(data.vertices);
+    for (auto& cached : data.subMeshes) {
+        PhongMaterial* material = new PhongMaterial();
+        material->SetName(cached.materialName);
+        material->SetKa(cached.Ka);
+        material->SetKd(cached.Kd);
+        material->SetKs(cached.Ks);
+        material->SetNs(cached.Ns);
+        if (!cached.texturePath.empty())
+            material->SetMapKd(TextureCache::Acquire(cached.texturePath));
+
+        SubMesh subMesh;
+        subMesh.material = material;
+        subMesh.vertexIndices = std::move(cached.vertexIndices);
+        materialIndex.emplace(cached.materialName, (int)subMeshes.size());
+        subMeshes.push_back(subMesh);
+    }
+    for (const auto& library : data.materialLibraries)
+        materialLibraries.push_back(library.path);
+
+    numVertices = (int)vertices.size();
+    numVerticesBeforeWeld = data.numVerticesBeforeWeld;
+    numTriangles = data.numTriangles;
+    objCenter = data.objCenter;
+    objExtent = data.objExtent;
+    vertexCacheBefore = data.vertexCacheBefore;
+    vertexCacheAfter = data.vertexCacheAfter;
+    overdrawBefore = data.overdrawBefore;
+    overdrawAfter = data.overdrawAfter;
+    vertexFetchBefore = data.vertexFetchBefore;
+    vertexFetchAfter = data.vertexFetchAfter;
+    WaitForTextures();
+    CreateTextureAtlas();
+    return !IsCancelled();
+}
+
+// Wait until the textures of all materials are decoded; drop the ones that failed.
+void TriangleMesh::WaitForTextures()
+{
+    for (auto& subMesh : subMeshes) {
+        if (IsCancelled())
+            return;
+        PhongMaterial* material = subMesh.material;
+        if (material == nullptr || material->GetMapKd() == nullptr)
+            continue;
+        material->GetMapKd()->Decode();
+        if (!material->GetMapKd()->IsValid())
+            material->SetMapKd(nullptr);
+    }
+}
+
+// Store the loaded mesh in its binary cache.
+bool TriangleMesh::SaveToCache(const std::string& filePath, const MeshLoadOptions& loadOptions) const
+{
+    MeshCacheData data;
+    data.options = loadOptions;
+    if (!MeshCache::GetFileStamp(filePath, data.source))
+        return false;
+    for (const auto& library : materialLibraries) {
+        CachedFileStamp stamp;
+        if (!MeshCache::GetFileStamp(library, stamp))
+            return false;  // A missing library would make the cache look current forever.
+        data.materialLibraries.push_back(stamp);
+    }
+
+    for (const auto& subMesh : subMeshes) {
+        CachedSubMesh cached;
+        const PhongMaterial* material = subMesh.material;
+        cached.materialName = material ? material->GetName() : "";
+        cached.Ka = material ? material->GetKa() : glm::vec3(0.0f);
+        cached.Kd = material ? material->GetKd() : glm::vec3(0.0f);
+        cached.Ks = material ? material->GetKs() : glm::vec3(0.0f);
+        cached.Ns = material ? material->GetNs() : 0.0f;
+        if (material && material->GetMapKd())
+            cached.texturePath = material->GetMapKd()->GetPath();
+        cached.vertexIndices = subMesh.vertexIndices;
+        data.subMeshes.push_back(std::move(cached));
+    }
+    data.vertices = vertices;
+    data.numTriangles = numTriangles;
+    data.numVerticesBeforeWeld = numVerticesBeforeWeld;
+    data.objCenter = objCenter;
+    data.objExtent = objExtent;
+    data.vertexCacheBefore = vertexCacheBefore;
+    data.vertexCacheAfter = vertexCacheAfter;
+    data.overdrawBefore = overdrawBefore;
+    data.overdrawAfter = overdrawAfter;
+    data.vertexFetchBefore = vertexFetchBefore;
+    data.vertexFetchAfter = vertexFetchAfter;
+    return MeshCache::Save(filePath, data);
+}
+
+// Measure the vertex cache efficiency of every subMesh and, if enabled, reorder its triangles
+// for the vertex cache and then against overdraw. The subMeshes are independent, so they are
+// spread over the load threads.
+void TriangleMesh::OptimizeIndexOrder()
+{
+    const auto startTime = std::chrono::steady_clock::now();
+    overdrawBefore = overdrawAfter = OverdrawStats();
+    if (optimizeOverdraw)
+        overdrawBefore = AnalyzeOverdraw(vertices, subMeshes);
+    std::vector<VertexCacheStats> before(subMeshes.size());
+    std::vector<VertexCacheStats> after(subMeshes.size());
+    std::atomic<size_t> nextSubMesh(0);
+    const int numThreads = numLoadThreads > 0 ? numLoadThreads : std::max(1, (int)std::thread::hardware_concurrency());
+    ParallelFor(std::min(subMeshes.size(), (size_t)numThreads), [&](const size_t) {
+        for (size_t i = nextSubMesh++; i < subMeshes.size(); i = nextSubMesh++) {
+            std::vector<unsigned int>& indices = subMeshes[i].vertexIndices;
+            before[i] = AnalyzeVertexCache(indices.data(), indices.size());
+            if (optimizeVertexCache)
+                OptimizeVertexCache(indices.data(), indices.size());
+            if (optimizeOverdraw)
+                OptimizeOverdraw(indices.data(), indices.size(), vertices.data(), vertices.size(), overdrawThreshold);
+            after[i] = (optimizeVertexCache || optimizeOverdraw) ? AnalyzeVertexCache(indices.data(), indices.size()) : before[i];
+        }
+    });
+    if (optimizeOverdraw)
+        overdrawAfter = AnalyzeOverdraw(vertices, subMeshes);
+
+    vertexCacheBefore = vertexCacheAfter = VertexCacheStats();
+    for (size_t i = 0; i < subMeshes.size(); i++) {
+        vertexCacheBefore.numTriangles += before[i].numTriangles;
+        vertexCacheBefore.numVertices += before[i].numVertices;
+        vertexCacheBefore.numMisses += before[i].numMisses;
+        vertexCacheAfter.numTriangles += after[i].numTriangles;
+        vertexCacheAfter.numVertices += after[i].numVertices;
+        vertexCacheAfter.numMisses += after[i].numMisses;
+    }
+    if (reportLoadStats && (optimizeVertexCache || optimizeOverdraw)) {
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        std::cout << "[INFO] Optimized the triangle order in " << std::fixed << std::setprecision(2) << seconds * 1000.0
+                  << " ms" << std::defaultfloat << std::endl;
+    }
+}
+
+// Renumber the vertices in the order the subMeshes (in drawing order) first use them, so each
+// draw fetches its vertices front to back from a compact range of the array. SubMeshes that
+// share vertices but reach them in different orders can make this worse than the original
+// layout, which is then kept.
+void TriangleMesh::OptimizeVertexFetch()
+{
+    const unsigned int unusedVertex = 0xFFFFFFFFu;
+    std::vector<unsigned int> remap(vertices.size(), unusedVertex);
+    std::vector<unsigned int> source;  // Old index of each new vertex
+    std::vector<VertexPTN> reordered;
+    source.reserve(vertices.size());
+    reordered.reserve(vertices.size());
+    vertexFetchBefore = vertexFetchAfter = VertexFetchStats();
+    for (auto& subMesh : subMeshes) {
+        std::vector<unsigned int>& indices = subMesh.vertexIndices;
+        const VertexFetchStats before = AnalyzeVertexFetch(indices.data(), indices.size(), vertices.size(), sizeof(VertexPTN));
+        vertexFetchBefore.numBytesFetched += before.numBytesFetched;
+        vertexFetchBefore.numBytesUsed += before.numBytesUsed;
+        for (unsigned int& index : indices) {
+            if (remap[index] == unusedVertex) {
+                remap[index] = (unsigned int)reordered.size();
+                source.push_back(index);
+                reordered.push_back(vertices[index]);
             }
+            index = remap[index];
+        }
+    }
+    vertices.swap(reordered);
+    for (const auto& subMesh : subMeshes) {
+        const std::vector<unsigned int>& indices = subMesh.vertexIndices;
+        const VertexFetchStats after = AnalyzeVertexFetch(indices.data(), indices.size(), vertices.size(), sizeof(VertexPTN));
+        vertexFetchAfter.numBytesFetched += after.numBytesFetched;
+        vertexFetchAfter.numBytesUsed += after.numBytesUsed;
+    }
+    if (vertexFetchAfter.numBytesFetched > vertexFetchBefore.numBytesFetched) {
+        for (auto& subMesh : subMeshes) {
+            for (unsigned int& index : subMesh.vertexIndices)
+                index = source[index];
+        }
+        vertices.swap(reordered);
+        vertexFetchAfter = vertexFetchBefore;
+    }
+    numVertices = (int)vertices.size();
+}
 
-            numTriangles += currentVertexIndices.size() / 3;
-            currentVertexIndices.clear();  // MżȦsvertexIndices۶]U@submesh
+// Hand the vertices from firstVertex on and the subMesh indices past firstIndices to the stream.
+void TriangleMesh::PublishBatch(const size_t firstVertex, const std::vector<size_t>& firstIndices)
+{
+    MeshBatch batch;
+    batch.vertices.assign(vertices.begin() + firstVertex, vertices.end());
+    if (!batch.vertices.empty()) {
+        batch.boundsMin = batch.boundsMax = batch.vertices[0].position;
+        for (const auto& vertex : batch.vertices) {
+            batch.boundsMin = glm::min(batch.boundsMin, vertex.position);
+            batch.boundsMax = glm::max(batch.boundsMax, vertex.position);
         }
-        else if (line.substr(0, 7) == "usemtl ") {  // P_nέ@material
-            std::istringstream iss(line.substr(7));
-            std::string mat;
-            iss >> mat;
-            subMesh_pointer = std::find_if(subMeshes.begin(), subMeshes.end(), [&mat](const SubMesh& subMesh) {
-                return subMesh.material && subMesh.material->GetName() == mat;
-                });
+    }
+    for (size_t i = 0; i < subMeshes.size(); i++) {
+        const auto& indices = subMeshes[i].vertexIndices;
+        const size_t first = i < firstIndices.size() ? firstIndices[i] : 0;
+        batch.materials.push_back(subMeshes[i].material != nullptr ? *subMeshes[i].material : PhongMaterial());
+        batch.subMeshIndices.emplace_back(indices.begin() + first, indices.end());
+    }
+    stream->Push(std::move(batch));
+}
+
+// Hash of a welding key made of eight 32-bit words.
+static inline unsigned long long HashWeldKey(const unsigned int key[8])
+{
+    unsigned long long h = 0x9E3779B97F4A7C15ull;
+    for (int i = 0; i < 8; i++) {
+        h ^= key[i];
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+// Build the welding key of a vertex: the exact bits of its position, normal and texcoord.
+static inline void MakeWeldKey(const VertexPTN& vertex, unsigned int key[8])
+{
+    const float values[8] = {
+        vertex.position.x, vertex.position.y, vertex.position.z,
+        vertex.normal.x, vertex.normal.y, vertex.normal.z,
+        vertex.texcoord.x, vertex.texcoord.y
+    };
+    for (int i = 0; i < 8; i++) {
+        const float value = values[i] + 0.0f;  // Folds -0.0 into 0.0.
+        std::memcpy(&key[i], &value, sizeof(float));
+    }
+}
+
+// Merge vertices with identical attributes into the first of them; returns the welded count.
+static size_t WeldExact(std::vector<VertexPTN>& vertices, std::vector<unsigned int>& remap)
+{
+    const size_t count = vertices.size();
+    // Open-addressing table of indices into the welded array; keys are recomputed on demand.
+    size_t tableSize = 1;
+    while (tableSize < count * 2) tableSize <<= 1;
+    const unsigned int emptySlot = 0xFFFFFFFFu;
+    std::vector<unsigned int> table(tableSize, emptySlot);
+    std::vector<unsigned int> welded;  // Welded key per output vertex, 8 words each
+    welded.reserve(count);
+
+    size_t numWelded = 0;
+    for (size_t i = 0; i < count; i++) {
+        unsigned int key[8];
+        MakeWeldKey(vertices[i], key);
+        size_t slot = (size_t)HashWeldKey(key) & (tableSize - 1);
+        while (true) {
+            const unsigned int candidate = table[slot];
+            if (candidate == emptySlot) {
+                // First vertex with this key; it becomes the representative.
+                table[slot] = (unsigned int)numWelded;
+                welded.insert(welded.end(), key, key + 8);
+                vertices[numWelded] = vertices[i];
+                remap[i] = (unsigned int)numWelded++;
+                break;
+            }
+            if (std::memcmp(&welded[candidate * 8], key, sizeof(key)) == 0) {
+                remap[i] = candidate;
+                break;
+            }
+            slot = (slot + 1) & (tableSize - 1);
         }
-        else if (line.substr(0, 7) == "mtllib ") {  // P_nέ@modelmaterial library
-            std::istringstream iss(line.substr(7));
-            std::string lib;
-            iss >> lib;
+    }
+    return numWelded;
+}
+
+// Largest difference per component at which normals and texcoords still count as equal in a
+// tolerance weld; these are unit vectors and [0, 1] coordinates, unlike the positions.
+const float WELD_NORMAL_TOLERANCE = 1e-3f;
+const float WELD_TEXCOORD_TOLERANCE = 1e-5f;
+
+// Grid cell (of size 2 epsilon) a position falls in, and per axis the neighbouring cell on the
+// side it is nearer to: anything within epsilon lies in one of those 8 cells. False for
+// positions that are not finite; coordinates are clamped well inside the long long range,
+// where the cast is defined.
+static inline bool GetWeldCell(const glm::vec3& position, const float epsilon, long long cell[3], int side[3])
+{
+    const double limit = 4.0e18;
+    for (int k = 0; k < 3; k++) {
+        const double q = (double)position[k] / (2.0 * epsilon);
+        const double lower = std::floor(q);
+        if (!std::isfinite(lower))
+            return false;
+        cell[k] = (long long)std::max(-limit, std::min(limit, lower));
+        side[k] = (q - lower < 0.5) ? -1 : 1;
+    }
+    return true;
+}
+
+static inline unsigned long long HashWeldCell(const long long cell[3])
+{
+    unsigned int key[8] = {};
+    std::memcpy(key, cell, 3 * sizeof(long long));
+    return HashWeldKey(key);
+}
+
+// Whether a vertex may be merged into a representative, and how far apart their positions are.
+static inline bool IsWithinWeldTolerance(const VertexPTN& a, const VertexPTN& b, const float epsilon, float& distance)
+{
+    distance = glm::length(a.position - b.position);
+    if (!(distance <= epsilon))
+        return false;
+    const glm::vec3 normalDelta = glm::abs(a.normal - b.normal);
+    const glm::vec2 texcoordDelta = glm::abs(a.texcoord - b.texcoord);
+    return std::max(normalDelta.x, std::max(normalDelta.y, normalDelta.z)) <= WELD_NORMAL_TOLERANCE
+        && std::max(texcoordDelta.x, texcoordDelta.y) <= WELD_TEXCOORD_TOLERANCE;
+}
 
-            size_t lastSlash = filePath.find_last_of('/');  // J|̫@slash
+// Merge each vertex into the nearest earlier representative within the tolerances, found among
+// the representatives of the grid cells around it; returns the welded count. Representatives
+// keep their own attributes, and the merge is greedy, so a chain of vertices each within
+// epsilon of the next may still end up as several vertices.
+static size_t WeldWithinEpsilon(std::vector<VertexPTN>& vertices, const float epsilon, std::vector<unsigned int>& remap)
+{
+    const size_t count = vertices.size();
+    // Open-addressing table of the non-empty cells; each slot holds the last representative
+    // that went into its cell, and next[] chains to the earlier ones. It grows with the number
+    // of cells, which is often far below the number of vertices.
+    const unsigned int emptySlot = 0xFFFFFFFFu;
+    size_t tableSize = 1024;
+    std::vector<unsigned int> table(tableSize, emptySlot);
+    size_t numCells = 0;
+    std::vector<long long> cells;  // Cell per output vertex, 3 coordinates each
+    std::vector<unsigned int> next;
 
-            std::string newFileName = filePath;
-            newFileName = newFileName.substr(0, lastSlash + 1) + lib;  // last slash᭱rssɮתWr
+    const auto findSlot = [&](const long long cell[3]) {
+        size_t slot = (size_t)HashWeldCell(cell) & (tableSize - 1);
+        while (table[slot] != emptySlot && std::memcmp(&cells[(size_t)table[slot] * 3], cell, 3 * sizeof(long long)) != 0)
+            slot = (slot + 1) & (tableSize - 1);
+        return slot;
+    };
 
-            LoadMaterialsFromFile(newFileName);
+    size_t numWelded = 0;
+    for (size_t i = 0; i < count; i++) {
+        long long cell[3] = { 0, 0, 0 };
+        int side[3] = { 0, 0, 0 };
+        const bool finite = GetWeldCell(vertices[i].position, epsilon, cell, side);
+        unsigned int best = emptySlot;
+        float bestDistance = 0.0f;
+        // The own cell first; an exact duplicate there cannot be beaten.
+        for (int n = 0; n < 8 && finite && !(best != emptySlot && bestDistance == 0.0f); n++) {
+            const long long neighbour[3] = { cell[0] + ((n & 1) ? side[0] : 0), cell[1] + ((n & 2) ? side[1] : 0), cell[2] + ((n & 4) ? side[2] : 0) };
+            for (unsigned int candidate = table[findSlot(neighbour)]; candidate != emptySlot; candidate = next[candidate]) {
+                float distance = 0.0f;
+                if (IsWithinWeldTolerance(vertices[i], vertices[candidate], epsilon, distance) && (best == emptySlot || distance < bestDistance)) {
+                    best = candidate;
+                    bestDistance = distance;
+                }
+            }
+        }
+        if (best != emptySlot) {
+            remap[i] = best;
+            continue;
         }
 
+        // No match; the vertex becomes a representative. One that is not finite never merges.
+        vertices[numWelded] = vertices[i];
+        remap[i] = (unsigned int)numWelded;
+        cells.insert(cells.end(), cell, cell + 3);
+        next.push_back(emptySlot);
+        if (finite) {
+            size_t slot = findSlot(cell);
+            if (table[slot] == emptySlot && ++numCells * 2 > tableSize) {
+                std::vector<unsigned int> heads;
+                for (const unsigned int head : table) {
+                    if (head != emptySlot)
+                        heads.push_back(head);
+                }
+                tableSize *= 2;
+                table.assign(tableSize, emptySlot);
+                for (const unsigned int head : heads)
+                    table[findSlot(&cells[(size_t)head * 3])] = head;
+                slot = findSlot(cell);
+            }
+            next.back() = table[slot];
+            table[slot] = (unsigned int)numWelded;
+        }
+        numWelded++;
     }
-    f.close();
+    return numWelded;
+}
 
-    numVertices = vertices.size();
+// Merge duplicated vertices and remap the subMesh indices to the compacted vertex array.
+void TriangleMesh::WeldVertices(const float epsilon)
+{
+    const size_t count = vertices.size();
+    numVerticesBeforeWeld = (int)count;
+    if (count == 0)
+        return;
 
-    // Normalize the geometry data.
-    if (normalized) {
-        Normalize();
+    std::vector<unsigned int> remap(count);
+    const size_t numWelded = (epsilon > 0.0f) ? WeldWithinEpsilon(vertices, epsilon, remap) : WeldExact(vertices, remap);
+    vertices.resize(numWelded);
+    vertices.shrink_to_fit();
+
+    for (auto& subMesh : subMeshes) {
+        std::vector<unsigned int>& indices = subMesh.vertexIndices;
+        size_t numKept = 0;
+        for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+            const unsigned int a = remap[indices[t]];
+            const unsigned int b = remap[indices[t + 1]];
+            const unsigned int c = remap[indices[t + 2]];
+            // Welding with a tolerance can collapse small triangles.
+            if (a == b || b == c || a == c) {
+                numTriangles--;
+                continue;
+            }
+            indices[numKept++] = a;
+            indices[numKept++] = b;
+            indices[numKept++] = c;
+        }
+        indices.resize(numKept);
     }
-    return true;
+    numVertices = (int)vertices.size();
 }
 
 void TriangleMesh::Normalize()  // same as HW1
 {
+    if (vertices.empty())
+        return;
+
     float center_x;
     float center_y;
     float center_z;
@@ -170,6 +779,8 @@ void TriangleMesh::Normalize()  // same as HW1
     float length_y = max_y - min_y;
     float length_z = max_z - min_z;
 
+    objExtent = glm::vec3(length_x, length_y, length_z);
+
     float max_length = length_x;
     if (length_y > max_length) {
         max_length = length_y;
@@ -195,7 +806,6 @@ bool TriangleMesh::LoadMaterialsFromFile(std::string newFileName)
 
     std::string line;
     PhongMaterial* nowMaterial = nullptr;
-    ImageTexture* texture = nullptr;
 
     while (std::getline(f, line)) {
         std::istringstream iss(line);
@@ -210,6 +820,8 @@ bool TriangleMesh::LoadMaterialsFromFile(std::string newFileName)
 
             SubMesh newSubMesh;
             newSubMesh.material = nowMaterial;
+            // The first definition of a name wins, as with the linear search this replaces.
+            materialIndex.emplace(material, (int)subMeshes.size());
             subMeshes.push_back(newSubMesh);
         }
         else if (nowMaterial && temp == "Ka") {
@@ -240,11 +852,14 @@ bool TriangleMesh::LoadMaterialsFromFile(std::string newFileName)
             std::string texFileName = newFileName;
             texFileName = texFileName.substr(0, lastSlash + 1) + s;  // last slash᭱rssɮתWr
 
-            texture = new ImageTexture(texFileName);
-            nowMaterial->SetMapKd(texture);
+            if (IsCancelled())
+                break;
+            // Materials that name the same image share one texture.
+            nowMaterial->SetMapKd(TextureCache::Acquire(texFileName));
         }
     }
     f.close();
+    return true;
 }
 
 void TriangleMesh::Rendering(SubMesh submesh)
@@ -254,12 +869,23 @@ void TriangleMesh::Rendering(SubMesh submesh)
     glEnableVertexAttribArray(2);
 
     glBindBuffer(GL_ARRAY_BUFFER, vboId);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexPTN), 0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VertexPTN), (const GLvoid*)12);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(VertexPTN), (const GLvoid*)24);
+    if (bufferFormat == VERTEX_FORMAT_PACKED) {
+        // Integers as they are; the vertex shader scales them (see vertexpacking.h).
+        glVertexAttribPointer(0, 3, GL_SHORT, GL_FALSE, sizeof(VertexPacked), 0);
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_FALSE, sizeof(VertexPacked), (const GLvoid*)8);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(VertexPacked), (const GLvoid*)12);
+    }
+    else {
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexPTN), 0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VertexPTN), (const GLvoid*)12);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(VertexPTN), (const GLvoid*)24);
+    }
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, submesh.iboId);
-    glDrawElements(GL_TRIANGLES, (GLsizei)(submesh.vertexIndices.size()), GL_UNSIGNED_INT, 0);
+    if (submesh.baseVertex != 0)
+        glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)(submesh.numUploadedIndices), submesh.indexType, 0, submesh.baseVertex);
+    else
+        glDrawElements(GL_TRIANGLES, (GLsizei)(submesh.numUploadedIndices), submesh.indexType, 0);
 
     glDisableVertexAttribArray(0);
     glDisableVertexAttribArray(1);
@@ -267,16 +893,264 @@ void TriangleMesh::Rendering(SubMesh submesh)
 }
 
 // Create the buffers.
-void TriangleMesh::CreateBuffers() {
+void TriangleMesh::CreateBuffers(TextureUploader* uploader) {
+    // Textures are decoded with the mesh (possibly on a loader thread); upload them here on the GL thread,
+    // or hand them to the uploader so they stream in over the next frames.
+    // Small textures were replaced by their atlas while loading, so they are never uploaded on their own;
+    // their pixels go here, where the GL state ReleaseDecodedLevels() checks is not changing under it.
+    if (!atlasReplacedTextures.empty()) {
+        TextureCache::ReleaseUnusedPixels(atlasReplacedTextures);
+        atlasReplacedTextures.clear();
+    }
+    for (auto& submesh : subMeshes) {
+        if (submesh.material == nullptr || submesh.material->GetMapKd() == nullptr)
+            continue;
+        if (uploader != nullptr)
+            uploader->Enqueue(submesh.material->GetMapKd());
+        else
+            submesh.material->GetMapKd()->Upload();
+    }
+    if (useTextureArrays)
+        CreateTextureArrays();
     glGenBuffers(1, &vboId);
     glBindBuffer(GL_ARRAY_BUFFER, vboId);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(VertexPTN) * numVertices, vertices.data(), GL_STATIC_DRAW);
+    bufferFormat = vertexFormat;
+    if (bufferFormat == VERTEX_FORMAT_PACKED) {
+        std::vector<VertexPacked> packed(vertices.size());
+        PackVertices(vertices.data(), vertices.size(), packed.data(), packedPositionScale, packedPositionOffset, packingError);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(VertexPacked) * packed.size(), packed.data(), GL_STATIC_DRAW);
+    }
+    else {
+        glBufferData(GL_ARRAY_BUFFER, sizeof(VertexPTN) * numVertices, vertices.data(), GL_STATIC_DRAW);
+    }
+    // 16-bit indices wherever the vertices a subMesh uses span fewer than 65536; the draw adds
+    // the first of them back (glDrawElementsBaseVertex) unless it is 0.
+    const bool hasBaseVertex = GLEW_VERSION_3_2 || GLEW_ARB_draw_elements_base_vertex;
+    std::vector<unsigned short> shortIndices;
     for (auto& submesh : subMeshes) {
         glGenBuffers(1, &(submesh.iboId));
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, submesh.iboId);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * submesh.vertexIndices.size(), submesh.vertexIndices.data(), GL_STATIC_DRAW);
+        const auto& indices = submesh.vertexIndices;
+        unsigned int minIndex = 0;
+        unsigned int maxIndex = 0;
+        if (!indices.empty()) {
+            const auto range = std::minmax_element(indices.begin(), indices.end());
+            minIndex = *range.first;
+            maxIndex = *range.second;
+        }
+        if (!hasBaseVertex)
+            minIndex = 0;
+        if (maxIndex - minIndex <= USHRT_MAX) {
+            shortIndices.resize(indices.size());
+            for (size_t i = 0; i < indices.size(); i++)
+                shortIndices[i] = (unsigned short)(indices[i] - minIndex);
+            submesh.indexType = GL_UNSIGNED_SHORT;
+            submesh.baseVertex = (GLint)minIndex;
+            submesh.iboCapacity = sizeof(unsigned short) * indices.size();
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, submesh.iboCapacity, shortIndices.data(), GL_STATIC_DRAW);
+        }
+        else {
+            submesh.indexType = GL_UNSIGNED_INT;
+            submesh.baseVertex = 0;
+            submesh.iboCapacity = sizeof(unsigned int) * indices.size();
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, submesh.iboCapacity, indices.data(), GL_STATIC_DRAW);
+        }
+        submesh.numUploadedIndices = indices.size();
+    }
+}
+
+// Replace the small textures of the materials by one atlas; runs on the loader thread.
+void TriangleMesh::CreateTextureAtlas()
+{
+    if (atlasTextureSize <= 0 || IsCancelled())
+        return;
+    std::vector<ImageTexture*> textures;
+    for (const auto& submesh : subMeshes) {
+        ImageTexture* texture = (submesh.material != nullptr) ? submesh.material->GetMapKd() : nullptr;
+        if (texture != nullptr && texture->IsValid() && std::find(textures.begin(), textures.end(), texture) == textures.end())
+            textures.push_back(texture);
+    }
+    std::vector<ImageTexture*> candidates;
+    for (ImageTexture* texture : textures) {
+        if (!TextureAtlas::IsCandidate(texture, atlasTextureSize))
+            continue;
+        const bool hasArrayPartner = useTextureArrays && std::any_of(textures.begin(), textures.end(), [texture](const ImageTexture* other) {
+            return other != texture && TextureArray::IsCompatible(other, texture);
+        });
+        if (!hasArrayPartner)
+            candidates.push_back(texture);
+    }
+    if (candidates.size() < 2)
+        return;
+
+    std::vector<glm::vec4> regions;
+    textureAtlas = TextureAtlas::Build(candidates, regions);
+    if (textureAtlas == nullptr)
+        return;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        if (regions[i].z > 0.0f)
+            numAtlasTextures++;
+    }
+    // The replaced textures stay in the TextureCache for other models, but lose their pixels in
+    // CreateBuffers() unless something else still uses them.
+    std::vector<bool> replaced(candidates.size(), false);
+    for (auto& submesh : subMeshes) {
+        if (submesh.material == nullptr)
+            continue;
+        const auto it = std::find(candidates.begin(), candidates.end(), submesh.material->GetMapKd());
+        const size_t index = it - candidates.begin();
+        if (it == candidates.end() || regions[index].z <= 0.0f)
+            continue;
+        if (!replaced[index]) {
+            atlasReplacedTextures.push_back(submesh.material->GetMapKdHandle());
+            replaced[index] = true;
+        }
+        submesh.material->SetMapKdRegion(regions[index]);
+        submesh.material->SetMapKd(textureAtlas);
+    }
+}
+
+// Group the subMesh textures that can share a texture array; groups of one stay as they are.
+void TriangleMesh::CreateTextureArrays()
+{
+    GLint maxLayers = 256;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+
+    // Distinct textures by group, in subMesh order.
+    std::vector<std::vector<ImageTexture*>> groups;
+    for (const auto& submesh : subMeshes) {
+        ImageTexture* texture = (submesh.material != nullptr) ? submesh.material->GetMapKd() : nullptr;
+        if (texture == nullptr || !texture->IsValid())
+            continue;
+        auto group = std::find_if(groups.begin(), groups.end(), [texture](const std::vector<ImageTexture*>& textures) {
+            return TextureArray::IsCompatible(textures[0], texture);
+        });
+        if (group == groups.end())
+            groups.push_back(std::vector<ImageTexture*>(1, texture));
+        else if (std::find(group->begin(), group->end(), texture) == group->end())
+            group->push_back(texture);
+    }
+
+    std::unordered_map<ImageTexture*, std::pair<TextureArray*, int>> layers;
+    for (const auto& group : groups) {
+        if (group.size() < 2)
+            continue;
+        TextureArray* textureArray = nullptr;
+        for (ImageTexture* texture : group) {
+            if (textureArray == nullptr || textureArray->GetNumLayers() == maxLayers) {
+                textureArray = new TextureArray();
+                textureArrays.push_back(textureArray);
+            }
+            layers[texture] = std::make_pair(textureArray, textureArray->AddLayer(texture));
+        }
+    }
+    for (auto& submesh : subMeshes) {
+        const auto layer = (submesh.material != nullptr) ? layers.find(submesh.material->GetMapKd()) : layers.end();
+        if (layer == layers.end())
+            continue;
+        submesh.textureArray = layer->second.first;
+        submesh.textureLayer = layer->second.second;
     }
 }
+
+void TriangleMesh::UpdateTextureArrays()
+{
+    for (TextureArray* textureArray : textureArrays)
+        textureArray->Update();
+}
+
+// Grow a buffer object to at least requiredSize bytes, keeping its first usedSize bytes.
+static void ReserveBuffer(GLuint& bufferId, size_t& capacity, const size_t usedSize, const size_t requiredSize)
+{
+    if (bufferId != 0 && requiredSize <= capacity)
+        return;
+    size_t newCapacity = std::max<size_t>(capacity, 64 * 1024);
+    while (newCapacity < requiredSize)
+        newCapacity *= 2;
+
+    GLuint newBufferId = 0;
+    glGenBuffers(1, &newBufferId);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, newBufferId);
+    glBufferData(GL_COPY_WRITE_BUFFER, newCapacity, nullptr, GL_STATIC_DRAW);
+    if (bufferId != 0) {
+        if (usedSize > 0) {
+            glBindBuffer(GL_COPY_READ_BUFFER, bufferId);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedSize);
+        }
+        glDeleteBuffers(1, &bufferId);
+    }
+    bufferId = newBufferId;
+    capacity = newCapacity;
+}
+
+// Start a streamed mesh with room for vertexCapacity vertices.
+void TriangleMesh::BeginStreaming(const size_t vertexCapacity)
+{
+    streaming = true;
+    ReserveBuffer(vboId, vboCapacity, 0, sizeof(VertexPTN) * std::max<size_t>(vertexCapacity, 1));
+}
+
+// Append a batch on the GL thread: only the new vertices and indices are uploaded.
+// The streamed mesh keeps no CPU copy of them.
+void TriangleMesh::AppendBatch(const MeshBatch& batch)
+{
+    // New subMeshes.
+    for (size_t i = subMeshes.size(); i < batch.materials.size(); i++) {
+        SubMesh subMesh;
+        subMesh.material = new PhongMaterial(batch.materials[i]);
+        subMeshes.push_back(subMesh);
+    }
+    // Textures still decoding in the background are uploaded with a later batch.
+    for (auto& subMesh : subMeshes) {
+        if (subMesh.material != nullptr && subMesh.material->GetMapKd() != nullptr)
+            subMesh.material->GetMapKd()->Upload();
+    }
+
+    if (!batch.vertices.empty()) {
+        const size_t usedSize = sizeof(VertexPTN) * numVertices;
+        const size_t batchSize = sizeof(VertexPTN) * batch.vertices.size();
+        ReserveBuffer(vboId, vboCapacity, usedSize, usedSize + batchSize);
+        glBindBuffer(GL_ARRAY_BUFFER, vboId);
+        glBufferSubData(GL_ARRAY_BUFFER, usedSize, batchSize, batch.vertices.data());
+
+        if (numVertices == 0) {
+            streamBoundsMin = batch.boundsMin;
+            streamBoundsMax = batch.boundsMax;
+        }
+        else {
+            streamBoundsMin = glm::min(streamBoundsMin, batch.boundsMin);
+            streamBoundsMax = glm::max(streamBoundsMax, batch.boundsMax);
+        }
+        numVertices += (int)batch.vertices.size();
+    }
+
+    for (size_t i = 0; i < batch.subMeshIndices.size() && i < subMeshes.size(); i++) {
+        const auto& indices = batch.subMeshIndices[i];
+        if (indices.empty())
+            continue;
+        SubMesh& subMesh = subMeshes[i];
+        const size_t usedSize = sizeof(unsigned int) * subMesh.numUploadedIndices;
+        const size_t batchSize = sizeof(unsigned int) * indices.size();
+        ReserveBuffer(subMesh.iboId, subMesh.iboCapacity, usedSize, usedSize + batchSize);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, subMesh.iboId);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, usedSize, batchSize, indices.data());
+        subMesh.numUploadedIndices += indices.size();
+        numTriangles += (int)(indices.size() / 3);
+    }
+}
+
+// The streamed vertices are not normalized yet; move the bounds seen so far into the unit box
+// the way Normalize() will, so the picture does not jump when the finished mesh replaces it.
+glm::mat4x4 TriangleMesh::GetModelMatrix() const
+{
+    if (!streaming || numVertices == 0)
+        return glm::mat4x4(1.0f);
+    const glm::vec3 center = (streamBoundsMin + streamBoundsMax) * 0.5f;
+    const glm::vec3 length = streamBoundsMax - streamBoundsMin;
+    const float maxLength = std::max(length.x, std::max(length.y, length.z));
+    const float scale = maxLength > 0.0f ? 1.0f / maxLength : 1.0f;
+    return glm::scale(glm::mat4x4(1.0f), glm::vec3(scale)) * glm::translate(glm::mat4x4(1.0f), -center);
+}
 // Release the buffers.
 void TriangleMesh::ReleaseBuffers() {
     glDeleteBuffers(1, &vboId);
@@ -287,9 +1161,59 @@ void TriangleMesh::ReleaseBuffers() {
 // Show model information.
 void TriangleMesh::ShowInfo()
 {
-	std::cout << "# Vertices: " << numVertices << std::endl;
+	std::cout << "# Vertices: " << numVertices;
+	if (numVerticesBeforeWeld != numVertices)
+		std::cout << " (" << numVerticesBeforeWeld << " before welding)";
+	std::cout << std::endl;
 	std::cout << "# Triangles: " << numTriangles << std::endl;
+	if (bufferFormat == VERTEX_FORMAT_PACKED) {
+		std::cout << "Packed vertices: " << sizeof(VertexPacked) << " instead of " << sizeof(VertexPTN) << " bytes ("
+				  << (sizeof(VertexPTN) - sizeof(VertexPacked)) * vertices.size() / 1024 << " KB saved); max error: position "
+				  << packingError.position << ", normal " << packingError.normalDegrees << " degrees, texcoord "
+				  << packingError.texcoord << std::endl;
+	}
+	if (vertexCacheBefore.numTriangles > 0) {
+		std::cout << std::fixed << std::setprecision(3) << "Vertex cache (" << VERTEX_CACHE_ANALYSIS_SIZE << " entries): ACMR "
+				  << vertexCacheBefore.GetAcmr() << ", ATVR " << vertexCacheBefore.GetAtvr();
+		if (vertexCacheAfter.numMisses != vertexCacheBefore.numMisses)
+			std::cout << " as loaded; ACMR " << vertexCacheAfter.GetAcmr() << ", ATVR " << vertexCacheAfter.GetAtvr() << " reordered";
+		std::cout << std::defaultfloat << std::endl;
+	}
+	if (overdrawBefore.numCovered > 0) {
+		std::cout << std::fixed << std::setprecision(3) << "Overdraw (6 views, " << OVERDRAW_GRID_SIZE << " x " << OVERDRAW_GRID_SIZE
+				  << "): " << overdrawBefore.GetOverdraw() << " as loaded, " << overdrawAfter.GetOverdraw() << " reordered"
+				  << std::defaultfloat << std::endl;
+	}
+	if (vertexFetchBefore.numBytesUsed > 0) {
+		std::cout << std::fixed << std::setprecision(3) << "Vertex fetch (" << VERTEX_FETCH_LINE_SIZE << "-byte lines): "
+				  << vertexFetchBefore.GetOverfetch() << " bytes fetched per byte used before sorting the vertices, "
+				  << vertexFetchAfter.GetOverfetch() << " after" << std::defaultfloat << std::endl;
+	}
 	std::cout << "Total " << subMeshes.size() << " subMeshes loaded" << std::endl;
+	if (!textureArrays.empty()) {
+		int numLayers = 0;
+		for (const TextureArray* textureArray : textureArrays)
+			numLayers += textureArray->GetNumLayers();
+		std::cout << numLayers << " textures packed into " << textureArrays.size() << " texture arrays" << std::endl;
+	}
+	if (textureAtlas != nullptr) {
+		std::cout << numAtlasTextures << " textures packed into a " << textureAtlas->GetWidth() << " x "
+				  << textureAtlas->GetHeight() << " atlas" << std::endl;
+	}
+	size_t indexBytes = 0;
+	size_t savedIndexBytes = 0;
+	int numShortIndexSubMeshes = 0;
+	for (const auto& submesh : subMeshes) {
+		indexBytes += submesh.iboCapacity;
+		if (submesh.indexType == GL_UNSIGNED_SHORT) {
+			savedIndexBytes += (sizeof(unsigned int) - sizeof(unsigned short)) * submesh.vertexIndices.size();
+			numShortIndexSubMeshes++;
+		}
+	}
+	if (numShortIndexSubMeshes > 0) {
+		std::cout << "Index buffers: " << indexBytes / 1024 << " KB, 16-bit in " << numShortIndexSubMeshes << " of "
+				  << subMeshes.size() << " subMeshes (" << savedIndexBytes / 1024 << " KB saved)" << std::endl;
+	}
 	for (unsigned int i = 0; i < subMeshes.size(); ++i) {
 		const SubMesh& g = subMeshes[i];
 		std::cout << "SubMesh " << i << " with material: " << g.material->GetName() << std::endl;
@@ -3,6 +3,13 @@
 
 #include "headers.h"
 #include "material.h"
+#include "vertexcache.h"
+
+class MeshStream;
+struct MeshBatch;
+struct MeshLoadOptions;
+class TextureUploader;
+class TextureArray;
 
 // VertexPTN Declarations.
 struct VertexPTN
@@ -22,16 +29,79 @@ struct VertexPTN
 	glm::vec2 texcoord;
 };
 
+// Vertex layouts of the VBO (see SetVertexFormat).
+//   FLOAT: VertexPTN as it is, 32 bytes.
+//   PACKED: VertexPacked, 16 bytes, decoded in the vertex shader.
+enum VertexFormat
+{
+	VERTEX_FORMAT_FLOAT,
+	VERTEX_FORMAT_PACKED,
+};
+
+// VertexPacked Declarations.
+// VertexPTN quantized to 16 bytes (see vertexpacking.h).
+struct VertexPacked
+{
+	// Position in the mesh's bounding box: offset + position * scale, as 16-bit integers
+	// (w is padding).
+	short position[4];
+	// Unit normal, octahedral-encoded as two 16-bit integers in [-32767, 32767].
+	short normal[2];
+	// Texcoord as two half floats.
+	unsigned int texcoord;
+};
+
+// Largest differences between VertexPTNs and their packed versions.
+struct VertexPackingError
+{
+	VertexPackingError() : position(0.0f), normalDegrees(0.0f), texcoord(0.0f) {}
+	// Distance in model units.
+	float position;
+	// Angle between the normals.
+	float normalDegrees;
+	// Largest difference of either coordinate.
+	float texcoord;
+};
+
+// Fragments of a headless render that passed the depth test, and pixels they covered (see
+// AnalyzeOverdraw).
+struct OverdrawStats
+{
+	OverdrawStats() : numCovered(0), numShaded(0) {}
+	// Shaded fragments per covered pixel; 1 means no overdraw.
+	float GetOverdraw() const { return numCovered > 0 ? (float)numShaded / numCovered : 0.0f; }
+	unsigned long long numCovered;
+	unsigned long long numShaded;
+};
+
 // SubMesh Declarations.
 struct SubMesh
 {
 	SubMesh() {
 		material = nullptr;
 		iboId = 0;
+		iboCapacity = 0;
+		numUploadedIndices = 0;
+		indexType = GL_UNSIGNED_INT;
+		baseVertex = 0;
+		textureArray = nullptr;
+		textureLayer = -1;
 	}
 	PhongMaterial* material;
 	GLuint iboId;
+	// Size of the IBO in bytes; a streamed subMesh grows it as batches arrive.
+	size_t iboCapacity;
+	// Indices in the IBO; Rendering() draws only these.
+	size_t numUploadedIndices;
+	// GL_UNSIGNED_SHORT if the IBO holds 16-bit indices relative to baseVertex (see
+	// CreateBuffers), otherwise GL_UNSIGNED_INT and baseVertex 0.
+	GLenum indexType;
+	GLint baseVertex;
 	std::vector<unsigned int> vertexIndices;
+	// Array that holds the material's texture as layer textureLayer (nullptr if none; the
+	// texture is bound on its own until the array is ready).
+	TextureArray* textureArray;
+	int textureLayer;
 };
 
 
@@ -43,7 +113,7 @@ public:
 	TriangleMesh();
 	~TriangleMesh();
 	
-	// Load the model from an *.OBJ file.
+	// Load the model from an *.OBJ or *.OBJM file.
 	bool LoadFromFile(const std::string& filePath, const bool normalized = true);
 	
 	// Show model information.
@@ -52,26 +122,102 @@ public:
 	// -------------------------------------------------------
 	// Feel free to add your methods or data here.
 	void Normalize();
+	// Merge duplicated vertices into the first of them. With epsilon 0 all attributes must match
+	// exactly; with a positive epsilon the positions may be up to epsilon apart (in model units),
+	// the normals and texcoords only by a small fixed tolerance. That weld is greedy: a vertex
+	// joins the nearest earlier survivor, which keeps its own attributes, and a vertex with a
+	// position that is not finite never merges.
+	void WeldVertices(const float epsilon = 0.0f);
+	// Sort the vertex array by first use in the subMesh index lists and drop unused vertices.
+	void OptimizeVertexFetch();
 	// -------------------------------------------------------
+	// Textures are decoded in the background; LoadFromFile() waits for them before it returns.
 	bool LoadMaterialsFromFile(std::string);
+	void WaitForTextures();
 	const std::vector<SubMesh>& GetSubMeshes() const { return subMeshes; }
 	// -------------------------------------------------------
 
 	void Rendering(SubMesh);
-	void CreateBuffers();
+	// Textures go through the uploader if one is given, otherwise they are uploaded right away.
+	void CreateBuffers(TextureUploader* uploader = nullptr);
 	void ReleaseBuffers();
+	// Build the texture arrays whose layers have all arrived; called once per frame on the GL thread.
+	void UpdateTextureArrays();
 	// -------------------------------------------------------
 
+	// Print the parse throughput (MB/s) after each LoadFromFile.
+	void SetReportLoadStats(const bool report) { reportLoadStats = report; }
+	// Number of threads used to parse large files (0 = one per core, 1 = serial).
+	void SetNumLoadThreads(const int n) { numLoadThreads = n; }
+	// Weld duplicated vertices after parsing (on by default, exact matches only; a positive
+	// epsilon also merges positions up to that far apart, see WeldVertices).
+	void SetWeldVertices(const bool weld, const float epsilon = 0.0f) { weldVertices = weld; weldEpsilon = epsilon; }
+	// Reorder the triangles of each subMesh for the post-transform vertex cache after loading
+	// (on by default). The cache file holds the reordered indices.
+	void SetOptimizeVertexCache(const bool optimize) { optimizeVertexCache = optimize; }
+	// Then reorder clusters of them against overdraw (on by default), letting the vertex cache
+	// miss rate grow by up to acmrThreshold (see OptimizeOverdraw). The overdraw is measured
+	// before and after, which costs a few software-rendered views on the first load.
+	void SetOptimizeOverdraw(const bool optimize, const float acmrThreshold = 1.05f) { optimizeOverdraw = optimize; overdrawThreshold = acmrThreshold; }
+	// Finally run OptimizeVertexFetch() (on by default).
+	void SetOptimizeVertexFetch(const bool optimize) { optimizeVertexFetch = optimize; }
+	// Reuse / write the "<model>.meshcache" sidecar file (on by default).
+	void SetUseCache(const bool use) { useCache = use; }
+	// Pack same-sized textures into texture arrays in CreateBuffers() (on by default).
+	void SetUseTextureArrays(const bool use) { useTextureArrays = use; }
+	// Vertex layout CreateBuffers() uploads (VERTEX_FORMAT_FLOAT by default). Streamed meshes
+	// always use VERTEX_FORMAT_FLOAT.
+	void SetVertexFormat(const VertexFormat format) { vertexFormat = format; }
+	// Layout of the VBO, and the transform the vertex shader decodes packed positions with.
+	VertexFormat GetBufferFormat() const { return bufferFormat; }
+	glm::vec3 GetPackedPositionScale() const { return packedPositionScale; }
+	glm::vec3 GetPackedPositionOffset() const { return packedPositionOffset; }
+	// Pack textures no larger than maxTextureSize on either side into one atlas at the end of LoadFromFile()
+	// (TextureAtlas::DEFAULT_MAX_TEXTURE_SIZE by default; 0 = off). Textures that can share a
+	// texture array with another one are left to it.
+	void SetTextureAtlasSize(const int maxTextureSize) { atlasTextureSize = maxTextureSize; }
+	// Abort LoadFromFile (it returns false) as soon as the flag is set; used by ModelLoader.
+	void SetCancelFlag(const std::atomic<bool>* flag) { cancelFlag = flag; }
+	bool IsCancelled() const { return cancelFlag != nullptr && cancelFlag->load(); }
+	// Publish the geometry to a MeshStream as it is parsed (nullptr = off); used by ModelLoader.
+	// The file is then parsed in small waves, and faces may only use earlier vertex data.
+	void SetStream(MeshStream* meshStream) { stream = meshStream; }
+
+	// Progressive display: start as an empty mesh that grows by the batches of a MeshStream.
+	// The VBO is preallocated for vertexCapacity vertices and grows when it runs out.
+	void BeginStreaming(const size_t vertexCapacity);
+	void AppendBatch(const MeshBatch& batch);
+	bool IsStreaming() const { return streaming; }
+	// Transform to draw the mesh with: identity, or while streaming the normalization
+	// LoadFromFile() will apply, based on the bounds of the batches seen so far.
+	glm::mat4x4 GetModelMatrix() const;
+
 	int GetNumVertices() const { return numVertices; }
 	int GetNumTriangles() const { return numTriangles; }
 	int GetNumSubMeshes() const { return (int)subMeshes.size(); }
 
 	glm::vec3 GetObjCenter() const { return objCenter; }
 	glm::vec3 GetObjExtent() const { return objExtent; }
+	// Measurements of the index order as loaded and as drawn (see OptimizeIndexOrder).
+	const VertexCacheStats& GetVertexCacheBefore() const { return vertexCacheBefore; }
+	const VertexCacheStats& GetVertexCacheAfter() const { return vertexCacheAfter; }
+	const OverdrawStats& GetOverdrawBefore() const { return overdrawBefore; }
+	const OverdrawStats& GetOverdrawAfter() const { return overdrawAfter; }
+	// Vertex fetch traffic before and after the last OptimizeVertexFetch().
+	const VertexFetchStats& GetVertexFetchBefore() const { return vertexFetchBefore; }
+	const VertexFetchStats& GetVertexFetchAfter() const { return vertexFetchAfter; }
 
 private:
 	// -------------------------------------------------------
 	// Feel free to add your methods or data here.
+	int AddDefaultSubMesh();
+	MeshLoadOptions GetLoadOptions(const bool normalized) const;
+	bool LoadFromCache(const std::string& filePath, const MeshLoadOptions& loadOptions);
+	bool SaveToCache(const std::string& filePath, const MeshLoadOptions& loadOptions) const;
+	void PublishBatch(const size_t firstVertex, const std::vector<size_t>& firstIndices);
+	void OptimizeIndexOrder();
+	void CreateTextureAtlas();
+	void CreateTextureArrays();
 	// -------------------------------------------------------
 
 	// TriangleMesh Private Data.
@@ -82,11 +228,59 @@ private:
 	// GLuint iboId;
 	// std::vector<unsigned int> vertexIndices;
 	std::vector<SubMesh> subMeshes;
+	// Texture arrays the subMeshes sample from (see CreateTextureArrays).
+	std::vector<TextureArray*> textureArrays;
+	// Atlas of the small textures (see CreateTextureAtlas), and how many it holds.
+	std::shared_ptr<ImageTexture> textureAtlas;
+	int numAtlasTextures;
+	// Textures the atlas replaced; CreateBuffers() frees their pixels on the GL thread.
+	std::vector<std::weak_ptr<ImageTexture>> atlasReplacedTextures;
+	// Material name -> index of its subMesh, filled by LoadMaterialsFromFile.
+	std::unordered_map<std::string, int> materialIndex;
+
+	bool reportLoadStats;
+	int numLoadThreads;
+	bool weldVertices;
+	float weldEpsilon;
+	bool useCache;
+	bool optimizeVertexCache;
+	bool optimizeOverdraw;
+	float overdrawThreshold;
+	bool optimizeVertexFetch;
+	bool useTextureArrays;
+	VertexFormat vertexFormat;
+	int atlasTextureSize;
+	const std::atomic<bool>* cancelFlag;
+	MeshStream* stream;
+	// Material libraries the model pulled in; the cache depends on them too.
+	std::vector<std::string> materialLibraries;
+
+	// Packed vertex state (see SetVertexFormat).
+	VertexFormat bufferFormat;
+	glm::vec3 packedPositionScale;
+	glm::vec3 packedPositionOffset;
+	VertexPackingError packingError;
+
+	// Progressive display state (see BeginStreaming).
+	bool streaming;
+	size_t vboCapacity;
+	glm::vec3 streamBoundsMin;
+	glm::vec3 streamBoundsMax;
 
 	int numVertices;
+	int numVerticesBeforeWeld;
 	int numTriangles;
 	glm::vec3 objCenter;
 	glm::vec3 objExtent;
+	// Vertex cache efficiency of the index order as loaded and after OptimizeIndexOrder().
+	VertexCacheStats vertexCacheBefore;
+	VertexCacheStats vertexCacheAfter;
+	// Overdraw of the same two orders; zero unless the overdraw optimization ran.
+	OverdrawStats overdrawBefore;
+	OverdrawStats overdrawAfter;
+	// Vertex fetch traffic of VertexPTNs before and after OptimizeVertexFetch().
+	VertexFetchStats vertexFetchBefore;
+	VertexFetchStats vertexFetchAfter;
 };
 
 
@@ -0,0 +1,196 @@
+#include "vertexcache.h"
+
+// Forsyth's simulated LRU cache and scoring constants.
+static const int OPTIMIZER_CACHE_SIZE = 32;
+static const float CACHE_DECAY_POWER = 1.5f;
+static const float LAST_TRIANGLE_SCORE = 0.75f;
+static const float VALENCE_BOOST_SCALE = 2.0f;
+static const float VALENCE_BOOST_POWER = 0.5f;
+// Remaining-triangle counts up to this have their own score; higher ones share the last.
+static const int MAX_VALENCE_SCORE = 32;
+
+// Vertex scores by cache position and by remaining triangles.
+struct VertexScoreTables
+{
+	VertexScoreTables() {
+		for (int i = 0; i < OPTIMIZER_CACHE_SIZE; i++) {
+			if (i < 3) {
+				// The corners of the last triangle: using them again gains little on a real cache.
+				cacheScore[i] = LAST_TRIANGLE_SCORE;
+			}
+			else {
+				const float scaler = 1.0f / (OPTIMIZER_CACHE_SIZE - 3);
+				cacheScore[i] = std::pow(1.0f - (i - 3) * scaler, CACHE_DECAY_POWER);
+			}
+		}
+		valenceScore[0] = 0.0f;
+		for (int i = 1; i <= MAX_VALENCE_SCORE; i++)
+			valenceScore[i] = VALENCE_BOOST_SCALE * std::pow((float)i, -VALENCE_BOOST_POWER);
+	}
+	float cacheScore[OPTIMIZER_CACHE_SIZE];
+	float valenceScore[MAX_VALENCE_SCORE + 1];
+};
+
+VertexCacheStats AnalyzeVertexCache(const unsigned int* indices, const size_t numIndices)
+{
+	VertexCacheStats stats;
+	stats.numTriangles = numIndices / 3;
+	// Time each vertex entered the cache; it is still there while fewer than SIZE misses followed.
+	std::unordered_map<unsigned int, unsigned long long> entered;
+	entered.reserve(numIndices / 2);
+	for (size_t i = 0; i < numIndices; i++) {
+		const auto it = entered.find(indices[i]);
+		if (it == entered.end()) {
+			entered.emplace(indices[i], stats.numMisses);
+			stats.numMisses++;
+		}
+		else if (stats.numMisses - it->second >= VERTEX_CACHE_ANALYSIS_SIZE) {
+			it->second = stats.numMisses;
+			stats.numMisses++;
+		}
+	}
+	stats.numVertices = entered.size();
+	return stats;
+}
+
+VertexFetchStats AnalyzeVertexFetch(const unsigned int* indices, const size_t numIndices, const size_t numVertices, const size_t vertexSize)
+{
+	VertexFetchStats stats;
+	// Line address + 1 held by each cache line (0 = empty).
+	std::vector<unsigned long long> lines(VERTEX_FETCH_CACHE_SIZE / VERTEX_FETCH_LINE_SIZE, 0);
+	std::vector<bool> used(numVertices, false);
+	for (size_t i = 0; i < numIndices; i++) {
+		const unsigned int index = indices[i];
+		if (!used[index]) {
+			used[index] = true;
+			stats.numBytesUsed += vertexSize;
+		}
+		const unsigned long long first = (unsigned long long)index * vertexSize / VERTEX_FETCH_LINE_SIZE;
+		const unsigned long long last = ((unsigned long long)index * vertexSize + vertexSize - 1) / VERTEX_FETCH_LINE_SIZE;
+		for (unsigned long long line = first; line <= last; line++) {
+			unsigned long long& cached = lines[line % lines.size()];
+			if (cached != line + 1) {
+				cached = line + 1;
+				stats.numBytesFetched += VERTEX_FETCH_LINE_SIZE;
+			}
+		}
+	}
+	return stats;
+}
+
+void OptimizeVertexCache(unsigned int* indices, const size_t numIndices)
+{
+	static const VertexScoreTables tables;
+	const size_t numTriangles = numIndices / 3;
+	if (numTriangles < 2)
+		return;
+
+	// Local vertex numbers, so the work is proportional to the list rather than the mesh.
+	std::vector<unsigned int> vertexIds(indices, indices + numTriangles * 3);
+	std::sort(vertexIds.begin(), vertexIds.end());
+	vertexIds.erase(std::unique(vertexIds.begin(), vertexIds.end()), vertexIds.end());
+	const size_t numVertices = vertexIds.size();
+	std::vector<unsigned int> corners(numTriangles * 3);
+	for (size_t i = 0; i < corners.size(); i++)
+		corners[i] = (unsigned int)(std::lower_bound(vertexIds.begin(), vertexIds.end(), indices[i]) - vertexIds.begin());
+
+	// Triangles of each vertex; the first numActive[v] entries are the ones not emitted yet.
+	std::vector<unsigned int> firstTriangle(numVertices + 1, 0);
+	for (const unsigned int v : corners)
+		firstTriangle[v + 1]++;
+	for (size_t v = 0; v < numVertices; v++)
+		firstTriangle[v + 1] += firstTriangle[v];
+	std::vector<unsigned int> vertexTriangles(corners.size());
+	std::vector<unsigned int> numActive(numVertices, 0);
+	for (size_t t = 0; t < numTriangles; t++) {
+		for (int k = 0; k < 3; k++) {
+			const unsigned int v = corners[t * 3 + k];
+			vertexTriangles[firstTriangle[v] + numActive[v]++] = (unsigned int)t;
+		}
+	}
+
+	std::vector<int> cachePosition(numVertices, -1);
+	std::vector<float> vertexScore(numVertices);
+	auto scoreVertex = [&](const unsigned int v) {
+		if (numActive[v] == 0)
+			return -1.0f;
+		const float cache = (cachePosition[v] >= 0) ? tables.cacheScore[cachePosition[v]] : 0.0f;
+		return cache + tables.valenceScore[std::min<unsigned int>(numActive[v], MAX_VALENCE_SCORE)];
+	};
+	for (size_t v = 0; v < numVertices; v++)
+		vertexScore[v] = scoreVertex((unsigned int)v);
+	std::vector<float> triangleScore(numTriangles);
+	std::vector<bool> emitted(numTriangles, false);
+	for (size_t t = 0; t < numTriangles; t++)
+		triangleScore[t] = vertexScore[corners[t * 3]] + vertexScore[corners[t * 3 + 1]] + vertexScore[corners[t * 3 + 2]];
+
+	int cache[OPTIMIZER_CACHE_SIZE + 3];
+	int cacheSize = 0;
+	size_t scanCursor = 0;
+	size_t best = (size_t)(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+	std::vector<unsigned int> output;
+	output.reserve(numTriangles * 3);
+	for (size_t n = 0; n < numTriangles; n++) {
+		if (best == numTriangles) {
+			// Nothing around the cache is left; take the next triangle not emitted yet.
+			while (emitted[scanCursor])
+				scanCursor++;
+			best = scanCursor;
+		}
+		emitted[best] = true;
+		for (int k = 0; k < 3; k++)
+			output.push_back(indices[best * 3 + k]);
+
+		// Retire the triangle from its corners, and move them to the front of the cache.
+		int newCache[OPTIMIZER_CACHE_SIZE + 3];
+		int newCacheSize = 0;
+		for (int k = 0; k < 3; k++) {
+			const unsigned int v = corners[best * 3 + k];
+			unsigned int* triangles = vertexTriangles.data() + firstTriangle[v];
+			for (unsigned int i = 0; i < numActive[v]; i++) {
+				if (triangles[i] == best) {
+					std::swap(triangles[i], triangles[numActive[v] - 1]);
+					break;
+				}
+			}
+			numActive[v]--;
+			newCache[newCacheSize++] = (int)v;
+		}
+		for (int i = 0; i < cacheSize; i++) {
+			const int v = cache[i];
+			if (v != newCache[0] && v != newCache[1] && v != newCache[2])
+				newCache[newCacheSize++] = v;
+		}
+
+		// Rescore the cached vertices; the ones pushed out fall back to their valence score.
+		for (int i = 0; i < newCacheSize; i++) {
+			const unsigned int v = (unsigned int)newCache[i];
+			cachePosition[v] = (i < OPTIMIZER_CACHE_SIZE) ? i : -1;
+			const float score = scoreVertex(v);
+			const float delta = score - vertexScore[v];
+			vertexScore[v] = score;
+			const unsigned int* triangles = vertexTriangles.data() + firstTriangle[v];
+			for (unsigned int j = 0; j < numActive[v]; j++)
+				triangleScore[triangles[j]] += delta;
+		}
+		cacheSize = std::min(newCacheSize, OPTIMIZER_CACHE_SIZE);
+		std::copy(newCache, newCache + cacheSize, cache);
+
+		// Only once every score is final, pick the best triangle around the cached vertices;
+		// a triangle with two or three cached corners would otherwise be judged half-updated.
+		float bestScore = -1.0f;
+		best = numTriangles;
+		for (int i = 0; i < cacheSize; i++) {
+			const unsigned int v = (unsigned int)cache[i];
+			const unsigned int* triangles = vertexTriangles.data() + firstTriangle[v];
+			for (unsigned int j = 0; j < numActive[v]; j++) {
+				const unsigned int t = triangles[j];
+				if (triangleScore[t] > bestScore) {
+					bestScore = triangleScore[t];
+					best = t;
+				}
+			}
+		}
+	}
+	std::copy(output.begin(), output.end(), indices);
+}
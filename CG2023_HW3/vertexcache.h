@@ -0,0 +1,53 @@
+#ifndef VERTEX_CACHE_H
+#define VERTEX_CACHE_H
+
+#include "headers.h"
+
+// Post-transform vertex cache optimization of triangle lists.
+// The GPU keeps the shaded results of the last few vertices; a triangle whose corners are still
+// there costs no vertex shader invocations. OptimizeVertexCache() reorders triangles with Tom
+// Forsyth's linear-speed algorithm: it greedily emits the triangle whose corners score highest,
+// where a corner scores for sitting in a simulated 32-entry LRU cache and for having few
+// triangles left (so lone triangles are not stranded). The triangles keep their corner order,
+// so winding and the vertex data are untouched.
+
+// Vertex cache misses of a triangle list, on a FIFO cache of VERTEX_CACHE_ANALYSIS_SIZE entries.
+//   ACMR: misses per triangle (0.5 is the ideal for large regular meshes, 3 the worst).
+//   ATVR: misses per distinct vertex (1 is the ideal).
+const int VERTEX_CACHE_ANALYSIS_SIZE = 16;
+
+struct VertexCacheStats
+{
+	VertexCacheStats() : numTriangles(0), numVertices(0), numMisses(0) {}
+	float GetAcmr() const { return numTriangles > 0 ? (float)numMisses / numTriangles : 0.0f; }
+	float GetAtvr() const { return numVertices > 0 ? (float)numMisses / numVertices : 0.0f; }
+	// Sums, so the stats of several lists add up.
+	unsigned long long numTriangles;
+	unsigned long long numVertices;
+	unsigned long long numMisses;
+};
+
+// Memory traffic of the vertex fetches of an index list, on a direct-mapped cache of
+// VERTEX_FETCH_CACHE_SIZE bytes (about a GPU's L1) in lines of VERTEX_FETCH_LINE_SIZE bytes. Overfetch is the
+// bytes fetched per byte of the vertices used (1 is the ideal; vertices scattered over the
+// array cost a whole line each).
+const int VERTEX_FETCH_LINE_SIZE = 64;
+const int VERTEX_FETCH_CACHE_SIZE = 16 * 1024;
+
+struct VertexFetchStats
+{
+	VertexFetchStats() : numBytesFetched(0), numBytesUsed(0) {}
+	float GetOverfetch() const { return numBytesUsed > 0 ? (float)numBytesFetched / numBytesUsed : 0.0f; }
+	// Sums, so the stats of several lists add up.
+	unsigned long long numBytesFetched;
+	unsigned long long numBytesUsed;
+};
+
+// Simulate the cache over numIndices indices (a multiple of 3).
+VertexCacheStats AnalyzeVertexCache(const unsigned int* indices, const size_t numIndices);
+// Simulate the fetches of numIndices indices into an array of numVertices vertices of vertexSize bytes.
+VertexFetchStats AnalyzeVertexFetch(const unsigned int* indices, const size_t numIndices, const size_t numVertices, const size_t vertexSize);
+// Reorder the triangles of numIndices indices (a multiple of 3) in place.
+void OptimizeVertexCache(unsigned int* indices, const size_t numIndices);
+
+#endif
@@ -0,0 +1,81 @@
+#include "vertexpacking.h"
+#include <packing.hpp>
+
+// Largest magnitude of the 16-bit integers.
+static const float SNORM16_MAX = 32767.0f;
+
+static inline float SignNotZero(const float value)
+{
+	return (value >= 0.0f) ? 1.0f : -1.0f;
+}
+
+glm::vec2 EncodeOctahedral(const glm::vec3& normal)
+{
+	const float sum = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+	if (sum <= 0.0f)
+		return glm::vec2(0.0f, 0.0f);
+	glm::vec2 encoded = glm::vec2(normal.x, normal.y) / sum;
+	// Fold the lower hemisphere over the diagonals.
+	if (normal.z < 0.0f)
+		encoded = glm::vec2((1.0f - std::fabs(encoded.y)) * SignNotZero(encoded.x), (1.0f - std::fabs(encoded.x)) * SignNotZero(encoded.y));
+	return encoded;
+}
+
+glm::vec3 DecodeOctahedral(const glm::vec2& encoded)
+{
+	glm::vec3 normal(encoded.x, encoded.y, 1.0f - std::fabs(encoded.x) - std::fabs(encoded.y));
+	const float t = std::max(-normal.z, 0.0f);
+	normal.x += (normal.x >= 0.0f) ? -t : t;
+	normal.y += (normal.y >= 0.0f) ? -t : t;
+	return glm::normalize(normal);
+}
+
+static inline short QuantizeSnorm16(const float value)
+{
+	return (short)std::lround(glm::clamp(value, -1.0f, 1.0f) * SNORM16_MAX);
+}
+
+void PackVertices(const VertexPTN* vertices, const size_t count, VertexPacked* packed,
+				  glm::vec3& scale, glm::vec3& offset, VertexPackingError& error)
+{
+	glm::vec3 boundsMin(0.0f);
+	glm::vec3 boundsMax(0.0f);
+	for (size_t i = 0; i < count; i++) {
+		boundsMin = (i == 0) ? vertices[i].position : glm::min(boundsMin, vertices[i].position);
+		boundsMax = (i == 0) ? vertices[i].position : glm::max(boundsMax, vertices[i].position);
+	}
+	offset = (boundsMin + boundsMax) * 0.5f;
+	glm::vec3 halfExtent = (boundsMax - boundsMin) * 0.5f;
+	for (int axis = 0; axis < 3; axis++) {
+		if (halfExtent[axis] <= 0.0f)
+			halfExtent[axis] = 1.0f;
+	}
+	scale = halfExtent / SNORM16_MAX;
+
+	error = VertexPackingError();
+	float minNormalCos = 1.0f;
+	for (size_t i = 0; i < count; i++) {
+		const VertexPTN& vertex = vertices[i];
+		VertexPacked& out = packed[i];
+		const glm::vec3 position = (vertex.position - offset) / halfExtent;
+		for (int axis = 0; axis < 3; axis++)
+			out.position[axis] = QuantizeSnorm16(position[axis]);
+		out.position[3] = 0;
+		const glm::vec2 encoded = EncodeOctahedral(vertex.normal);
+		out.normal[0] = QuantizeSnorm16(encoded.x);
+		out.normal[1] = QuantizeSnorm16(encoded.y);
+		out.texcoord = glm::packHalf2x16(vertex.texcoord);
+
+		// Decode as the vertex shader does.
+		const glm::vec3 decodedPosition = offset + glm::vec3(out.position[0], out.position[1], out.position[2]) * scale;
+		error.position = std::max(error.position, glm::distance(decodedPosition, vertex.position));
+		const float length = glm::length(vertex.normal);
+		if (length > 0.0f) {
+			const glm::vec3 decodedNormal = DecodeOctahedral(glm::vec2(out.normal[0], out.normal[1]) / SNORM16_MAX);
+			minNormalCos = std::min(minNormalCos, glm::dot(decodedNormal, vertex.normal / length));
+		}
+		const glm::vec2 texcoordError = glm::abs(glm::unpackHalf2x16(out.texcoord) - vertex.texcoord);
+		error.texcoord = std::max(error.texcoord, std::max(texcoordError.x, texcoordError.y));
+	}
+	error.normalDegrees = glm::degrees(std::acos(glm::clamp(minNormalCos, -1.0f, 1.0f)));
+}
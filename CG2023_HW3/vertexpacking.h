@@ -0,0 +1,23 @@
+#ifndef VERTEX_PACKING_H
+#define VERTEX_PACKING_H
+
+#include "headers.h"
+#include "trianglemesh.h"
+
+// Quantization of VertexPTN into VertexPacked.
+// Positions become 16-bit integers across the bounding box of all vertices, so their error is
+// at most half a step (a step is 1/65534 of the box) on each axis, normalized or not. Normals are mapped
+// onto an octahedron and its faces unfolded into a square, whose two coordinates are stored as
+// 16-bit integers (a few hundredths of a degree of error). Texcoords become half floats, which keep 11
+// significant bits: within [0, 1] the error is below 1/4096. The vertex shader reverses all three.
+
+// Octahedral encoding of a unit vector, and its inverse; both coordinates are in [-1, 1].
+glm::vec2 EncodeOctahedral(const glm::vec3& normal);
+glm::vec3 DecodeOctahedral(const glm::vec2& encoded);
+
+// Pack count vertices; a packed position p decodes to offset + p * scale. The largest
+// deviation of the decoded vertices from the input goes to error.
+void PackVertices(const VertexPTN* vertices, const size_t count, VertexPacked* packed,
+				  glm::vec3& scale, glm::vec3& offset, VertexPackingError& error);
+
+#endif
@@ -0,0 +1,553 @@
+// LoaderBench: measures the model loading path without a GL context.
+//
+// Runs TriangleMesh::LoadFromFile, LoadMaterialsFromFile and Normalize over every
+// *.obj / *.objm file below the test model folder, and over synthetic OBJ/OBJM grids of
+// 1M to 50M triangles, then prints one JSON document with the wall time, throughput,
+// peak resident set size and heap allocations of every stage, and the vertex cache miss rate
+// (ACMR) and overdraw of each model's triangle order before and after the load-time reordering,
+// and its vertex fetch overfetch before and after the vertices are sorted by first use.
+//
+// Usage: LoaderBench [--models <dir>] [--data <dir>] [--sizes 1000000,5000000,...]
+//                    [--threads <n>] [--repeat <n>] [--no-synthetic] [--out <file.json>]
+//
+// Synthetic files are generated once into the data folder and reused; the 50M-triangle
+// OBJM file alone takes about 12 GB, so pass smaller --sizes on machines without the room.
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "headers.h"
+#include "trianglemesh.h"
+#include "texturecache.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstdio>
+
+// ------------------------------------------------------------------------------------------------
+// Allocation counting: every global new/delete in the process goes through these.
+
+static std::atomic<unsigned long long> numAllocations(0);
+static std::atomic<unsigned long long> numAllocatedBytes(0);
+
+void* operator new(size_t size)
+{
+	numAllocations.fetch_add(1, std::memory_order_relaxed);
+	numAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+	if (void* p = std::malloc(size > 0 ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+// Start measuring the peak resident set size anew; false where the OS only keeps the high-water
+// mark of the whole process (Windows, macOS), so a stage also reports the peaks before it.
+static bool ResetPeakRss()
+{
+#ifdef __linux__
+	std::ofstream clearRefs("/proc/self/clear_refs");
+	clearRefs << "5";
+	clearRefs.close();
+	return !clearRefs.fail();
+#else
+	return false;
+#endif
+}
+
+// Peak resident set size since the last ResetPeakRss(), or of the process so far, in bytes.
+static unsigned long long GetPeakRss()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return (unsigned long long)counters.PeakWorkingSetSize;
+	return 0;
+#else
+#ifdef __linux__
+	// VmHWM follows clear_refs; the rusage maximum below does not.
+	std::ifstream status("/proc/self/status");
+	std::string line;
+	while (std::getline(status, line)) {
+		if (line.compare(0, 6, "VmHWM:") == 0)
+			return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+	}
+#endif
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#ifdef __APPLE__
+	return (unsigned long long)usage.ru_maxrss;
+#else
+	return (unsigned long long)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+// ------------------------------------------------------------------------------------------------
+
+// Result of one timed stage.
+struct StageResult
+{
+	std::string name;
+	double seconds;
+	unsigned long long bytes;
+	unsigned long long triangles;
+	unsigned long long peakRss;
+	// Whether peakRss is the stage's own peak rather than the process peak (see ResetPeakRss).
+	bool peakRssIsStage;
+	unsigned long long allocations;
+	unsigned long long allocatedBytes;
+	bool succeeded;
+};
+
+// All stages of one model file.
+struct ModelResult
+{
+	std::string path;
+	std::string kind;
+	unsigned long long fileSize;
+	int numVertices;
+	int numTriangles;
+	int numSubMeshes;
+	std::vector<StageResult> stages;
+	// Index order as parsed and as reordered by the loader (see TriangleMesh::OptimizeIndexOrder).
+	VertexCacheStats vertexCacheBefore;
+	VertexCacheStats vertexCacheAfter;
+	OverdrawStats overdrawBefore;
+	OverdrawStats overdrawAfter;
+	VertexFetchStats vertexFetchBefore;
+	VertexFetchStats vertexFetchAfter;
+};
+
+// Time a stage; the fastest of 'repeat' runs is kept (setup and teardown are not timed).
+template <typename Setup, typename Stage, typename Teardown>
+static StageResult RunStage(const std::string& name, const int repeat, Setup setup, Stage stage, Teardown teardown)
+{
+	StageResult result;
+	result.name = name;
+	result.seconds = 0.0;
+	result.bytes = result.triangles = 0;
+	result.allocations = result.allocatedBytes = 0;
+	result.peakRss = 0;
+	result.peakRssIsStage = true;
+	result.succeeded = true;
+	for (int i = 0; i < std::max(repeat, 1); i++) {
+		setup();
+		result.peakRssIsStage = ResetPeakRss() && result.peakRssIsStage;
+		const unsigned long long allocationsBefore = numAllocations.load();
+		const unsigned long long bytesBefore = numAllocatedBytes.load();
+		const auto startTime = std::chrono::steady_clock::now();
+		const bool succeeded = stage();
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		if (i == 0 || seconds < result.seconds) {
+			result.seconds = seconds;
+			result.allocations = numAllocations.load() - allocationsBefore;
+			result.allocatedBytes = numAllocatedBytes.load() - bytesBefore;
+		}
+		result.peakRss = std::max(result.peakRss, GetPeakRss());
+		result.succeeded = result.succeeded && succeeded;
+		teardown();
+	}
+	return result;
+}
+
+static unsigned long long GetFileSize(const std::string& filePath)
+{
+	std::error_code error;
+	const unsigned long long size = std::filesystem::file_size(filePath, error);
+	return error ? 0 : size;
+}
+
+// Material libraries named by the "mtllib" records of a model, with their folder.
+static std::vector<std::string> FindMaterialLibraries(const std::string& modelPath)
+{
+	std::vector<std::string> libraries;
+	std::ifstream file(modelPath);
+	const std::string folder = std::filesystem::path(modelPath).parent_path().string();
+	std::string line;
+	while (std::getline(file, line)) {
+		if (line.compare(0, 7, "mtllib ") == 0) {
+			std::string name = line.substr(7);
+			while (!name.empty() && std::isspace((unsigned char)name.back()))
+				name.pop_back();
+			libraries.push_back(folder.empty() ? name : folder + "/" + name);
+		}
+		// Libraries are declared before the geometry; stop at the first face or vertex record.
+		if (line.compare(0, 2, "f ") == 0 || line.compare(0, 4, "vtx ") == 0)
+			break;
+	}
+	return libraries;
+}
+
+// Benchmark the loader stages on one model file.
+static ModelResult BenchmarkModel(const std::string& modelPath, const std::string& kind, const int numThreads, const int repeat)
+{
+	ModelResult model;
+	model.path = modelPath;
+	model.kind = kind;
+	model.fileSize = GetFileSize(modelPath);
+	model.numVertices = model.numTriangles = model.numSubMeshes = 0;
+
+	TriangleMesh* mesh = nullptr;
+	auto newMesh = [&]() {
+		delete mesh;
+		// Every run decodes its textures again instead of reusing the previous run's.
+		TextureCache::Clear();
+		mesh = new TriangleMesh();
+		mesh->SetNumLoadThreads(numThreads);
+		mesh->SetUseCache(false);
+	};
+	auto noTeardown = []() {};
+
+	// 1. Parse (and weld) the model; normalization is measured on its own below.
+	StageResult load = RunStage("LoadFromFile", repeat, newMesh,
+		[&]() { return mesh->LoadFromFile(modelPath, false); }, noTeardown);
+	load.bytes = model.fileSize;
+	load.triangles = (unsigned long long)mesh->GetNumTriangles();
+	model.numVertices = mesh->GetNumVertices();
+	model.numTriangles = mesh->GetNumTriangles();
+	model.numSubMeshes = mesh->GetNumSubMeshes();
+	model.stages.push_back(load);
+
+	// 2. Normalize the loaded vertices (the loaded mesh is kept, so only one run makes sense).
+	StageResult normalize = RunStage("Normalize", 1, []() {},
+		[&]() { mesh->Normalize(); return true; }, noTeardown);
+	normalize.bytes = sizeof(VertexPTN) * (unsigned long long)mesh->GetNumVertices();
+	normalize.triangles = load.triangles;
+	model.stages.push_back(normalize);
+
+	// 3. Material libraries, including the decoding of their textures.
+	const std::vector<std::string> libraries = FindMaterialLibraries(modelPath);
+	if (!libraries.empty()) {
+		StageResult materials = RunStage("LoadMaterialsFromFile", repeat, newMesh,
+			[&]() {
+				bool succeeded = true;
+				for (const auto& library : libraries)
+					succeeded = mesh->LoadMaterialsFromFile(library) && succeeded;
+				mesh->WaitForTextures();
+				return succeeded;
+			}, noTeardown);
+		for (const auto& library : libraries)
+			materials.bytes += GetFileSize(library);
+		model.stages.push_back(materials);
+	}
+
+	// 4. Load again through the binary cache, for comparison with the text parse.
+	//    An untimed load writes the cache first.
+	newMesh();
+	mesh->SetUseCache(true);
+	mesh->LoadFromFile(modelPath, true);
+	StageResult cached = RunStage("LoadFromCache", repeat,
+		[&]() {
+			newMesh();
+			mesh->SetUseCache(true);
+		},
+		[&]() { return mesh->LoadFromFile(modelPath, true); }, noTeardown);
+	cached.bytes = model.fileSize;
+	cached.triangles = (unsigned long long)mesh->GetNumTriangles();
+	model.stages.push_back(cached);
+	model.vertexCacheBefore = mesh->GetVertexCacheBefore();
+	model.vertexCacheAfter = mesh->GetVertexCacheAfter();
+	model.overdrawBefore = mesh->GetOverdrawBefore();
+	model.overdrawAfter = mesh->GetOverdrawAfter();
+	model.vertexFetchBefore = mesh->GetVertexFetchBefore();
+	model.vertexFetchAfter = mesh->GetVertexFetchAfter();
+
+	delete mesh;
+	return model;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Synthetic models: a wavy n x n grid with positions, texcoords and normals.
+
+// Grid resolution whose two triangles per cell add up to at least numTriangles.
+static int GetGridSize(const unsigned long long numTriangles)
+{
+	int n = 1;
+	while (2ull * n * n < numTriangles)
+		n++;
+	return n;
+}
+
+static VertexPTN GetGridVertex(const int n, const int x, const int y)
+{
+	const float u = (float)x / n;
+	const float v = (float)y / n;
+	const float h = 0.05f * std::sin(u * 40.0f) * std::cos(v * 40.0f);
+	return VertexPTN(glm::vec3(u - 0.5f, h, v - 0.5f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec2(u, v));
+}
+
+// Write the grid as an indexed *.OBJ file with "v/vt/vn" corners.
+static bool WriteSyntheticObj(const std::string& filePath, const unsigned long long numTriangles)
+{
+	std::ofstream file(filePath, std::ios::binary);
+	if (!file)
+		return false;
+	const int n = GetGridSize(numTriangles);
+	file << "# LoaderBench grid, " << numTriangles << " triangles\n";
+	char line[160];
+	for (int y = 0; y <= n; y++) {
+		for (int x = 0; x <= n; x++) {
+			const VertexPTN vertex = GetGridVertex(n, x, y);
+			const int length = std::snprintf(line, sizeof(line), "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn 0 1 0\n",
+				vertex.position.x, vertex.position.y, vertex.position.z, vertex.texcoord.x, vertex.texcoord.y);
+			file.write(line, length);
+		}
+	}
+	unsigned long long written = 0;
+	for (int y = 0; y < n && written < numTriangles; y++) {
+		for (int x = 0; x < n && written < numTriangles; x++) {
+			const long long a = (long long)y * (n + 1) + x + 1;
+			const long long b = a + 1;
+			const long long c = a + (n + 1);
+			const long long d = c + 1;
+			int length = std::snprintf(line, sizeof(line), "f %lld/%lld/%lld %lld/%lld/%lld %lld/%lld/%lld\n", a, a, a, c, c, c, b, b, b);
+			file.write(line, length);
+			if (++written == numTriangles)
+				break;
+			length = std::snprintf(line, sizeof(line), "f %lld/%lld/%lld %lld/%lld/%lld %lld/%lld/%lld\n", b, b, b, c, c, c, d, d, d);
+			file.write(line, length);
+			written++;
+		}
+	}
+	return (bool)file;
+}
+
+// Write the grid as an *.OBJM triangle soup of "vtx px py pz u v nx ny nz" records.
+static bool WriteSyntheticObjm(const std::string& filePath, const unsigned long long numTriangles)
+{
+	std::ofstream file(filePath, std::ios::binary);
+	if (!file)
+		return false;
+	const int n = GetGridSize(numTriangles);
+	char line[160];
+	auto writeVertex = [&](const int x, const int y) {
+		const VertexPTN vertex = GetGridVertex(n, x, y);
+		const int length = std::snprintf(line, sizeof(line), "vtx %.6f %.6f %.6f %.6f %.6f 0 1 0\n",
+			vertex.position.x, vertex.position.y, vertex.position.z, vertex.texcoord.x, vertex.texcoord.y);
+		file.write(line, length);
+	};
+	unsigned long long written = 0;
+	for (int y = 0; y < n && written < numTriangles; y++) {
+		for (int x = 0; x < n && written < numTriangles; x++) {
+			writeVertex(x, y); writeVertex(x, y + 1); writeVertex(x + 1, y);
+			if (++written == numTriangles)
+				break;
+			writeVertex(x + 1, y); writeVertex(x, y + 1); writeVertex(x + 1, y + 1);
+			written++;
+		}
+	}
+	return (bool)file;
+}
+
+// Generate a synthetic file unless it already exists.
+static bool PrepareSyntheticModel(const std::string& filePath, const bool isObjm, const unsigned long long numTriangles)
+{
+	if (GetFileSize(filePath) > 0)
+		return true;
+	std::cerr << "[INFO] Generating " << filePath << std::endl;
+	const std::string tempPath = filePath + ".tmp";
+	const bool written = isObjm ? WriteSyntheticObjm(tempPath, numTriangles) : WriteSyntheticObj(tempPath, numTriangles);
+	std::error_code error;
+	if (written)
+		std::filesystem::rename(tempPath, filePath, error);
+	if (!written || error) {
+		std::filesystem::remove(tempPath, error);
+		std::cerr << "[ERROR] Could not write " << filePath << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+// JSON output.
+
+static std::string EscapeJson(const std::string& text)
+{
+	std::string escaped;
+	for (const char c : text) {
+		if (c == '"' || c == '\\') {
+			escaped += '\\';
+			escaped += c;
+		}
+		else if ((unsigned char)c < 0x20) {
+			char code[8];
+			std::snprintf(code, sizeof(code), "\\u%04x", c);
+			escaped += code;
+		}
+		else {
+			escaped += c;
+		}
+	}
+	return escaped;
+}
+
+static void WriteJson(std::ostream& out, const std::vector<ModelResult>& models, const int numThreads, const int repeat)
+{
+	out << std::fixed << std::setprecision(3);
+	out << "{\n";
+	out << "  \"threads\": " << (numThreads > 0 ? numThreads : (int)std::thread::hardware_concurrency()) << ",\n";
+	out << "  \"repeat\": " << repeat << ",\n";
+	out << "  \"models\": [\n";
+	for (size_t m = 0; m < models.size(); m++) {
+		const ModelResult& model = models[m];
+		out << "    {\n";
+		out << "      \"path\": \"" << EscapeJson(model.path) << "\",\n";
+		out << "      \"kind\": \"" << model.kind << "\",\n";
+		out << "      \"file_bytes\": " << model.fileSize << ",\n";
+		out << "      \"vertices\": " << model.numVertices << ",\n";
+		out << "      \"triangles\": " << model.numTriangles << ",\n";
+		out << "      \"submeshes\": " << model.numSubMeshes << ",\n";
+		out << "      \"acmr\": { \"loaded\": " << model.vertexCacheBefore.GetAcmr()
+			<< ", \"reordered\": " << model.vertexCacheAfter.GetAcmr() << " },\n";
+		out << "      \"overdraw\": { \"loaded\": " << model.overdrawBefore.GetOverdraw()
+			<< ", \"reordered\": " << model.overdrawAfter.GetOverdraw() << " },\n";
+		out << "      \"overfetch\": { \"before\": " << model.vertexFetchBefore.GetOverfetch()
+			<< ", \"after\": " << model.vertexFetchAfter.GetOverfetch() << " },\n";
+		out << "      \"stages\": [\n";
+		for (size_t s = 0; s < model.stages.size(); s++) {
+			const StageResult& stage = model.stages[s];
+			const double megaBytes = stage.bytes / (1024.0 * 1024.0);
+			out << "        { \"name\": \"" << stage.name << "\""
+				<< ", \"ok\": " << (stage.succeeded ? "true" : "false")
+				<< ", \"wall_ms\": " << stage.seconds * 1000.0
+				<< ", \"mb_per_s\": " << (stage.seconds > 0.0 ? megaBytes / stage.seconds : 0.0)
+				<< ", \"triangles_per_s\": " << (stage.seconds > 0.0 ? stage.triangles / stage.seconds : 0.0)
+				<< ", \"" << (stage.peakRssIsStage ? "peak_rss_bytes" : "process_peak_rss_bytes") << "\": " << stage.peakRss
+				<< ", \"allocations\": " << stage.allocations
+				<< ", \"allocated_bytes\": " << stage.allocatedBytes
+				<< " }" << (s + 1 < model.stages.size() ? "," : "") << "\n";
+		}
+		out << "      ]\n";
+		out << "    }" << (m + 1 < models.size() ? "," : "") << "\n";
+	}
+	out << "  ]\n";
+	out << "}\n";
+}
+
+// ------------------------------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+	std::string modelFolder = "../TestModels_HW3";
+	std::string dataFolder = "bench_data";
+	std::string outputPath;
+	std::vector<unsigned long long> sizes = { 1000000ull, 5000000ull, 10000000ull, 50000000ull };
+	int numThreads = 0;
+	int repeat = 3;
+	bool synthetic = true;
+
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+		const bool hasValue = (i + 1 < argc);
+		if (arg == "--models" && hasValue) {
+			modelFolder = argv[++i];
+		}
+		else if (arg == "--data" && hasValue) {
+			dataFolder = argv[++i];
+		}
+		else if (arg == "--out" && hasValue) {
+			outputPath = argv[++i];
+		}
+		else if (arg == "--threads" && hasValue) {
+			numThreads = std::atoi(argv[++i]);
+		}
+		else if (arg == "--repeat" && hasValue) {
+			repeat = std::max(1, std::atoi(argv[++i]));
+		}
+		else if (arg == "--sizes" && hasValue) {
+			sizes.clear();
+			std::stringstream list(argv[++i]);
+			std::string item;
+			while (std::getline(list, item, ','))
+				if (!item.empty())
+					sizes.push_back(std::strtoull(item.c_str(), nullptr, 10));
+		}
+		else if (arg == "--no-synthetic") {
+			synthetic = false;
+		}
+		else {
+			std::cerr << "Usage: LoaderBench [--models <dir>] [--data <dir>] [--sizes n1,n2,...] [--threads n] "
+						 "[--repeat n] [--no-synthetic] [--out <file.json>]" << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<ModelResult> results;
+
+	// Bundled models, in a stable order.
+	std::vector<std::string> modelPaths;
+	std::error_code error;
+	for (std::filesystem::recursive_directory_iterator it(modelFolder, error), end; !error && it != end; it.increment(error)) {
+		if (!it->is_regular_file())
+			continue;
+		std::string extension = it->path().extension().string();
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+		if (extension == ".obj" || extension == ".objm")
+			modelPaths.push_back(it->path().generic_string());
+	}
+	if (modelPaths.empty())
+		std::cerr << "Warning: No models found in " << modelFolder << std::endl;
+	std::sort(modelPaths.begin(), modelPaths.end());
+	for (const auto& modelPath : modelPaths) {
+		std::cerr << "[INFO] Benchmarking " << modelPath << std::endl;
+		results.push_back(BenchmarkModel(modelPath, "bundled", numThreads, repeat));
+	}
+
+	// Synthetic models of increasing size; large files run once.
+	if (synthetic) {
+		std::filesystem::create_directories(dataFolder, error);
+		for (const unsigned long long numTriangles : sizes) {
+			for (const bool isObjm : { false, true }) {
+				const std::string modelPath = dataFolder + "/grid_" + std::to_string(numTriangles) + (isObjm ? ".objm" : ".obj");
+				if (!PrepareSyntheticModel(modelPath, isObjm, numTriangles))
+					continue;
+				std::cerr << "[INFO] Benchmarking " << modelPath << std::endl;
+				results.push_back(BenchmarkModel(modelPath, "synthetic", numThreads, numTriangles >= 10000000ull ? 1 : repeat));
+				std::filesystem::remove(modelPath + ".meshcache", error);
+			}
+		}
+	}
+
+	if (outputPath.empty()) {
+		WriteJson(std::cout, results, numThreads, repeat);
+	}
+	else {
+		std::ofstream out(outputPath);
+		if (!out) {
+			std::cerr << "[ERROR] Could not write " << outputPath << std::endl;
+			return 1;
+		}
+		WriteJson(out, results, numThreads, repeat);
+	}
+	return 0;
+}